@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/*
+  Boot timeline and the dependencies between the init stages.
+
+  The subsystems are started as tasks from setup() and initialize in parallel, a task that
+  needs something from another task waits for its bit with bootWaitFor() and the task that
+  provides it calls bootSignal() when done:
+
+    BOOT_I2C_READY   GUI task has setup the touch I2C bus (initRTC() use the same bus)
+    BOOT_RTC_READY   System time is set from the HW RTC and the timebase is anchored, BT scan
+                     and the scanner link wait for it so no detection is stamped before
+    BOOT_GUI_READY   GUI task has created all tabs and is handling queueGFX
+
+  Every stage is timed with bootStageStart()/bootStageDone() (us since power on from
+  esp_timer) and logged with task and core when done. bootReport() logs the whole timeline,
+  it's called by RaceDB when laps are counted, e.g. after a brown-out in the middle of a race.
+*/
+
+#define BOOT_I2C_READY  (1 << 0)
+#define BOOT_RTC_READY  (1 << 1)
+#define BOOT_GUI_READY  (1 << 2)
+
+#define BOOT_WAIT_TIMEOUT 10000 // ms, esp_restart() if a dependency is not ready in this time
+#define BOOT_MAX_STAGES   16
+
+void bootInit(); // Must be called before starting all tasks as they might wait for each other
+void bootSignal(EventBits_t bits);
+void bootWaitFor(EventBits_t bits, const char *who);
+
+uint32_t bootStageStart(const char *name); // Return stage to use in bootStageDone()
+void bootStageDone(uint32_t stage);
+void bootReport();
@@ -17,41 +17,44 @@ extern uint32_t raceStartIn;
 extern bool raceOngoing;
 
 #define TASK_BT_PRIO 20
+#define TASK_SCANNERLINK_PRIO 15
 #define TASK_RACEDB_PRIO 10
 #define TASK_GUI_PRIO 5
+#define TASK_GUI_FLUSH_PRIO 6 // Copies LVGL draw buffers to the panel while the GUI task renders
+#define TASK_LOG_PRIO 2 // Drains the deferred log, see deferredLog.h
 
 // Stack size in words, not bytes.
 #define TASK_BT_STACK (6*1024)
+#define TASK_SCANNERLINK_STACK (4*1024)
 #define TASK_RACEDB_STACK (70*1024)
 #define TASK_GUI_STACK (90*1024)
+#define TASK_GUI_FLUSH_STACK (3*1024)
+#define TASK_LOG_STACK (4*1024)
 
 // The participant to show for goal in the graph
 // 4 = ZINGO
 #define DEFAULT_PARTICIPANT 4
-// The participant the goal
+// Goal (m) of DEFAULT_PARTICIPANT when the race file has none, also the graph distance
+// scale in time based races when the shown participant has no goal
 #define DEFAULT_PARTICIPANT_GOAL (170*1000)
 
-// If ALL_TAGS_TRIGGER_DEFAULT_PARTICIPANT is defined
-// any of the registrated tags will trigger the DEFAULT_PARTICIPANT
-// instead of the correct participant.
-// This is a temporary fix for a one man race mode, e.g. using this as a
-// your own race timetaking in a 24H race to get the special nice info from
-// the graph view and ALSO give the increased lap detection of having more
-// then one TAG.
-// e.g. Im the only one using this and to make it less likely for fails
-// or missed detection I will bring 2-3 tags.
-// Plan is to make it possible to asign more TAGs per user in the future and
-// remove this config from here.
-#define ALL_TAGS_TRIGGER_DEFAULT_PARTICIPANT
+// Each participant can have a goal, a distance (m) at the race maxTime. The goal plan
+// expects GOAL_HALFTIME_SHARE of it at half time (everyone slows down) and the graph
+// draws GOAL_BAND_FASTER/GOAL_BAND_SLOWER lines around it.
+#define GOAL_HALFTIME_SHARE 0.60
+#define GOAL_BAND_FASTER 1.10
+#define GOAL_BAND_SLOWER 0.95
 
 
 extern TaskHandle_t xHandleBT;
+extern TaskHandle_t xHandleScannerLink;
 extern TaskHandle_t xHandleRaceDB;
 extern TaskHandle_t xHandleGUI;
 
 void saveRace(); // Send signal to save race
 
 void showHeapInfo(void);
+void initLittleFS();
 
 // TODO move below to signals to remove access to global variables
 void startRaceCountdown(time_t countDownValue);
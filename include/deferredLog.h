@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+/*
+  Deferred logging for hot paths like the lap detection, so log volume never slows down
+  lap processing, not even with verbose logging during a race.
+
+  DLOGI(TAG, "fmt", args...) etc. only copy the arguments into a ring of DEFERRED_LOG_RECORDS
+  records in PSRAM, no formatting and no UART. A low priority task formats and drains them
+  with the normal ESP_LOGx every DEFERRED_LOG_DRAIN_PERIOD, with the capture time first:
+
+    [@<ms since boot>] <text>
+
+  Rules for the arguments:
+    - fmt must be a string literal, it's only formatted later.
+    - At most DEFERRED_LOG_MAX_ARGS arguments, integers, floats, pointers and strings.
+    - Strings (char *) are copied, use c_str() for std::string. All strings of one line share
+      DEFERRED_LOG_STRING_SPACE bytes, longer is truncated.
+    - deferredLogTime{ms since epoch} with %s is formatted as local time by the drain task,
+      instead of localtime_r()/strftime() in the hot path.
+
+  Each call site is rate limited to DEFERRED_LOG_SITE_LIMIT lines per DEFERRED_LOG_SITE_WINDOW,
+  e.g. a unknown tag advertising. The number of suppressed lines is added to the next line
+  from the same site. If the ring is full the line is dropped, the drain task reports how many.
+  Lines above DEFERRED_LOG_LEVEL (default CORE_DEBUG_LEVEL) are removed at compile time.
+*/
+
+#define DEFERRED_LOG_RECORDS       1024 // ~160 bytes each
+#define DEFERRED_LOG_MAX_ARGS      8
+#define DEFERRED_LOG_STRING_SPACE  64
+#define DEFERRED_LOG_SITE_LIMIT    20   // Lines per call site and window
+#define DEFERRED_LOG_SITE_WINDOW   1000 // ms
+#define DEFERRED_LOG_DRAIN_PERIOD  50   // ms
+
+#define DEFERRED_LOG_ERROR   1
+#define DEFERRED_LOG_WARN    2
+#define DEFERRED_LOG_INFO    3
+#define DEFERRED_LOG_DEBUG   4
+#define DEFERRED_LOG_VERBOSE 5
+
+#ifndef DEFERRED_LOG_LEVEL
+#ifdef CORE_DEBUG_LEVEL
+#define DEFERRED_LOG_LEVEL CORE_DEBUG_LEVEL
+#else
+#define DEFERRED_LOG_LEVEL DEFERRED_LOG_INFO
+#endif
+#endif
+
+struct deferredLogTime {
+  int64_t ms; // ms since epoch, see timebase.h
+};
+
+enum deferredLogArgType : uint8_t {
+  DEFERRED_LOG_ARG_INT,
+  DEFERRED_LOG_ARG_UINT,
+  DEFERRED_LOG_ARG_DOUBLE,
+  DEFERRED_LOG_ARG_PTR,
+  DEFERRED_LOG_ARG_STRING, // Offset in strings
+  DEFERRED_LOG_ARG_TIME
+};
+
+union deferredLogValue {
+  int64_t i;
+  uint64_t u;
+  double d;
+  const void *p;
+};
+
+struct deferredLogRecord {
+  std::atomic<bool> ready; // Set when all arguments are captured
+  uint8_t level;
+  uint8_t argCount;
+  uint8_t stringUsed;
+  uint32_t timeMs;         // ms since boot when captured
+  uint32_t suppressed;     // Lines suppressed at this site before this one
+  const char *tag;
+  const char *fmt;
+  deferredLogArgType types[DEFERRED_LOG_MAX_ARGS];
+  deferredLogValue values[DEFERRED_LOG_MAX_ARGS];
+  char strings[DEFERRED_LOG_STRING_SPACE];
+
+  void add(deferredLogArgType type, deferredLogValue value);
+  void addString(const char *str, deferredLogArgType type = DEFERRED_LOG_ARG_STRING);
+};
+
+struct deferredLogSite {
+  uint32_t windowStartMs;
+  uint32_t count;
+  uint32_t suppressed;
+};
+
+void deferredLogInit(); // Call first in setup(), before any task use DLOGx
+deferredLogRecord *deferredLogBegin(deferredLogSite &site, uint8_t level, const char *tag, const char *fmt); // nullptr = skip
+void deferredLogCommit(deferredLogRecord *record);
+
+// Capture of each argument type
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+deferredLogArg(deferredLogRecord &record, T value) { deferredLogValue v; v.i = value; record.add(DEFERRED_LOG_ARG_INT, v); }
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+deferredLogArg(deferredLogRecord &record, T value) { deferredLogValue v; v.u = value; record.add(DEFERRED_LOG_ARG_UINT, v); }
+template<typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type
+deferredLogArg(deferredLogRecord &record, T value) { deferredLogValue v; v.i = static_cast<int64_t>(value); record.add(DEFERRED_LOG_ARG_INT, v); }
+template<typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+deferredLogArg(deferredLogRecord &record, T value) { deferredLogValue v; v.d = value; record.add(DEFERRED_LOG_ARG_DOUBLE, v); }
+template<typename T>
+inline void deferredLogArg(deferredLogRecord &record, T *value) { deferredLogValue v; v.p = value; record.add(DEFERRED_LOG_ARG_PTR, v); }
+inline void deferredLogArg(deferredLogRecord &record, const char *value) { record.addString(value); }
+inline void deferredLogArg(deferredLogRecord &record, char *value) { record.addString(value); }
+inline void deferredLogArg(deferredLogRecord &record, deferredLogTime value) { deferredLogValue v; v.i = value.ms; record.add(DEFERRED_LOG_ARG_TIME, v); }
+
+inline void deferredLogArgs(deferredLogRecord &) {}
+template<typename T, typename... Rest>
+inline void deferredLogArgs(deferredLogRecord &record, T value, Rest... rest)
+{
+  deferredLogArg(record, value);
+  deferredLogArgs(record, rest...);
+}
+
+template<typename... Args>
+inline void deferredLogCapture(deferredLogRecord *record, Args... args)
+{
+  static_assert(sizeof...(Args) <= DEFERRED_LOG_MAX_ARGS, "Too many arguments for a deferred log line");
+  deferredLogArgs(*record, args...);
+  deferredLogCommit(record);
+}
+
+#define DLOG(level, tag, fmt, ...) do { \
+    if ((level) <= DEFERRED_LOG_LEVEL) { \
+      static deferredLogSite deferredLogSite_ = {}; \
+      deferredLogRecord *deferredLogRecord_ = deferredLogBegin(deferredLogSite_, (level), (tag), (fmt)); \
+      if (deferredLogRecord_ != nullptr) { \
+        deferredLogCapture(deferredLogRecord_, ##__VA_ARGS__); \
+      } \
+    } \
+  } while (0)
+
+#define DLOGE(tag, fmt, ...) DLOG(DEFERRED_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG(DEFERRED_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG(DEFERRED_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...) DLOG(DEFERRED_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define DLOGV(tag, fmt, ...) DLOG(DEFERRED_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
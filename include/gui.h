@@ -9,4 +9,7 @@ static const uint32_t screenHeight = 480;
 void initLVGL();
 
 // Call this in the loop to update GFX
-void loopHandlLVGL();
\ No newline at end of file
+void loopHandlLVGL();
+// Number of labels/widgets the GUI changed during the last second, updates that would not
+// change what is shown are skipped and not counted
+uint32_t guiInvalidationsPerSecond();
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  Heap accounting per subsystem, fragmentation and a leak/trend alarm.
+
+  Memory is charged to a subsystem in two ways:
+
+    heapTrackAlloc()/heapTrackFree()  Exact, used where we own the allocator, e.g. the
+                                      ArduinoJson documents of the race/config files.
+    HEAP_TRACK_SCOPE(subsystem)       Net change of the free heap from here to the end of the
+                                      scope, e.g. handling one message. Other tasks allocating
+                                      at the same time end up in it too, so it is only summed
+                                      per HEAP_STATS_PERIOD (window) and never accumulated,
+                                      a hint of who allocated lately, not what they hold.
+
+  The LVGL objects live in LVGL's own pool (LV_MEM_SIZE), the GUI task reports its usage
+  and fragmentation with heapStatsSetLvgl().
+
+  heapStatsSample() is called from loop() every HEAP_STATS_PERIOD. It samples free, largest
+  free block, minimum ever free and fragmentation (100 - largest block / free) of internal RAM
+  and PSRAM and logs them as one line that is easy to parse from the serial log:
+
+    HEAP,<uptimeMs>,<intFree>,<intLargest>,<intMinFree>,<intFrag>,<psramFree>,<psramLargest>,<psramFrag>,
+         <lvglUsed>,<lvglFrag>,<intTrend>,<alarm>[,<subsystem>:<bytes>:<peak>:<allocs>:<window>:<scopes>]...
+
+  bytes/peak/allocs are the exact accounting (0 if the subsystem has none), window/scopes the
+  summed HEAP_TRACK_SCOPE changes and the number of scopes during the last period.
+
+  intTrend is the slope (bytes/hour) of internal free RAM over the last HEAP_TREND_SAMPLES
+  samples. The alarm is raised (ESP_LOGE "HEAP ALARM") if internal free RAM is below
+  HEAP_INTERNAL_RESERVE or the trend will take it there within HEAP_ALARM_HOURS.
+*/
+
+#define HEAP_STATS_PERIOD     60      // s
+#define HEAP_TREND_SAMPLES    60      // Trend over the last hour
+#define HEAP_INTERNAL_RESERVE (32*1024) // bytes
+#define HEAP_ALARM_HOURS      12
+
+enum heapSubsystem {
+  HEAP_RACEDB,
+  HEAP_PERSISTENCE,
+  HEAP_GUI,
+  HEAP_BT,
+  HEAP_SUBSYSTEMS
+};
+
+struct heapSubsystemStats {
+  int64_t bytes;         // Currently charged by heapTrackAlloc()/heapTrackFree()
+  int64_t peak;
+  uint32_t allocs;
+  int64_t window;        // Free heap change in HEAP_TRACK_SCOPE during the last period
+  uint32_t windowScopes;
+};
+
+struct heapStatsSnapshot {
+  int64_t uptimeMs;
+  size_t internalFree;
+  size_t internalLargest;
+  size_t internalMinFree;
+  uint8_t internalFrag; // %
+  size_t psramFree;
+  size_t psramLargest;
+  uint8_t psramFrag;    // %
+  size_t lvglUsed;
+  uint8_t lvglFrag;     // %
+  int32_t internalTrend; // bytes/hour, negative = shrinking
+  bool alarm;
+  heapSubsystemStats subsystems[HEAP_SUBSYSTEMS];
+};
+
+const char *heapSubsystemName(heapSubsystem subsystem);
+void heapTrackAlloc(heapSubsystem subsystem, size_t bytes);
+void heapTrackFree(heapSubsystem subsystem, size_t bytes);
+void heapStatsSetLvgl(size_t used, uint8_t frag);
+
+void heapStatsSample(); // Only call from one task
+void heapStatsGet(heapStatsSnapshot &snapshot);
+
+class heapTrackScope {
+  public:
+    explicit heapTrackScope(heapSubsystem inSubsystem);
+    ~heapTrackScope();
+  private:
+    heapSubsystem subsystem;
+    size_t freeAtStart;
+};
+
+#define HEAP_TRACK_CONCAT2(a, b) a##b
+#define HEAP_TRACK_CONCAT(a, b) HEAP_TRACK_CONCAT2(a, b)
+#define HEAP_TRACK_SCOPE(subsystem) heapTrackScope HEAP_TRACK_CONCAT(heapTrackScope_, __LINE__)(subsystem)
@@ -62,25 +62,21 @@ union msg_BroadcastMessages
 struct msg_iTagDetected //TODO creat union see union msg_GFX for inspiration
 {
   msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
-  time_t time;
+  int64_t timeMs; // ms since epoch, see timebase.h
   uint64_t address;
   int8_t RSSI;
   int8_t battery;
+  uint8_t receiverId; // RECEIVER_ID_LOCAL or the scanner node that detected the tag, see scannerLink.h
 };
 
+#define RECEIVER_ID_LOCAL 0 // Detected by our own BT scan
+
 #define MSG_ITAG_CONFIG                  0x1000 //msg_iTagDetected queueBTConnect
+#define MSG_ITAG_READ_BATTERY            0x1001 //msg_iTagDetected queueBTConnect
 
 
 // ##################### Send to queueRaceDB
 
-struct msg_AddParticipantResponse
-{
-  msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
-  uint32_t handleDB;
-  uint32_t handleGFX;
-  bool wasOK;
-};
-
 // Used when editing a user
 struct msg_UpdateParticipantInDB
 {
@@ -109,6 +105,14 @@ struct msg_UpdateParticipantLapCount
   int32_t lapDiff;  //Value is added to lap negative values will result in a subtraction.
 };
 
+struct msg_UpdateParticipantGoal
+{
+  msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
+  uint32_t handleDB;
+  uint32_t handleGFX;
+  uint32_t goal;    // Distance in m at race maxTime, 0 is no goal
+};
+
 struct msg_LoadSaveRace
 {
   msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
@@ -128,10 +132,10 @@ union msg_RaceDB
   msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
   msg_BroadcastMessages Broadcast;
   msg_iTagDetected iTag;
-  msg_AddParticipantResponse AddedToGFX;
   msg_UpdateParticipantInDB UpdateParticipant;
   msg_UpdateParticipantRaceStatus UpdateParticipantRaceStatus;
   msg_UpdateParticipantLapCount UpdateParticipantLapCount;
+  msg_UpdateParticipantGoal UpdateParticipantGoal;
   msg_LoadSaveRace LoadRace;
   msg_LoadSaveRace SaveRace;
   msg_Timer Timer;
@@ -140,12 +144,13 @@ union msg_RaceDB
 // TODO this chould be class enum to avoid typo misstakes
 #define MSG_ITAG_DETECTED                0x2000 //msg_iTagDetected queueRaceDB
 #define MSG_ITAG_CONFIGURED              0x2001 //msg_iTagDetected queueRaceDB
-#define MSG_ITAG_GFX_ADD_USER_RESPONSE   0x2002 //msg_AddParticipantResponse queueRaceDB
 #define MSG_ITAG_UPDATE_USER             0x2003 //msg_UpdateParticipantInDB queueRaceDB
 #define MSG_ITAG_UPDATE_USER_RACE_STATUS 0x2004 //msg_UpdateParticipantRaceStatus queueRaceDB
 #define MSG_ITAG_UPDATE_USER_LAP_COUNT   0x2005 //msg_UpdateParticipantRaceStatus queueRaceDB
 #define MSG_ITAG_LOAD_RACE               0x2006 //msg_LoadSaveRace queueRaceDB
 #define MSG_ITAG_SAVE_RACE               0x2007 //msg_LoadSaveRace queueRaceDB
+#define MSG_ITAG_BATTERY                 0x2008 //msg_iTagDetected queueRaceDB, battery is INT8_MIN if read failed
+#define MSG_ITAG_UPDATE_USER_GOAL        0x2009 //msg_UpdateParticipantGoal queueRaceDB
 // "internal" update GUI timer tick
 #define MSG_ITAG_TIMER_2000              0x2100 //msg_Timer queueRaceDB
 
@@ -153,15 +158,28 @@ union msg_RaceDB
 // ##################### Send to queueGFX
 
 
-// Startup setup of all participants in GUI will respond with MSG_ITAG_GFX_ADD_USER_RESPONSE containing the handleGFX that is later used
-struct msg_AddParticipant
+// One entry per participant in the startup registration table, RaceDB fill in the first part
+// and the GUI fill in handleGFX/wasOK
+struct participantRegistration
 {
-  msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct 
   uint32_t handleDB;
   uint32_t color0;
   uint32_t color1;
   char name[PARTICIPANT_NAME_LENGTH+1]; // add one for nulltermination
   bool inRace;
+  // Filled in by GUI
+  uint32_t handleGFX;
+  bool wasOK;
+};
+
+// Startup setup of all participants in GUI in one go. The table is owned by the sender (RaceDB) and
+// the GUI must not touch it after it has notified replyTask (xTaskNotifyGive()) that all handleGFX are set
+struct msg_AddParticipants
+{
+  msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
+  participantRegistration *participants;
+  uint32_t count;
+  TaskHandle_t replyTask;
 };
 
 // Used when loading or reconfig a user
@@ -185,8 +203,8 @@ struct msg_UpdateParticipantData
   uint32_t handleGFX;
   uint32_t distance;
   uint32_t laps;
-  time_t lastLapTime;  //seconds since start of Race, This is used with laps ONLY for newLap registration
-  time_t lastSeenTime; //seconds since start of Race, If this and laps is present this updates lastSeenTime values in graph
+  int64_t lastLapTimeMs;  //ms since start of Race, This is used with laps ONLY for newLap registration
+  int64_t lastSeenTimeMs; //ms since start of Race, If this and laps is present this updates lastSeenTime values in graph
   int8_t connectionStatus; //0 = not connected for long time, 1 not connected for short time  If <0 Connected now value is RSSI
   bool inRace;   // Is participand in a race of not
 };
@@ -198,26 +216,57 @@ struct msg_UpdateParticipantStatus
   uint32_t handleGFX;
   int8_t connectionStatus; //0 = not connected for long time, 1 = not connected for short time  If <0 Connected now value is RSSI
   int8_t battery; // 0-100%
+  int16_t batteryHoursLeft; // Estimated from battery drain trend, -1 = unknown
+  bool batteryLow; // Battery is low or estimated to not last the race
   bool inRace; // Use inRace to move participant in/out of race table in GUI
 };
 
+// Sent when laps or current lap start of a participant changed, all times in ms
+struct msg_UpdateParticipantLapStats
+{
+  msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
+  uint32_t handleGFX;
+  uint32_t laps;
+  int64_t lastLapTime;    // 0 if no lap yet
+  int64_t bestLapTime;    // 0 if no lap yet
+  int64_t averageLapTime; // 0 if no lap yet
+  int64_t lastNLapTime;   // Average of the last LAP_STATS_LAST_N laps, 0 if no lap yet
+  uint32_t averagePace;   // s/km from start
+  uint32_t currentPace;   // s/km over the last LAP_STATS_LAST_N laps
+  uint32_t projectedDistance; // m at race maxTime with current pace
+  int64_t projectedFinishTime; // ms since race start when race distance is reached with current pace (distance races), 0 if unknown
+  uint32_t goal;          // m at race maxTime, 0 if no goal (then the rest of the goal fields are 0)
+  int32_t goalAhead;      // m ahead (negative behind) of the goal plan at the last lap
+  uint32_t goalPace;      // s/km needed from the last lap to reach the next goal checkpoint
+};
+
+// Sent by RaceDB when a participant changes position in the standings (laps, then who reached it first),
+// the GUI moves the participants row to position and all rows in between shift one step.
+struct msg_StandingsMove
+{
+  msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
+  uint32_t handleGFX;
+  uint32_t position; // 0 = leader
+};
+
 union msg_GFX
 {
   msgHeader header; //Must be first in all msg, used to interpertate and select rest of struct
   msg_BroadcastMessages Broadcast;
-  msg_AddParticipant AddUser;
+  msg_AddParticipants AddUsers;
   msg_UpdateParticipant UpdateUser;
   msg_UpdateParticipantData UpdateUserData;
   msg_UpdateParticipantStatus UpdateStatus;
-  msg_Timer Timer;
+  msg_StandingsMove StandingsMove;
+  msg_UpdateParticipantLapStats UpdateLapStats;
 };
 
-#define MSG_GFX_ADD_USER           0x3000 //msg_AddParticipant queueGFX
+#define MSG_GFX_ADD_USERS          0x3000 //msg_AddParticipants queueGFX
 #define MSG_GFX_UPDATE_USER        0x3001 //msg_UpdateParticipant queueGFX
 #define MSG_GFX_UPDATE_USER_DATA   0x3002 //msg_UpdateParticipantData queueGFX
 #define MSG_GFX_UPDATE_USER_STATUS 0x3003 //msg_UpdateParticipantStatus queueGFX
-// "internal" update GUI timer tick
-#define MSG_GFX_TIMER              0x3100 //msg_Timer queueGFX
+#define MSG_GFX_STANDINGS_MOVE     0x3004 //msg_StandingsMove queueGFX
+#define MSG_GFX_UPDATE_USER_STATS  0x3005 //msg_UpdateParticipantLapStats queueGFX
 
 extern QueueHandle_t queueRaceDB;  // msg_RaceDB Task/Database manager is blocked reading from this
 extern QueueHandle_t queueBTConnect;     // msg_iTagDetected Bluetooth task is blocked reading from this
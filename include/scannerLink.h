@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+  initScannerLink() will start a Task that receive detections from extra scanner nodes
+  (helpers) over a UART link, useful when one antenna position don't cover the whole
+  depot or start/finish area.
+
+  Each helper runs this firmware built with -DSCANNER_HELPER, instead of sending
+  MSG_ITAG_DETECTED to its own RaceDB it forward each detection over the link as
+  one text line:
+
+    $D,<receiverId>,<timeMs>,<address>,<rssi>,<battery>*<checksum>\n
+
+    receiverId  1-SCANNER_LINK_MAX_RECEIVERS-1, unique per helper (0 is RECEIVER_ID_LOCAL)
+    timeMs      Helpers own clock in ms since epoch
+    address     BT address e.g. ff:ff:10:7e:82:46
+    rssi        dBm
+    battery     0-100 or -128 if unknown
+    checksum    Two hex digits, XOR of all chars between $ and * (like NMEA)
+
+  As it's plain text a host side process can stand in for a helper during testing,
+  tools/scanner_helper.py does that from a USB serial adapter, e.g. this line is tag
+  ff:ff:10:7e:82:46 seen by helper 1 at -60 dBm, battery unknown:
+
+    $D,1,1700000000000,ff:ff:10:7e:82:46,-60,-128*33
+
+  To keep the clocks aligned the main unit pings each helper it has heard from
+  every few seconds and the helper answers directly, NTP style:
+
+    $S,<receiverId>,<seq>,<t1>*<checksum>\n              main -> helper
+    $R,<receiverId>,<seq>,<t1>,<t2>,<t3>*<checksum>\n    helper -> main
+
+    t1  Main time when ping was sent
+    t2  Helper time when ping was received
+    t3  Helper time when answer was sent
+
+  From the round trip the main unit keeps a ms offset and a drift (ppm) estimate per
+  receiver, answers with a long round trip are ignored. Until a helper has answered
+  the offset is taken from the detection lines alone.
+
+  The main unit converts the helpers time to its own clock with this per receiver
+  offset and send MSG_ITAG_DETECTED with receiverId set to queueRaceDB (RaceDB task)
+  where it is deduplicated and fused with our own detections.
+*/
+
+#define SCANNER_LINK_MAX_RECEIVERS 8
+#ifndef SCANNER_HELPER_ID
+#define SCANNER_HELPER_ID 1 // receiverId used when built as helper, use -DSCANNER_HELPER_ID=x for more helpers
+#endif
+
+void initScannerLink();
+
+#ifdef SCANNER_HELPER
+struct msg_iTagDetected;
+void scannerLinkSendDetection(const msg_iTagDetected &msg_iTag);
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+  Runtime statistics of all FreeRTOS tasks, ours and the system ones (NimBLE host and
+  controller, timer daemon, esp_timer, idle...). sysStatsSample() is called from loop()
+  every SYS_STATS_PERIOD and the last sample can be read by other tasks with sysStatsGet(),
+  e.g. the GUI diagnostics tab.
+
+    load       Share of one core the task used since the previous sample.
+    core load  100% minus the load of the cores idle task.
+    stackFree  Least free stack the task ever had (high water mark).
+
+  FreeRTOS in the Arduino IDF build is built without configGENERATE_RUN_TIME_STATS so there
+  are no run time counters. Instead a tick hook on each core samples which task is running
+  at every FreeRTOS tick (1 kHz), ~5000 samples per core and period. Tasks that only run for
+  short bursts right after the tick (e.g. woken by a timer) are under counted. Context
+  switches need a traceTASK_SWITCHED_IN hook compiled into FreeRTOS, the precompiled one
+  has none, so they are shown as n/a until the build has it.
+
+  Each sample is also logged as one line that is easy to parse from the serial log:
+
+    STATS,<uptimeMs>,<core0Load>,<core1Load>,<taskCount>[,<name>:<core>:<prio>:<load>:<stackFree>:<switches>]...
+
+    core      0/1 or - if the task is not pinned to a core
+    load      %, - if unknown (first sample)
+    switches  Always n/a, see above
+*/
+
+#define SYS_STATS_PERIOD       5 // s
+#define SYS_STATS_MAX_TASKS    32
+#define SYS_STATS_LOAD_UNKNOWN 0xFF
+
+struct sysTaskStats {
+  char name[configMAX_TASK_NAME_LEN];
+  TaskHandle_t handle;
+  BaseType_t core;       // tskNO_AFFINITY if not pinned
+  UBaseType_t priority;
+  uint8_t load;          // %, SYS_STATS_LOAD_UNKNOWN if unknown
+  uint32_t stackFree;    // High water mark
+  uint32_t ticks;        // Ticks the task was seen running since the previous sample
+};
+
+struct sysStatsSnapshot {
+  int64_t uptimeMs;
+  uint8_t coreLoad[portNUM_PROCESSORS]; // %, SYS_STATS_LOAD_UNKNOWN if unknown
+  uint32_t taskCount;
+  sysTaskStats tasks[SYS_STATS_MAX_TASKS]; // Highest load first
+};
+
+void sysStatsSample(); // Only call from one task
+void sysStatsGet(sysStatsSnapshot &snapshot);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+  Millisecond timebase used for everything that needs the time (detections, lap times,
+  race start/end, GUI clock). Nothing should read or set the rtc (ESP32Time) directly
+  except the code that syncs the system time from the HW RTC or NTP.
+
+  timebaseNowMs() returns ms since epoch from the current clock, timebaseNow() the same in s.
+
+  The clock can be replaced with timebaseSetClock(), e.g. to run races faster then real time
+  in tests and benchmarks without touching the system time:
+
+    timebaseRealClock     Default. Counted with esp_timer (monotonic us since boot) from an
+                          anchor taken from the RTC (rtc, e.g. the system time). Small
+                          adjustments of the system time will not make lap times jump, but if
+                          the clock is set (e.g. from HW RTC or NTP) we follow it and re-anchor.
+    timebaseScaledClock   Starts at the real time when started and then runs scale times faster.
+
+  timebaseAnchor() takes a new anchor of the real clock, this is done at boot and when the
+  race countdown starts so the race is timed without any steps.
+*/
+
+class timebaseClock {
+  public:
+    virtual ~timebaseClock() {}
+    virtual int64_t nowMs() = 0; // ms since epoch
+    virtual uint32_t speed() {return 1;} // Clock ms per real ms, 0 if it don't follow real time
+};
+
+class timebaseRealClock : public timebaseClock {
+  public:
+    int64_t nowMs() override;
+    void anchor();
+  private:
+    bool anchored = false;
+    int64_t anchorEpochMs = 0; // RTC time at anchor
+    int64_t anchorTimerUs = 0; // esp_timer at anchor
+};
+
+class timebaseScaledClock : public timebaseClock {
+  public:
+    explicit timebaseScaledClock(uint32_t inScale) : scale(inScale) {}
+    void start(); // From current real time
+    int64_t nowMs() override;
+    uint32_t speed() override {return scale;}
+  private:
+    uint32_t scale;
+    int64_t startEpochMs = 0;
+    int64_t startTimerUs = 0;
+};
+
+// nullptr selects the real clock again, the clock must live as long as it is used
+void timebaseSetClock(timebaseClock *clock);
+bool timebaseIsRealClock();
+uint32_t timebaseClockSpeed(); // See timebaseClock::speed()
+
+// Real time (us) until the clock reaches atMs, e.g. to arm a esp_timer. Clocks that don't
+// follow real time return maxUs so the caller will check again.
+uint64_t timebaseRealUsUntil(int64_t atMs, uint64_t maxUs);
+
+void timebaseAnchor();
+int64_t timebaseNowMs();
+time_t timebaseNow();
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+  Lightweight event tracer, to see where time is spent and where e.g. a lap detection waited
+  on its way from the BT scan callback through RaceDB to the GUI.
+
+  Each core has its own ring buffer of TRACE_EVENTS_PER_CORE events in PSRAM. A trace point
+  reserves its slot with an atomic increment, no locks, so it can be used from any task. When
+  the ring is full the oldest events are overwritten.
+
+    TRACE_SCOPE(id, arg)      Begin/end event around the rest of the scope
+    TRACE_BEGIN(id, arg) / TRACE_END(id)
+    TRACE_INSTANT(id, arg)    Single point in time, e.g. a detected tag
+    TRACE_COUNTER(id, value)  A value over time, e.g. messages waiting in a queue
+
+  All trace points are removed at compile time with -DTRACE_ENABLED=0.
+
+  Send "t" on the serial monitor to dump the buffer to the serial log, or "T" to save it to
+  TRACE_FILE on LittleFS. Convert the log/file on the host into a Chrome trace JSON timeline
+  (chrome://tracing or https://ui.perfetto.dev) with:
+
+    python tools/trace2chrome.py <log or trace file> > trace.json
+
+  Dump format, one line per record, lines from other logs in between are ignored:
+
+    TRACE,START,<nowUs>,<eventsPerCore>
+    TRACE,ID,<id>,<name>
+    TRACE,TASK,<handle>,<name>
+    TRACE,EV,<core>,<timeUs>,<task handle>,<id>,<B|E|i|C>,<arg>
+    TRACE,END
+*/
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+#define TRACE_EVENTS_PER_CORE 2048 // Must be a power of 2, 16 bytes each
+#define TRACE_FILE "/trace.txt"
+
+enum traceId : uint16_t {
+  TRACE_BT_ITAG_SEEN,     // Instant, arg = lower 32 bits of the tag address
+  TRACE_BT_CONNECT,       // Scope, arg = 1 configure, 0 read battery
+  TRACE_SEND_RACEDB,      // Scope around xQueueSend(queueRaceDB), arg = msgType
+  TRACE_SEND_GFX,         // Scope around xQueueSend(queueGFX), arg = msgType
+  TRACE_RACEDB_MSG,       // Scope, RaceDB handling one message, arg = msgType
+  TRACE_RACEDB_QUEUED,    // Counter, messages waiting in queueRaceDB
+  TRACE_GFX_MSG,          // Scope, GUI handling one message, arg = msgType
+  TRACE_GFX_QUEUED,       // Counter, messages waiting in queueGFX
+  TRACE_BTCONNECT_MSG,    // Scope, BT connect task handling one message, arg = msgType
+  TRACE_DB_SAVE_RACE,
+  TRACE_REFRESH_TAG_GUI,
+  TRACE_LV_TIMER_HANDLER,
+  TRACE_DISP_FLUSH,       // arg = pixels
+  TRACE_ID_COUNT
+};
+
+enum traceType : uint8_t {
+  TRACE_TYPE_BEGIN = 'B',
+  TRACE_TYPE_END = 'E',
+  TRACE_TYPE_INSTANT = 'i',
+  TRACE_TYPE_COUNTER = 'C'
+};
+
+void traceInit(); // Before starting the tasks, tracing is off if the buffer can't be allocated
+void traceEvent(traceId id, traceType type, uint32_t arg);
+
+class Stream;
+void traceDump(Stream &out); // Tracing is paused while dumping
+void traceSave();            // Dump to TRACE_FILE
+
+class traceScope {
+  public:
+    traceScope(traceId inId, uint32_t arg) : id(inId) { traceEvent(id, TRACE_TYPE_BEGIN, arg); }
+    ~traceScope() { traceEvent(id, TRACE_TYPE_END, 0); }
+  private:
+    traceId id;
+};
+
+#if TRACE_ENABLED
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(id, arg) traceScope TRACE_CONCAT(traceScope_, __LINE__)(id, arg)
+#define TRACE_BEGIN(id, arg) traceEvent(id, TRACE_TYPE_BEGIN, arg)
+#define TRACE_END(id) traceEvent(id, TRACE_TYPE_END, 0)
+#define TRACE_INSTANT(id, arg) traceEvent(id, TRACE_TYPE_INSTANT, arg)
+#define TRACE_COUNTER(id, value) traceEvent(id, TRACE_TYPE_COUNTER, value)
+#else
+#define TRACE_SCOPE(id, arg) do {} while (0)
+#define TRACE_BEGIN(id, arg) do {} while (0)
+#define TRACE_END(id) do {} while (0)
+#define TRACE_INSTANT(id, arg) do {} while (0)
+#define TRACE_COUNTER(id, value) do {} while (0)
+#endif
@@ -26,6 +26,7 @@
 #include <NimBLEDevice.h>
 #include "common.h"
 #include "messages.h"
+#include "timebase.h"
 
 #include <WiFi.h>
 #include "time.h"
@@ -34,6 +35,10 @@
 
 static TaskHandle_t xHandleTestEndToEnd = nullptr;
 
+// Fast tests run the whole system on a clock running this many times faster then real time
+#define TEST_FAST_CLOCK_SCALE 100
+static timebaseScaledClock testClock(TEST_FAST_CLOCK_SCALE);
+
 enum class EndToEndTest : uint32_t
 {
     Test24HFast,
@@ -90,7 +95,7 @@ void executeEndToEndTest(EndToEndTest enu) {
     return;
 }
 
-static bool speedupWithTimeJumps(EndToEndTest testEndToEnd)
+static bool speedupWithFastClock(EndToEndTest testEndToEnd)
 {
   if (testEndToEnd == EndToEndTest::Test24HFast || testEndToEnd == EndToEndTest::Test24HFastCont) {
     return true;
@@ -98,12 +103,34 @@ static bool speedupWithTimeJumps(EndToEndTest testEndToEnd)
   return false;
 }
 
+// Switch to the fast clock if this test should run faster then real time
+static void setupTestClock(EndToEndTest testEndToEnd)
+{
+  if (speedupWithFastClock(testEndToEnd)) {
+    testClock.start();
+    timebaseSetClock(&testClock);
+  }
+  else {
+    timebaseSetClock(nullptr);
+  }
+}
+
+// Wait ms on the current clock
+static void testDelay(uint32_t ms)
+{
+  if (!timebaseIsRealClock()) {
+    ms = ms / TEST_FAST_CLOCK_SCALE;
+  }
+  delay(ms);
+}
+
 static void Test24H(EndToEndTest testEndToEnd)
 {
 
-  std::string testTag("ff:ff:10:7e:be:67"); // Zingo
+  std::string testTag("ff:ff:10:7e:82:46"); // Zingo
   NimBLEAddress bleAddress(testTag,BLE_ADDR_PUBLIC);
-  time_t start = rtc.getEpoch();
+  setupTestClock(testEndToEnd);
+  time_t start = timebaseNow();
   uint32_t startIn = 15;
   uint32_t lapDist = 821; //meter
   // Max speed is 2,83min/km (or 170s/km e.g. Marathon on 2h) on the lap, this is used to not count a new lap in less time then this
@@ -125,10 +152,11 @@ static void Test24H(EndToEndTest testEndToEnd)
   {
     msg_RaceDB msg;
     msg.iTag.header.msgType = MSG_ITAG_DETECTED;
-    msg.iTag.time = start;
+    msg.iTag.timeMs = static_cast<int64_t>(start) * 1000;
     msg.iTag.address = static_cast<uint64_t>(bleAddress);
     msg.iTag.RSSI = INT8_MIN;
     msg.iTag.battery = 78;
+    msg.iTag.receiverId = RECEIVER_ID_LOCAL;
     BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 0 )); //try without wait
     if (!xReturned)
     {
@@ -152,7 +180,8 @@ static void Test24H(EndToEndTest testEndToEnd)
     msgReponse.iTag.address = static_cast<uint64_t>(bleAddress);
     msgReponse.iTag.battery = 78;
     msgReponse.iTag.RSSI = -57;
-    msgReponse.iTag.time = start;
+    msgReponse.iTag.timeMs = static_cast<int64_t>(start) * 1000;
+    msgReponse.iTag.receiverId = RECEIVER_ID_LOCAL;
 
     ESP_LOGI(TAG,"send: MSG_ITAG_CONFIGURED");
     BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msgReponse, (TickType_t)pdMS_TO_TICKS( 0 )); //try without wait
@@ -208,7 +237,7 @@ static void Test24H(EndToEndTest testEndToEnd)
   startRaceCountdown(startIn);
 
   ESP_LOGI(TAG,"EndToEnd Test: %s > WAIT FOR RACE COUTNDOWN +2s: %d\n", EndToEndTestEnum2String(testEndToEnd).c_str(),startIn+2);
-  delay((startIn+2)*1000); 
+  testDelay((startIn+2)*1000);
 
   ESP_LOGI(TAG,"EndToEnd Test: %s > RACE STARTED\n", EndToEndTestEnum2String(testEndToEnd).c_str());
   
@@ -219,26 +248,17 @@ static void Test24H(EndToEndTest testEndToEnd)
     if(thisLapTime < (blockNewLapTime+2)) thisLapTime = (blockNewLapTime+2);
     ESP_LOGI(TAG,"EndToEnd Test: %s > WAIT FOR LAP %d (BLOCK: %d) \n", EndToEndTestEnum2String(testEndToEnd).c_str(),thisLapTime, blockNewLapTime);
 
-    if (speedupWithTimeJumps(testEndToEnd)) {
-      // Fake time jump by adding time to RTC
-      ESP_LOGI(TAG,"EndToEnd Test: %s > SKIP TIME %d wait %d\n", EndToEndTestEnum2String(testEndToEnd).c_str(),thisLapTime-4,4);
-      rtc.setTime(rtc.getEpoch()+10,0);
-      delay((2)*1000);
-      rtc.setTime(rtc.getEpoch()+thisLapTime-14,0);
-      delay((2)*1000);
-    }
-    else {
-      delay((thisLapTime)*1000);
-    }
+    testDelay((thisLapTime)*1000);
   
     ESP_LOGI(TAG,"EndToEnd Test: %s > TAG\n", EndToEndTestEnum2String(testEndToEnd).c_str());
     {
       msg_RaceDB msg;
       msg.iTag.header.msgType = MSG_ITAG_DETECTED;
-      msg.iTag.time = rtc.getEpoch();
+      msg.iTag.timeMs = timebaseNowMs();
       msg.iTag.address = static_cast<uint64_t>(bleAddress);
       msg.iTag.RSSI = INT8_MIN;
       msg.iTag.battery = 78;
+      msg.iTag.receiverId = RECEIVER_ID_LOCAL;
       BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 0 )); //try without wait
       if (!xReturned)
       {
@@ -256,9 +276,10 @@ static void Test24H(EndToEndTest testEndToEnd)
 
 static void Test24HContinue(EndToEndTest testEndToEnd)
 {
-  std::string testTag("ff:ff:10:7e:be:67"); // Zingo
+  std::string testTag("ff:ff:10:7e:82:46"); // Zingo
   NimBLEAddress bleAddress(testTag, BLE_ADDR_PUBLIC);
-  time_t start = rtc.getEpoch();
+  setupTestClock(testEndToEnd);
+  time_t start = timebaseNow();
   uint32_t startIn = 15;
   uint32_t lapDist = 821; //meter
   // Max speed is 2,83min/km (or 170s/km e.g. Marathon on 2h) on the lap, this is used to not count a new lap in less time then this
@@ -288,26 +309,17 @@ static void Test24HContinue(EndToEndTest testEndToEnd)
     ESP_LOGI(TAG,"EndToEnd Test: %s > WAIT FOR LAP %d (BLOCK: %d)", EndToEndTestEnum2String(testEndToEnd).c_str(),thisLapTime, blockNewLapTime);
 
 
-    if (speedupWithTimeJumps(testEndToEnd)) {
-      // Fake time jump by adding time to RTC
-      ESP_LOGI(TAG,"EndToEnd Test: %s > SKIP TIME %d wait %d\n", EndToEndTestEnum2String(testEndToEnd).c_str(),thisLapTime-4,4);
-      rtc.setTime(rtc.getEpoch()+10,0);
-      delay((2)*1000);
-      rtc.setTime(rtc.getEpoch()+thisLapTime-14,0);
-      delay((2)*1000);
-    }
-    else {
-      delay((thisLapTime)*1000);
-    }
+    testDelay((thisLapTime)*1000);
   
     ESP_LOGI(TAG,"EndToEnd Test: %s > TAG\n", EndToEndTestEnum2String(testEndToEnd).c_str());
     {
       msg_RaceDB msg;
       msg.iTag.header.msgType = MSG_ITAG_DETECTED;
-      msg.iTag.time = rtc.getEpoch();
+      msg.iTag.timeMs = timebaseNowMs();
       msg.iTag.address = static_cast<uint64_t>(bleAddress);
       msg.iTag.RSSI = INT8_MIN;
       msg.iTag.battery = 78;
+      msg.iTag.receiverId = RECEIVER_ID_LOCAL;
       BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 0 )); //try without wait
       if (!xReturned)
       {
@@ -319,7 +331,7 @@ static void Test24HContinue(EndToEndTest testEndToEnd)
           //TODO do something clever ??? Collect how many?
         }
       }
-      delay((1)*1000);
+      testDelay((1)*1000);
     }
   }
 }
@@ -349,7 +361,7 @@ static time_t convertToEpoch(int yr, int mt, int dy, int hr, int mn, int sc )
 static time_t secondsTo(int yr, int mt, int dy, int hr, int mn, int sc )
 {
   time_t timeSinceEpoch = convertToEpoch(yr, mt, dy, hr, mn, sc );
-  time_t now = rtc.getEpoch();
+  time_t now = timebaseNow();
   if (now < timeSinceEpoch) {
     time_t secLeft = timeSinceEpoch - now;
     ESP_LOGI(TAG,"EndToEnd Test:  > TIME RACE diff from now: %d",secLeft);
@@ -466,6 +478,7 @@ void vTaskTestEndToEnd( void *pvParameters )
   ESP_LOGI(TAG,"EndToEnd Test: %s > Started!\n", EndToEndTestEnum2String(testEndToEnd).c_str());
 
   executeEndToEndTest(testEndToEnd);
+  timebaseSetClock(nullptr); // Back to real time, a fast test must not leave the unit on the test clock
 
   xHandleTestEndToEnd = nullptr;
   vTaskDelete( NULL );
@@ -483,6 +496,7 @@ void stopTestEndToEnd()
     vTaskDelete( xHandleTestEndToEnd );
     xHandleTestEndToEnd = nullptr;
   }
+  timebaseSetClock(nullptr);
 }
 
 void startTestEndToEnd(std::string testname)
@@ -5,10 +5,17 @@
 
 #include "common.h"
 #include "messages.h"
+#include "scannerLink.h"
+#include "timebase.h"
+#include "boot.h"
+#include "heapStats.h"
+#include "trace.h"
+#include "deferredLog.h"
 
 #define TAG "BT"
 
 #define BT_SCAN_TIME 5000 // in seconds
+#define BT_BATTERY_CONNECT_TIMEOUT 3 // in seconds, used when reading battery during race
 //static uint16_t appId = 1;
 
 //std::string convertBLEAddressToString(uint64_t bleAddress64)
@@ -114,14 +121,22 @@ static bool BTtoggleBeepOnLost(NimBLEClient* client, bool beep) {
     return false;
 }
 
-static bool BTconnect(msg_iTagDetected &msg_iTag)
+// configure=true is the first connect when the tag is activated, configure=false only reads battery
+static bool BTconnect(msg_iTagDetected &msg_iTag, bool configure)
 {
+  TRACE_SCOPE(TRACE_BT_CONNECT, configure ? 1 : 0);
   NimBLEClient* client;
   NimBLEAddress bleAddress(convertBLEAddressToString(msg_iTag.address).c_str(),BLE_ADDR_PUBLIC);
   ESP_LOGI(TAG,"BT Connect %s", bleAddress.toString().c_str());
 
   client = BLEDevice::createClient();
-  client->setConnectTimeout(10); // 10s
+  if (configure) {
+    client->setConnectTimeout(10); // 10s
+  }
+  else {
+    // Scanning is stopped while we connect, don't block it long just to read battery. We will retry later.
+    client->setConnectTimeout(BT_BATTERY_CONNECT_TIMEOUT);
+  }
 
   //NimBLEAddress bleAddress(address);
   if(!client->connect(bleAddress,true)) {
@@ -156,7 +171,9 @@ static bool BTconnect(msg_iTagDetected &msg_iTag)
     }
   }
 #endif
-  BTtoggleBeepOnLost(client, false);
+  if (configure) {
+    BTtoggleBeepOnLost(client, false);
+  }
   BTupdateBattery(client,msg_iTag);
 
   //BTtoggleBeep(client, true);  // Welcome/setup beep
@@ -181,18 +198,26 @@ class BLEScanCallbacks : public NimBLEScanCallbacks {
       //ESP_LOGI(TAG,"Scaning iTAGs MATCH: %s",String(advertisedDevice->toString().c_str()).c_str());
       msg_RaceDB msg;
       msg.iTag.header.msgType = MSG_ITAG_DETECTED;
-      msg.iTag.time = rtc.getEpoch();
+      msg.iTag.timeMs = timebaseNowMs();
       msg.iTag.address = static_cast<uint64_t>(advertisedDevice->getAddress());
       msg.iTag.RSSI = advertisedDevice->getRSSI();
       msg.iTag.battery = INT8_MIN;
+      msg.iTag.receiverId = RECEIVER_ID_LOCAL;
+      TRACE_INSTANT(TRACE_BT_ITAG_SEEN, static_cast<uint32_t>(msg.iTag.address));
+#ifdef SCANNER_HELPER
+      // Helper node, forward to the main unit instead of our own RaceDB
+      scannerLinkSendDetection(msg.iTag);
+      return;
+#endif
+      TRACE_SCOPE(TRACE_SEND_RACEDB, msg.iTag.header.msgType);
       BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 0 )); //try without wait
       if (!xReturned)
       {
-        ESP_LOGE(TAG,"ERROR iTAG detected queue is full: %s RETRY for 1s",std::string(advertisedDevice->toString().c_str()).c_str());
+        DLOGE(TAG,"ERROR iTAG detected queue is full: %s RETRY for 1s",advertisedDevice->getAddress().toString().c_str());
         xReturned = xQueueSend(queueRaceDB, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 1000 )); //just wait a short while
         if (!xReturned)
         {
-          ESP_LOGE(TAG,"ERROR ERROR iTAG detected queue is still full: %s trow a way detected",std::string(advertisedDevice->toString().c_str()).c_str());
+          DLOGE(TAG,"ERROR ERROR iTAG detected queue is still full: %s trow a way detected",advertisedDevice->getAddress().toString().c_str());
           //TODO do something clever ??? Collect how many?
         }
       }
@@ -213,6 +238,30 @@ class BLEScanCallbacks : public NimBLEScanCallbacks {
   }
 };
 
+static void BTsendResponse(msg_iTagDetected &msg_iTag, uint32_t msgType)
+{
+  msg_RaceDB msgReponse;
+  msgReponse.iTag.header.msgType = msgType;
+  msgReponse.iTag.address = msg_iTag.address;
+  msgReponse.iTag.battery = msg_iTag.battery;
+  msgReponse.iTag.RSSI = msg_iTag.RSSI;
+  msgReponse.iTag.timeMs = msg_iTag.timeMs;
+  msgReponse.iTag.receiverId = RECEIVER_ID_LOCAL;
+
+  ESP_LOGI(TAG,"send: 0x%" PRIx32 "", msgType);
+  BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msgReponse, (TickType_t)pdMS_TO_TICKS( 0 )); //try without wait
+  if (!xReturned)
+  {
+    ESP_LOGE(TAG,"ERROR iTAG detected/configured queue is full RETRY for 1s");
+    xReturned = xQueueSend(queueRaceDB, (void*)&msgReponse, (TickType_t)pdMS_TO_TICKS( 1000 )); //just wait a short while
+    if (!xReturned)
+    {
+      ESP_LOGE(TAG,"ERROR iTAG detected/configured queue is full IGNORE");
+      //TODO do something clever ??? Collect how many?
+    }
+  }
+}
+
 static void vTaskBTConnect( void *pvParameters )
 {
   /* The parameter value is expected to be 1 as 1 is passed in the
@@ -221,6 +270,7 @@ static void vTaskBTConnect( void *pvParameters )
   //configASSERT( ( ( uint32_t ) pvParameters ) == 1 );
 
   BLEScan* pBLEScan;
+  uint32_t stage = bootStageStart("BLE init");
   ESP_LOGI(TAG,"BLEDevice init");
   NimBLEDevice::init("");
 
@@ -235,6 +285,10 @@ static void vTaskBTConnect( void *pvParameters )
 
   // Active scan will gather scan response data from advertisers but will use more energy from both devices
   pBLEScan->setActiveScan(true);
+  bootStageDone(stage);
+
+  // Detections are timestamped, don't scan until the timebase is anchored to the RTC
+  bootWaitFor(BOOT_RTC_READY, "BT scan");
 
   // Start scanning for advertisers for the scan time specified (in seconds) 0 = forever
   doBTScan = true;  // used by the callback to autorestart BT scan
@@ -247,6 +301,8 @@ static void vTaskBTConnect( void *pvParameters )
     msg_iTagDetected msg_iTag;
     if( xQueueReceive(queueBTConnect, &(msg_iTag), (TickType_t)portMAX_DELAY) == pdPASS)
     {
+      HEAP_TRACK_SCOPE(HEAP_BT);
+      TRACE_SCOPE(TRACE_BTCONNECT_MSG, msg_iTag.header.msgType);
       switch(msg_iTag.header.msgType) {
         case MSG_ITAG_CONFIG:
         {
@@ -256,32 +312,30 @@ static void vTaskBTConnect( void *pvParameters )
           doBTScan = false;
           NimBLEDevice::getScan()->stop();
 
-          BTconnect(msg_iTag); //Will update battery
+          BTconnect(msg_iTag, true); //Will update battery
           
           ESP_LOGI(TAG,"BT Connect SCAN Start");
           doBTScan = true;
           NimBLEDevice::getScan()->start(BT_SCAN_TIME, true, true);
 
           // Send response/activate iTag
-          msg_RaceDB msgReponse;
-          msgReponse.iTag.header.msgType = MSG_ITAG_CONFIGURED;
-          msgReponse.iTag.address = msg_iTag.address;
-          msgReponse.iTag.battery = msg_iTag.battery;
-          msgReponse.iTag.RSSI = msg_iTag.RSSI;
-          msgReponse.iTag.time = msg_iTag.time;
-
-          ESP_LOGI(TAG,"send: MSG_ITAG_CONFIGURED");
-          BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msgReponse, (TickType_t)pdMS_TO_TICKS( 0 )); //try without wait
-          if (!xReturned)
-          {
-            ESP_LOGE(TAG,"ERROR iTAG detected/configured queue is full RETRY for 1s");
-            xReturned = xQueueSend(queueRaceDB, (void*)&msgReponse, (TickType_t)pdMS_TO_TICKS( 1000 )); //just wait a short while
-            if (!xReturned)
-            {
-            ESP_LOGE(TAG,"ERROR iTAG detected/configured queue is full IGNORE");
-              //TODO do something clever ??? Collect how many?
-            }
-          }
+          BTsendResponse(msg_iTag, MSG_ITAG_CONFIGURED);
+        }
+        break;
+        case MSG_ITAG_READ_BATTERY:
+        {
+          ESP_LOGI(TAG,"received: MSG_ITAG_READ_BATTERY");
+
+          doBTScan = false;
+          NimBLEDevice::getScan()->stop();
+
+          msg_iTag.battery = INT8_MIN; // Stays INT8_MIN if read fails
+          BTconnect(msg_iTag, false);
+
+          doBTScan = true;
+          NimBLEDevice::getScan()->start(BT_SCAN_TIME, true, true);
+
+          BTsendResponse(msg_iTag, MSG_ITAG_BATTERY);
         }
         break;
         default:
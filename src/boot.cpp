@@ -0,0 +1,106 @@
+/*
+  Boot timeline and init dependencies, see boot.h
+*/
+#include "esp_timer.h"
+#include "common.h"
+#include "boot.h"
+
+#define TAG "Boot"
+
+struct bootStage {
+  const char *name;
+  const char *task;
+  BaseType_t core;
+  int64_t startUs;
+  int64_t doneUs; // 0 while running
+};
+
+static portMUX_TYPE bootMux = portMUX_INITIALIZER_UNLOCKED;
+static EventGroupHandle_t bootEvents = NULL;
+static bootStage bootStages[BOOT_MAX_STAGES];
+static uint32_t bootStageCount = 0;
+
+void bootInit()
+{
+  bootEvents = xEventGroupCreate();
+  if (bootEvents == NULL) {
+    ESP_LOGE(TAG,"FATAL ERROR: xEventGroupCreate() Failed");
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
+  }
+}
+
+void bootSignal(EventBits_t bits)
+{
+  xEventGroupSetBits(bootEvents, bits);
+}
+
+void bootWaitFor(EventBits_t bits, const char *who)
+{
+  int64_t startUs = esp_timer_get_time();
+  EventBits_t isSet = xEventGroupWaitBits(bootEvents, bits, pdFALSE, pdTRUE, pdMS_TO_TICKS(BOOT_WAIT_TIMEOUT));
+  if ((isSet & bits) != bits) {
+    ESP_LOGE(TAG,"FATAL ERROR: %s waited %d ms for boot bits 0x%" PRIx32 " only got 0x%" PRIx32 ". INITIAL SETUP ERROR",
+             who, BOOT_WAIT_TIMEOUT, static_cast<uint32_t>(bits), static_cast<uint32_t>(isSet));
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
+  }
+  int64_t waitedUs = esp_timer_get_time() - startUs;
+  if (waitedUs > 1000) {
+    ESP_LOGI(TAG,"%s waited %" PRId64 " ms for boot bits 0x%" PRIx32, who, waitedUs / 1000, static_cast<uint32_t>(bits));
+  }
+}
+
+uint32_t bootStageStart(const char *name)
+{
+  int64_t nowUs = esp_timer_get_time();
+  const char *task = pcTaskGetName(NULL);
+  BaseType_t core = xPortGetCoreID();
+  uint32_t stage = BOOT_MAX_STAGES;
+  portENTER_CRITICAL(&bootMux);
+  if (bootStageCount < BOOT_MAX_STAGES) {
+    stage = bootStageCount++;
+    bootStages[stage] = {name, task, core, nowUs, 0};
+  }
+  portEXIT_CRITICAL(&bootMux);
+  if (stage >= BOOT_MAX_STAGES) {
+    ESP_LOGW(TAG,"WARNING: More then %d boot stages, %s is not timed", BOOT_MAX_STAGES, name);
+  }
+  return stage;
+}
+
+void bootStageDone(uint32_t stage)
+{
+  if (stage >= BOOT_MAX_STAGES) {
+    return;
+  }
+  int64_t nowUs = esp_timer_get_time();
+  portENTER_CRITICAL(&bootMux);
+  bootStages[stage].doneUs = nowUs;
+  bootStage done = bootStages[stage];
+  portEXIT_CRITICAL(&bootMux);
+  ESP_LOGI(TAG,"%-16s %7" PRId64 " ms (%s core %d)", done.name, (done.doneUs - done.startUs) / 1000, done.task, done.core);
+}
+
+void bootReport()
+{
+  bootStage stages[BOOT_MAX_STAGES];
+  portENTER_CRITICAL(&bootMux);
+  uint32_t count = bootStageCount;
+  for (uint32_t i = 0; i < count; i++) {
+    stages[i] = bootStages[i];
+  }
+  portEXIT_CRITICAL(&bootMux);
+
+  ESP_LOGI(TAG,"Boot timeline, %" PRId64 " ms since power on:", esp_timer_get_time() / 1000);
+  ESP_LOGI(TAG,"  %-16s %8s %8s %8s  %s", "Stage", "Start", "Done", "Time", "Task/Core");
+  for (uint32_t i = 0; i < count; i++) {
+    if (stages[i].doneUs == 0) {
+      ESP_LOGI(TAG,"  %-16s %8" PRId64 " %8s %8s  %s/%d", stages[i].name, stages[i].startUs / 1000, "-", "running", stages[i].task, stages[i].core);
+    }
+    else {
+      ESP_LOGI(TAG,"  %-16s %8" PRId64 " %8" PRId64 " %8" PRId64 "  %s/%d", stages[i].name, stages[i].startUs / 1000, stages[i].doneUs / 1000,
+               (stages[i].doneUs - stages[i].startUs) / 1000, stages[i].task, stages[i].core);
+    }
+  }
+}
@@ -0,0 +1,297 @@
+/*
+  Deferred logging, see deferredLog.h
+*/
+#include <new>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include "esp_heap_caps.h"
+#include "common.h"
+#include "deferredLog.h"
+
+#define TAG "Log"
+
+#define DEFERRED_LOG_LINE_LENGTH 256
+#define DEFERRED_LOG_SPEC_LENGTH 16
+
+static portMUX_TYPE deferredLogMux = portMUX_INITIALIZER_UNLOCKED;
+static deferredLogRecord *deferredLogRing = nullptr;
+static std::atomic<uint32_t> deferredLogHead(0); // Next record to write, reserved under deferredLogMux
+static std::atomic<uint32_t> deferredLogTail(0); // Next record to drain, only moved by the drain task
+static std::atomic<uint32_t> deferredLogDropped(0);
+
+void deferredLogRecord::add(deferredLogArgType type, deferredLogValue value)
+{
+  if (argCount >= DEFERRED_LOG_MAX_ARGS) {
+    return;
+  }
+  types[argCount] = type;
+  values[argCount] = value;
+  argCount++;
+}
+
+void deferredLogRecord::addString(const char *str, deferredLogArgType type)
+{
+  deferredLogValue value;
+  value.u = stringUsed;
+  add(type, value);
+  size_t space = DEFERRED_LOG_STRING_SPACE - stringUsed;
+  if (space == 0) {
+    return; // Offset points at the end, formatted as ""
+  }
+  if (str == nullptr) {
+    str = "(null)";
+  }
+  size_t len = strnlen(str, space - 1);
+  memcpy(strings + stringUsed, str, len);
+  strings[stringUsed + len] = '\0';
+  stringUsed += len + 1;
+}
+
+deferredLogRecord *deferredLogBegin(deferredLogSite &site, uint8_t level, const char *tag, const char *fmt)
+{
+  if (deferredLogRing == nullptr) {
+    deferredLogDropped++;
+    return nullptr;
+  }
+  uint32_t nowMs = millis();
+  uint32_t index;
+  uint32_t suppressed;
+  portENTER_CRITICAL(&deferredLogMux);
+  if (nowMs - site.windowStartMs >= DEFERRED_LOG_SITE_WINDOW) {
+    site.windowStartMs = nowMs;
+    site.count = 0;
+  }
+  if (site.count >= DEFERRED_LOG_SITE_LIMIT) {
+    site.suppressed++;
+    portEXIT_CRITICAL(&deferredLogMux);
+    return nullptr;
+  }
+  index = deferredLogHead;
+  if (index - deferredLogTail >= DEFERRED_LOG_RECORDS) {
+    portEXIT_CRITICAL(&deferredLogMux);
+    deferredLogDropped++;
+    return nullptr;
+  }
+  deferredLogHead = index + 1;
+  site.count++;
+  suppressed = site.suppressed;
+  site.suppressed = 0;
+  portEXIT_CRITICAL(&deferredLogMux);
+
+  deferredLogRecord *record = &deferredLogRing[index % DEFERRED_LOG_RECORDS];
+  record->level = level;
+  record->argCount = 0;
+  record->stringUsed = 0;
+  record->timeMs = nowMs;
+  record->suppressed = suppressed;
+  record->tag = tag;
+  record->fmt = fmt;
+  return record;
+}
+
+void deferredLogCommit(deferredLogRecord *record)
+{
+  record->ready.store(true, std::memory_order_release);
+}
+
+static size_t deferredLogFormatTime(char *out, size_t size, int64_t ms)
+{
+  time_t seconds = static_cast<time_t>(ms / 1000);
+  struct tm timeinfo;
+  localtime_r(&seconds, &timeinfo);
+  size_t len = strftime(out, size, "%Y-%m-%d %H:%M:%S", &timeinfo);
+  snprintf(out + len, size - len, ".%03d", static_cast<int>(ms % 1000));
+  return strlen(out);
+}
+
+// Format one conversion with the captured argument, spec is the printf spec without length
+// modifier and conversion, wide is true if the original length was 64 bit (e.g. PRId64)
+static int deferredLogFormatArg(char *out, size_t size, const char *spec, char conversion, bool wide,
+                                const deferredLogRecord &record, uint32_t arg)
+{
+  char fmt[DEFERRED_LOG_SPEC_LENGTH + 4];
+  if (arg >= record.argCount) {
+    return snprintf(out, size, "?");
+  }
+  deferredLogArgType type = record.types[arg];
+  const deferredLogValue &value = record.values[arg];
+  char timeText[32];
+  const char *str = nullptr;
+  if (type == DEFERRED_LOG_ARG_STRING) {
+    str = record.strings + value.u;
+  }
+  else if (type == DEFERRED_LOG_ARG_TIME) {
+    deferredLogFormatTime(timeText, sizeof(timeText), value.i);
+    str = timeText;
+  }
+
+  switch (conversion) {
+    case 'd':
+    case 'i':
+      snprintf(fmt, sizeof(fmt), "%slld", spec);
+      return snprintf(out, size, fmt, type == DEFERRED_LOG_ARG_UINT ? static_cast<long long>(value.u) : static_cast<long long>(value.i));
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+    {
+      unsigned long long number = value.u;
+      if (!wide) {
+        number = static_cast<uint32_t>(number); // e.g. a negative int32_t with %x
+      }
+      snprintf(fmt, sizeof(fmt), "%sll%c", spec, conversion);
+      return snprintf(out, size, fmt, number);
+    }
+    case 'c':
+      snprintf(fmt, sizeof(fmt), "%sc", spec);
+      return snprintf(out, size, fmt, static_cast<int>(value.i));
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+    {
+      double number = value.d;
+      if (type == DEFERRED_LOG_ARG_INT) {
+        number = static_cast<double>(value.i);
+      }
+      else if (type == DEFERRED_LOG_ARG_UINT) {
+        number = static_cast<double>(value.u);
+      }
+      snprintf(fmt, sizeof(fmt), "%s%c", spec, conversion);
+      return snprintf(out, size, fmt, number);
+    }
+    case 's':
+      snprintf(fmt, sizeof(fmt), "%ss", spec);
+      return snprintf(out, size, fmt, str ? str : "?");
+    case 'p':
+      return snprintf(out, size, "%p", value.p);
+    default:
+      return snprintf(out, size, "%%%c", conversion);
+  }
+}
+
+static void deferredLogFormat(char *out, size_t size, const deferredLogRecord &record)
+{
+  size_t len = snprintf(out, size, "[@%" PRIu32 "] ", record.timeMs);
+  uint32_t arg = 0;
+  const char *fmt = record.fmt;
+  while (*fmt != '\0' && len < size - 1) {
+    if (*fmt != '%') {
+      out[len++] = *fmt++;
+      continue;
+    }
+    fmt++;
+    if (*fmt == '%') {
+      out[len++] = *fmt++;
+      continue;
+    }
+    // Flags, width and precision are kept, length modifiers are replaced as all integers are 64 bit here
+    char spec[DEFERRED_LOG_SPEC_LENGTH] = "%";
+    size_t specLen = 1;
+    while (*fmt != '\0' && strchr("-+ #0123456789.", *fmt) != nullptr) {
+      if (specLen < sizeof(spec) - 1) {
+        spec[specLen++] = *fmt;
+      }
+      fmt++;
+    }
+    spec[specLen] = '\0';
+    bool wide = false;
+    while (*fmt != '\0' && strchr("hlLqjzt", *fmt) != nullptr) {
+      if (*fmt == 'l' && *(fmt + 1) == 'l') {
+        wide = true;
+        fmt++;
+      }
+      else if (*fmt == 'q' || *fmt == 'j') {
+        wide = true;
+      }
+      fmt++;
+    }
+    if (*fmt == '\0') {
+      break;
+    }
+    int written = deferredLogFormatArg(out + len, size - len, spec, *fmt, wide, record, arg++);
+    fmt++;
+    if (written > 0) {
+      len = std::min(len + static_cast<size_t>(written), size - 1);
+    }
+  }
+  out[len] = '\0';
+  if (record.suppressed > 0 && len < size - 1) {
+    snprintf(out + len, size - len, " (+%" PRIu32 " similar suppressed)", record.suppressed);
+  }
+}
+
+static void deferredLogDrain()
+{
+  static char line[DEFERRED_LOG_LINE_LENGTH];
+  uint32_t tail = deferredLogTail;
+  while (tail != deferredLogHead) {
+    deferredLogRecord &record = deferredLogRing[tail % DEFERRED_LOG_RECORDS];
+    if (!record.ready.load(std::memory_order_acquire)) {
+      break; // Still being captured, take it next time
+    }
+    deferredLogFormat(line, sizeof(line), record);
+    switch (record.level) {
+      case DEFERRED_LOG_ERROR: ESP_LOGE(record.tag, "%s", line); break;
+      case DEFERRED_LOG_WARN:  ESP_LOGW(record.tag, "%s", line); break;
+      case DEFERRED_LOG_INFO:  ESP_LOGI(record.tag, "%s", line); break;
+      case DEFERRED_LOG_DEBUG: ESP_LOGD(record.tag, "%s", line); break;
+      default:                 ESP_LOGV(record.tag, "%s", line); break;
+    }
+    record.ready.store(false, std::memory_order_relaxed);
+    tail++;
+    deferredLogTail.store(tail, std::memory_order_release);
+  }
+
+  static uint32_t reportedDropped = 0;
+  uint32_t dropped = deferredLogDropped;
+  if (dropped != reportedDropped) {
+    ESP_LOGW(TAG,"WARNING: %" PRIu32 " log lines dropped, ring of %d is full", dropped - reportedDropped, DEFERRED_LOG_RECORDS);
+    reportedDropped = dropped;
+  }
+}
+
+static void vTaskDeferredLog( void *pvParameters )
+{
+  for( ;; )
+  {
+    vTaskDelay(pdMS_TO_TICKS(DEFERRED_LOG_DRAIN_PERIOD));
+    deferredLogDrain();
+  }
+}
+
+void deferredLogInit()
+{
+  size_t size = DEFERRED_LOG_RECORDS * sizeof(deferredLogRecord);
+  void *ring = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+  if (ring == nullptr) {
+    ESP_LOGE(TAG,"FATAL ERROR: Could not allocate %u bytes in PSRAM for the log ring", size);
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
+  }
+  deferredLogRecord *records = static_cast<deferredLogRecord *>(ring);
+  for (uint32_t i = 0; i < DEFERRED_LOG_RECORDS; i++) {
+    new (&records[i]) deferredLogRecord();
+    records[i].ready = false;
+  }
+
+  BaseType_t xReturned = xTaskCreate(
+                  vTaskDeferredLog,   /* Function that implements the task. */
+                  "Log",              /* Text name for the task. */
+                  TASK_LOG_STACK,     /* Stack size in words, not bytes. */
+                  NULL,               /* Parameter passed into the task. */
+                  TASK_LOG_PRIO,      /* Priority  0-(configMAX_PRIORITIES-1)   idle = 0 = tskIDLE_PRIORITY*/
+                  NULL );             /* Used to pass out the created task's handle. */
+  if( xReturned != pdPASS )
+  {
+    ESP_LOGE(TAG,"FATAL ERROR: xTaskCreate(vTaskDeferredLog, Log,..) Failed");
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
+  }
+  deferredLogRing = records;
+}
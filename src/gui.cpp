@@ -22,6 +22,10 @@
  ******************************************************************************/
 #include <string>
 #include <cstdlib>
+#include <cstdarg>
+#include <cstring>
+#include <vector>
+#include <algorithm>
 
 #include "common.h"
 #include <lvgl.h>
@@ -31,6 +35,11 @@
 #include "gui.h"
 #include "messages.h"
 #include "iTag.h"
+#include "timebase.h"
+#include "boot.h"
+#include "sysStats.h"
+#include "heapStats.h"
+#include "trace.h"
 
 #define TAG "GFX"
 
@@ -60,8 +69,20 @@ TAMC_GT911 *ts; //= TAMC_GT911(TOUCH_GT911_SDA, TOUCH_GT911_SCL, TOUCH_GT911_INT
 // Setup screen resolution for LVGL
 static lv_disp_draw_buf_t draw_buf;
 static lv_color_t *disp_draw_buf = nullptr;
+static lv_color_t *disp_draw_buf2 = nullptr;
 static lv_disp_drv_t disp_drv;
 
+// LVGL renders into one draw buffer while the GFXFlush task copies the other one into the panel
+// framebuffer, see lvgl_displayFlushCallBack(). The RGB driver in IDF 4.4 only has one panel
+// framebuffer and the GFX library has no vsync callback, so frames can't be swapped on vsync.
+#define GFX_FLUSH_WAIT 10 // ms, LVGL checks again if the flush is done after this
+struct gfxFlushJob {
+  lv_disp_drv_t *disp;
+  lv_area_t area;
+  lv_color_t *color_p;
+};
+static QueueHandle_t queueGFXFlush = nullptr;
+
 static const lv_font_t *fontNormal = &lv_font_montserrat_16;
 static const lv_font_t *fontTag = &lv_font_montserrat_28;
 static const lv_font_t *fontLarge = &lv_font_montserrat_24;
@@ -77,6 +98,7 @@ static lv_style_t styleTagSmallText;
 static lv_style_t styleTime;
 static lv_style_t styleIcon;
 static lv_style_t styleIconOff;
+static lv_style_t styleBatteryLow;
 static lv_style_t styleBullet;
 static lv_style_t style_iTag0;  //iTag circle
 static lv_style_t style_iTag1;  //iTag rubber circle
@@ -86,44 +108,145 @@ static lv_obj_t *globalLabelRaceName = nullptr;
 static lv_obj_t *globalLabelRaceTag = nullptr;
 static lv_obj_t *globalLabelRaceTime = nullptr;
 
+#ifndef GUI_RELEASE_HIDDEN_GRAPH
+#define GUI_RELEASE_HIDDEN_GRAPH 0 // 1 = Delete the graph when not shown to save LVGL memory, see gfxCreateTab()
+#endif
+#define GUI_TAB_RACE         0
+#define GUI_TAB_PARTICIPANTS 1
+#define GUI_TAB_GRAPH        2
+#define GUI_TAB_CONFIG       3
+#define GUI_TAB_DIAGNOSTICS  4
+#define GUI_TAB_COUNT        5
 static lv_obj_t *tabRace = nullptr;
 static lv_obj_t *tabParticipants = nullptr;
 lv_obj_t *tabGraph  = nullptr;
+static lv_obj_t *tabConfig = nullptr;
+static lv_obj_t *tabDiagnostics = nullptr;
+static lv_obj_t *labelDiagnostics = nullptr;
+static lv_obj_t *tableDiagnostics = nullptr;
+static lv_obj_t *labelHeap = nullptr;
+static lv_obj_t *labelHeapSubsystems = nullptr;
+static bool tabCreated[GUI_TAB_COUNT] = {};
 static lv_obj_t *chartLaps = nullptr;
 //static lv_obj_t *chartRSSI = nullptr;
 
-static lv_obj_t* keyboard = nullptr;
+static lv_obj_t* keyboard = nullptr; // Use gfxKeyboard()
+
+// Level of detail store for one participants lap series in chartLaps. All points (lap arrive,
+// and in distance races also leave) are kept in full resolution but the chart only gets the
+// first and last point of each of GRAPH_TIME_BUCKETS time buckets over the graph time range.
+// As distance never decrease with time first/last is also min/max of the bucket, so the curve
+// look the same but a multi day race with thousands of laps cost the same to draw as a short race.
+// Buckets are only created when they get a point and are packed in the chart without gaps.
+#define GRAPH_TIME_BUCKETS 240 // Chart is ~700px wide, more then this can't be seen anyway
+#define GRAPH_CHART_POINTS (2*GRAPH_TIME_BUCKETS + 2)
+
+class lapGraphSeries {
+  public:
+    lapGraphSeries() : series(nullptr), timeRange(24*60*60) {}
+    void setSeries(lv_chart_series_t * inSeries) {series = inSeries; rebuildFrom(0);}
+    void setTimeRange(uint32_t seconds);
+    uint32_t size() {return points.size();}
+    void setPoint(uint32_t index, lv_coord_t time, lv_coord_t dist);
+    void truncate(uint32_t count);
+    void clear() {truncate(0);}
+
+  private:
+    struct graphPoint {
+      lv_coord_t time; // s since race start
+      lv_coord_t dist; // m
+    };
+    struct graphBucket {
+      uint32_t bucket; // 0..GRAPH_TIME_BUCKETS-1
+      uint32_t first;  // index in points
+      uint32_t last;   // index in points
+    };
+    uint32_t bucketOf(lv_coord_t time);
+    void addToBuckets(uint32_t index);
+    void rebuildFrom(uint32_t index);
+    void writeSlot(uint32_t slot, uint32_t index);
+    void clearSlot(uint32_t slot);
+
+    lv_chart_series_t * series;
+    uint32_t timeRange;              // s, x range of the chart
+    std::vector<graphPoint> points;  // Full resolution
+    std::vector<graphBucket> buckets; // Non empty buckets in time order, bucket i is chart point 2*i and 2*i+1
+};
+
+#define GFX_CONNECTION_UNKNOWN INT8_MAX // connectionStatus before anything is received
 
+// Participant data as last received from RaceDB, the rows in the race and participants tab
+// only show this, see guiParticipantList
 class guiParticipant {
   public:
     uint32_t handleDB; // save handle to use in the RaceDB messages (supplied ti RaceDB)
     uint32_t laps;     // sevaed so we can detect new laps and draw them in the graph
-    uint32_t thisLapStart;
-    // ParticipantTab
-    lv_obj_t * labelToRace;
-    lv_obj_t * ledColor0;
-    lv_obj_t * ledColor1;
-    lv_obj_t * textAreaName;
-    lv_obj_t * labelDist;
-    lv_obj_t * labelLaps;
-    lv_obj_t * labelTime;
-    lv_obj_t * labelConnectionStatus;
-    lv_obj_t * labelBattery;
+    int64_t thisLapStart; // ms since race start
+    msg_UpdateParticipantLapStats lapStats; // Last lap statistics from RaceDB
+    uint32_t color0;
+    uint32_t color1;
+    char name[PARTICIPANT_NAME_LENGTH+1];
+    uint32_t distance; // m
+    int8_t connectionStatus = GFX_CONNECTION_UNKNOWN; // As in msg_UpdateParticipantStatus
+    int8_t battery = -1; // 0-100%, -1 = not received yet
+    int16_t batteryHoursLeft = -1;
+    bool batteryLow = false;
+    bool inRace = false;
 
     // Graph
     lv_chart_series_t * seriesLaps = nullptr;;
+    lapGraphSeries lapSeries;
     //lv_chart_series_t * seriesRSSI = nullptr;;
+};
+
+// One row of LVGL objects in a guiParticipantList, it shows one participant at a time and
+// is rebound to another participant when the list is scrolled or reordered.
+struct guiListRow {
+  uint32_t handleGFX = UINT32_MAX; // Shown participant, UINT32_MAX if row is not used
+  uint32_t index = UINT32_MAX;     // Position in list
+  lv_obj_t * obj = nullptr;
+  lv_obj_t * labelToRace = nullptr;   // Participants tab only
+  lv_obj_t * ledColor0 = nullptr;
+  lv_obj_t * ledColor1 = nullptr;
+  lv_obj_t * textAreaName = nullptr;  // Participants tab only
+  lv_obj_t * labelName = nullptr;     // Race tab only
+  lv_obj_t * labelDist = nullptr;
+  lv_obj_t * labelLaps = nullptr;
+  lv_obj_t * labelTime = nullptr;
+  lv_obj_t * labelLapStats = nullptr; // Participants tab only
+  lv_obj_t * labelConnectionStatus = nullptr;
+  lv_obj_t * labelBattery = nullptr;  // Participants tab only
+  bool batteryLow = false;            // styleBatteryLow is added to labelBattery
+};
+
+// List of participants in the race tab (standings) or participants tab (all). Only the rows
+// that fit on the screen are created, when scrolling they are moved and rebound to the
+// participants that became visible so LVGL memory and layout time don't grow with the
+// number of participants.
+class guiParticipantList {
+  public:
+    void create(lv_obj_t * parentTab, bool isRaceTab);
+    void add(uint32_t handleGFX); // Last in list
+    void remove(uint32_t handleGFX);
+    void move(uint32_t handleGFX, uint32_t position);
+    void refresh(uint32_t handleGFX); // Participant data changed, update its row if visible
+    void refreshAll();
 
-    bool inRace;
-    // RaceTab (only valid if inRace is true)
-    lv_obj_t * objRace;        // Delete this to remove from GUI (set the rest *Race* to nullptr below)
-    lv_obj_t * ledRaceColor0;
-    lv_obj_t * ledRaceColor1;
-    lv_obj_t * labelRaceName;
-    lv_obj_t * labelRaceDist;
-    lv_obj_t * labelRaceLaps;
-    lv_obj_t * labelRaceTime;
-    lv_obj_t * labelRaceConnectionStatus;
+  private:
+    guiListRow * createRow();
+    void bindRow(guiListRow &row, uint32_t index);
+    void unbindRow(guiListRow &row);
+    void updateRow(guiListRow &row);
+    void layout(); // Bind rows to the visible part of the list
+    static void scroll_event_cb(lv_event_t * e);
+
+    lv_obj_t * parent = nullptr;
+    lv_obj_t * spacer = nullptr; // Placed after last item to give parent its full scroll height
+    bool raceTab = false;
+    bool inLayout = false; // Ending an edit when a row is rebound can scroll the tab
+    lv_coord_t rowHeight = 0; // Including space between rows
+    std::vector<uint32_t> items; // handleGFX in list order
+    std::vector<guiListRow *> rows; // Item i is shown in rows[i % rows.size()]
 };
 
 class guiRace {
@@ -141,20 +264,25 @@ class guiRace {
                 textAreaConfigRaceRaceStartIn(nullptr),
                 tabGraph(nullptr),
                 currentUserHandleGFX(DEFAULT_PARTICIPANT), // TODO make this selectable in GUI //TODO save on disk
-                personalGoal(DEFAULT_PARTICIPANT_GOAL), //TODO save on disk
                 labelCurrentUserName(nullptr),
                 labelCurrentUserGoal(nullptr),
-                seriesGraphGoal(nullptr),
-                seriesGraphGoalFaster(nullptr),
-                seriesGraphGoalSlower(nullptr),
+                graphHDiv(0),
+                graphVDiv(0),
+                graphDistRange(1),
+                staticLayer(nullptr),
+                staticLayerBuf(nullptr),
+                staticLayerW(0),
+                staticLayerH(0),
                 selectedUser(nullptr)
                 {}
 
     void receiveConfigRace(msg_RaceConfig *raceConfig);
     void sendConfigRace();
     void createGUITabConfig(lv_obj_t * parent);
+    void updateGUITabConfig();
     void updateGUITabRaceGraph();
     void updateGUITabRaceGraphGoalLines();
+    void updateGUITabRaceGraphStaticLayer();
     void UpdateCurrentUserInfo(uint32_t handleGFX);
     time_t getRaceStart() { return raceStart;}
     void setRaceStart(time_t inRaceStart) { raceStart = inRaceStart;}
@@ -162,24 +290,37 @@ class guiRace {
     void setDistance(uint32_t inDistance) { distance = inDistance;}
     uint32_t getLaps() { return laps;}
     void setLaps(uint32_t inLaps) { laps = inLaps;}
-    void setBlockNewLapTime(time_t newTime) {lv_textarea_set_text(textAreaConfigRaceBlockNewLapTime,std::to_string(newTime).c_str());}
+    void setBlockNewLapTime(time_t newTime);
     bool isTextAreaDistance(lv_obj_t *ta) {return ta==textAreaConfigRaceDistance;}
     bool isTextAreaLaps(lv_obj_t *ta) {return ta==textAreaConfigRaceLaps;}
     bool isCheckBoxTimeBased(lv_obj_t *cb) {return cb==textAreaConfigRaceTimebased;}
-    bool isTimeBasedRace() {return lv_obj_get_state(textAreaConfigRaceTimebased) & LV_STATE_CHECKED;}
+    bool isTimeBasedRace() {return configTimeBased;}
+    void setTimeBasedRace(bool timeBased) {configTimeBased = timeBased;}
     time_t getMaxTime();
     time_t getRaceStartCountdown();
     bool isDataValid() {return dataValid;}
-    void setTabGraph(lv_obj_t *inTabGraph) {tabGraph=inTabGraph; createGUITabRaceGraph();}
-    uint32_t getMaxGraphLaps();
+    void setTabGraph(lv_obj_t *inTabGraph) {tabGraph=inTabGraph;}
+    void createGUITabRaceGraph();
+    void releaseGUITabRaceGraph();
+    uint32_t getGraphTimeRange();
     uint32_t getCurrentUserHandleGFX() {return currentUserHandleGFX;}
-    uint32_t getCurrentUserPersonalGoal() {return personalGoal;}
+    uint32_t getCurrentUserPersonalGoal();
     void setCurrentUserPersonalGoal(uint32_t goal);
+    void currentUserPersonalGoalChanged();
   private:
+    void updateCurrentUserGoalLabel();
     bool dataValid;
     time_t raceStart;
     uint32_t distance;
     uint32_t laps;
+    // Last race config, the config tab widgets are only created when the tab is first shown
+    std::string configFileName;
+    std::string configName;
+    bool configTimeBased = false;
+    time_t configMaxTime = 6; // hours
+    time_t configBlockNewLapTime = 0;
+    time_t configUpdateCloserTime = 0;
+    time_t configRaceStartInTime = 0;
     lv_obj_t * textAreaConfigRaceFileName = nullptr;
     lv_obj_t * textAreaConfigRaceName = nullptr;
     lv_obj_t * textAreaConfigRaceTimebased = nullptr;
@@ -192,22 +333,116 @@ class guiRace {
     lv_obj_t * textAreaConfigRaceRaceStartIn = nullptr;
     lv_obj_t * tabGraph = nullptr;
     uint32_t currentUserHandleGFX;
-    uint32_t personalGoal;
     lv_obj_t *labelCurrentUserName = nullptr;
     lv_obj_t *labelCurrentUserGoal = nullptr;
-    lv_chart_series_t * seriesGraphGoal = nullptr;
-    lv_chart_series_t * seriesGraphGoalFaster = nullptr;
-    lv_chart_series_t * seriesGraphGoalSlower = nullptr;
+    // Grid and goal lines are drawn once into staticLayer (PSRAM) used as chartLaps background
+    // image, instead of being redrawn by the chart every time an area of it is refreshed
+    uint8_t graphHDiv;        // Grid lines, what lv_chart_set_div_line_count() would have been given
+    uint8_t graphVDiv;
+    uint32_t graphDistRange;  // m, y range of chartLaps
+    lv_obj_t * staticLayer = nullptr; // Hidden canvas, only used to draw into staticLayerBuf
+    uint8_t * staticLayerBuf = nullptr;
+    lv_coord_t staticLayerW;
+    lv_coord_t staticLayerH;
     lv_obj_t * selectedUser = nullptr;;
-    void createGUITabRaceGraph();
     //void createGUITabRSSI(lv_obj_t * parent);
 };
 
 static guiRace guiRace;
 static guiParticipant guiParticipants[ITAG_COUNT]; // TODO Could be dynamic
+static guiParticipantList guiRaceList;         // Race tab
+static guiParticipantList guiParticipantsList; // Participants tab
 static uint32_t globalHandleGFX = 0;  // We use the index into guiParticipants as a handle we will give to others like RaceDB
 
 static void gfxClearAllParticipantData();
+static void gfxShowTab(uint32_t tab);
+static void chartLaps_event_cb(lv_event_t * e);
+
+// Setting a label or style invalidates the widget and relayouts its parent even if nothing
+// changed. Most updates from RaceDB only change one or two values in a row so all periodic
+// updates go through these, they compare with the current label text (that is kept by LVGL
+// anyway so no extra cache memory is needed) and only touch the widget when it changes.
+#define GFX_LABEL_TEXT_MAX 128 // Longest formatted label text, longer is truncated
+static uint32_t gfxInvalidations = 0;          // Widgets changed since last second
+static uint32_t gfxInvalidationsPerSecond = 0; // Metric, see guiInvalidationsPerSecond()
+
+static void gfxSetLabelText(lv_obj_t * label, const char * text)
+{
+  if (strcmp(lv_label_get_text(label), text) == 0) {
+    return;
+  }
+  lv_label_set_text(label, text);
+  gfxInvalidations++;
+}
+
+static void gfxSetLabelTextFmt(lv_obj_t * label, const char * fmt, ...) __attribute__((format(printf, 2, 3)));
+static void gfxSetLabelTextFmt(lv_obj_t * label, const char * fmt, ...)
+{
+  char text[GFX_LABEL_TEXT_MAX];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(text, sizeof(text), fmt, args);
+  va_end(args);
+  gfxSetLabelText(label, text);
+}
+
+static void gfxSetTextAreaText(lv_obj_t * textArea, const char * text)
+{
+  if (strcmp(lv_textarea_get_text(textArea), text) == 0) {
+    return;
+  }
+  lv_textarea_set_text(textArea, text);
+  gfxInvalidations++;
+}
+
+static void gfxSetBgColor(lv_obj_t * obj, lv_color_t color)
+{
+  if (lv_obj_get_style_bg_color(obj, LV_PART_MAIN).full == color.full) {
+    return;
+  }
+  lv_obj_set_style_bg_color(obj, color, 0);
+  gfxInvalidations++;
+}
+
+uint32_t guiInvalidationsPerSecond()
+{
+  return gfxInvalidationsPerSecond;
+}
+
+// Race time as hhh:mm:ss.t
+static void gfxSetLabelRaceTime(lv_obj_t * label, int64_t timeMs)
+{
+  if (timeMs < 0) {
+    timeMs = 0;
+  }
+  int64_t tenths = timeMs / 100;
+  int64_t seconds = tenths / 10;
+  gfxSetLabelTextFmt(label, "%3d:%02d:%02d.%d", static_cast<int>(seconds / (60*60)), static_cast<int>((seconds / 60) % 60),
+                        static_cast<int>(seconds % 60), static_cast<int>(tenths % 10));
+}
+
+// Lap time as m:ss.t
+static void gfxSetLabelLapStats(lv_obj_t * label, const msg_UpdateParticipantLapStats &stats)
+{
+  if (stats.laps == 0) {
+    gfxSetLabelText(label, "");
+    return;
+  }
+  int64_t best = stats.bestLapTime / 100;
+  int64_t avg = stats.averageLapTime / 100;
+  if (stats.goal == 0) {
+    gfxSetLabelTextFmt(label, "best %d:%02d.%d\navg %d:%02d.%d",
+                          static_cast<int>(best / 600), static_cast<int>((best / 10) % 60), static_cast<int>(best % 10),
+                          static_cast<int>(avg / 600), static_cast<int>((avg / 10) % 60), static_cast<int>(avg % 10));
+  }
+  else {
+    // Ahead/behind the goal plan
+    gfxSetLabelTextFmt(label, "best %d:%02d.%d\navg %d:%02d.%d\ngoal %+.1fkm",
+                          static_cast<int>(best / 600), static_cast<int>((best / 10) % 60), static_cast<int>(best % 10),
+                          static_cast<int>(avg / 600), static_cast<int>((avg / 10) % 60), static_cast<int>(avg % 10),
+                          stats.goalAhead/1000.0);
+  }
+}
 
 static void btnTime_event_cb(lv_event_t * e)
 {
@@ -219,7 +454,7 @@ static void btnTime_event_cb(lv_event_t * e)
           //lv_obj_t * label = lv_obj_get_child(btn, 0);
           //lv_label_set_text_fmt(label, "Race Starts soon");
           startRaceCountdown(guiRace.getRaceStartCountdown());  //TODO should be signal
-          lv_obj_scroll_to_view_recursive(tabGraph, LV_ANIM_ON);
+          gfxShowTab(GUI_TAB_GRAPH);
           gfxClearAllParticipantData(); // TODO should probably be triggreded from RaceDB when it is cleared
         }
     }
@@ -236,7 +471,7 @@ static void btnTime_event_cb(lv_event_t * e)
         raceOngoing = true;
         lv_obj_t * label = lv_obj_get_child(btn, 0);
         lv_label_set_text_fmt(label, "Race continued!");
-        lv_obj_scroll_to_view_recursive(tabGraph, LV_ANIM_ON);
+        gfxShowTab(GUI_TAB_GRAPH);
       }
     }
 }
@@ -263,12 +498,19 @@ static void btnLoad_event_cb(lv_event_t * e)
     }
 }
 
+// Participant shown in the row the event is for, user data of the participant row widgets
+// is the guiListRow as rows are reused for different participants
+static uint32_t gfxEventRowHandle(lv_event_t * e)
+{
+  return reinterpret_cast<guiListRow *>(lv_event_get_user_data(e))->handleGFX;
+}
+
 static void btnTagAddToRace_event_cb(lv_event_t * e)
 {
     lv_event_code_t code = lv_event_get_code(e);
     //lv_obj_t * btn = lv_event_get_target(e);
-    if(code == LV_EVENT_SHORT_CLICKED) {
-      uint32_t handleGFX = reinterpret_cast<uint32_t>(lv_event_get_user_data(e));
+    uint32_t handleGFX = gfxEventRowHandle(e);
+    if(code == LV_EVENT_SHORT_CLICKED && handleGFX != UINT32_MAX) {
       msg_RaceDB msg;
       msg.UpdateParticipantRaceStatus.header.msgType = MSG_ITAG_UPDATE_USER_RACE_STATUS;
       msg.UpdateParticipantRaceStatus.handleDB = guiParticipants[handleGFX].handleDB;
@@ -282,43 +524,53 @@ static void btnTagAddToRace_event_cb(lv_event_t * e)
     }
 }
 
+// The on-screen keyboard is created the first time a text area is edited
+static lv_obj_t * gfxKeyboard()
+{
+  if (keyboard == nullptr) {
+    keyboard = lv_keyboard_create(lv_scr_act());
+    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+  }
+  return keyboard;
+}
+
 static void taEdit_event_cb(lv_event_t * e)
 {
   lv_event_code_t code = lv_event_get_code(e);
   lv_obj_t *ta = lv_event_get_target(e);
-  uint32_t handleGFX = reinterpret_cast<uint32_t>(lv_event_get_user_data(e));
+  uint32_t handleGFX = gfxEventRowHandle(e);
  // lv_obj_t *kb = reinterpret_cast<lv_obj_t *>(lv_event_get_user_data(e));
   if(code == LV_EVENT_FOCUSED) {
     if(lv_indev_get_type(lv_indev_get_act()) != LV_INDEV_TYPE_KEYPAD) {
-      lv_keyboard_set_mode(keyboard, LV_KEYBOARD_MODE_TEXT_LOWER);
-      lv_keyboard_set_textarea(keyboard, ta);
-      lv_obj_set_style_max_height(keyboard, LV_HOR_RES * 2 / 3, 0);
+      lv_keyboard_set_mode(gfxKeyboard(), LV_KEYBOARD_MODE_TEXT_LOWER);
+      lv_keyboard_set_textarea(gfxKeyboard(), ta);
+      lv_obj_set_style_max_height(gfxKeyboard(), LV_HOR_RES * 2 / 3, 0);
       lv_obj_update_layout(tabView);   /*Be sure the sizes are recalculated*/
-      lv_obj_set_height(tabView, LV_VER_RES - lv_obj_get_height(keyboard));
-      lv_obj_clear_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+      lv_obj_set_height(tabView, LV_VER_RES - lv_obj_get_height(gfxKeyboard()));
+      lv_obj_clear_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
       lv_obj_scroll_to_view_recursive(ta, LV_ANIM_ON);
     }
   }
   else if(code == LV_EVENT_DEFOCUSED) {
-    lv_keyboard_set_textarea(keyboard, NULL);
+    lv_keyboard_set_textarea(gfxKeyboard(), NULL);
     lv_obj_set_height(tabView, LV_VER_RES);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
     lv_indev_reset(NULL, ta);
   }
   else if(code == LV_EVENT_READY || code == LV_EVENT_CANCEL) {
     lv_obj_set_height(tabView, LV_VER_RES);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
     lv_obj_clear_state(ta, LV_STATE_FOCUSED);
     lv_indev_reset(NULL, ta);   /*To forget the last clicked object to make it focusable again*/
   }
 
   // Name updated -> send update signal to RaceDB, and update signal will be send back
   // that will resync name in all tabs.
-  if(code == LV_EVENT_READY || code == LV_EVENT_DEFOCUSED || code == LV_EVENT_CANCEL)
+  if((code == LV_EVENT_READY || code == LV_EVENT_DEFOCUSED || code == LV_EVENT_CANCEL) && handleGFX != UINT32_MAX)
   {
-    uint32_t color0 = lv_color_to32(lv_obj_get_style_bg_color(guiParticipants[handleGFX].ledColor0, LV_PART_MAIN));
-    uint32_t color1 = lv_color_to32(lv_obj_get_style_bg_color(guiParticipants[handleGFX].ledColor1, LV_PART_MAIN));
-    std::string nameParticipant = std::string(lv_textarea_get_text(guiParticipants[handleGFX].textAreaName));
+    uint32_t color0 = guiParticipants[handleGFX].color0;
+    uint32_t color1 = guiParticipants[handleGFX].color1;
+    std::string nameParticipant = std::string(lv_textarea_get_text(ta));
     bool inRace = guiParticipants[handleGFX].inRace;
 
     msg_RaceDB msg;
@@ -347,8 +599,8 @@ static void btnTagAdd_event_cb(lv_event_t * e)
 {
     lv_event_code_t code = lv_event_get_code(e);
     //lv_obj_t * btn = lv_event_get_target(e);
-    if(code == LV_EVENT_SHORT_CLICKED) {
-      uint32_t handleGFX = reinterpret_cast<uint32_t>(lv_event_get_user_data(e));
+    uint32_t handleGFX = gfxEventRowHandle(e);
+    if(code == LV_EVENT_SHORT_CLICKED && handleGFX != UINT32_MAX) {
       msg_RaceDB msg;
       msg.UpdateParticipantLapCount.header.msgType = MSG_ITAG_UPDATE_USER_LAP_COUNT;
       msg.UpdateParticipantLapCount.handleDB = guiParticipants[handleGFX].handleDB;
@@ -369,8 +621,8 @@ static void btnTagSub_event_cb(lv_event_t * e)
 {
     lv_event_code_t code = lv_event_get_code(e);
     //lv_obj_t * btn = lv_event_get_target(e);
-    if(code == LV_EVENT_SHORT_CLICKED) {
-      uint32_t handleGFX = reinterpret_cast<uint32_t>(lv_event_get_user_data(e));
+    uint32_t handleGFX = gfxEventRowHandle(e);
+    if(code == LV_EVENT_SHORT_CLICKED && handleGFX != UINT32_MAX) {
       msg_RaceDB msg;
       msg.UpdateParticipantLapCount.header.msgType = MSG_ITAG_UPDATE_USER_LAP_COUNT;
       msg.UpdateParticipantLapCount.handleDB = guiParticipants[handleGFX].handleDB;
@@ -450,8 +702,10 @@ static void btnCurrentUserGoalSub_event_cb(lv_event_t * e)
     if(code == LV_EVENT_SHORT_CLICKED) {
       uint32_t handleGFX = guiRace.getCurrentUserHandleGFX();
       uint32_t goal = guiRace.getCurrentUserPersonalGoal();
+      if (goal <= 2000) {
+        return; // Keep at least 2 km, 0 (no goal) is only set from the race file
+      }
       goal-=2000;
-      if(goal<2000) goal=2000;
       guiRace.setCurrentUserPersonalGoal(goal);
     }
 }
@@ -491,297 +745,381 @@ static void btnTest_event_cb(lv_event_t * e)
 }
 #endif
 
-static void gfxRemoveUserFromRace(uint32_t handleGFX)
-{
-  if (!guiParticipants[handleGFX].inRace) {
-    // Should already be remove but lets check for errors
-    if (guiParticipants[handleGFX].objRace ||
-        guiParticipants[handleGFX].ledRaceColor0 ||
-        guiParticipants[handleGFX].ledRaceColor1 ||
-        guiParticipants[handleGFX].labelRaceName ||
-        guiParticipants[handleGFX].labelRaceDist ||
-        guiParticipants[handleGFX].labelRaceLaps ||
-        guiParticipants[handleGFX].labelRaceTime ||
-        guiParticipants[handleGFX].labelRaceConnectionStatus) {
-        ESP_LOGE(TAG,"ERROR calling gfxRemoveUserFromRace() on a participant that should not be in the list AND all fields are not cleared as they should DO NOTHING");
-        }
+static const char * gfxConnectionSymbol(int8_t connectionStatus)
+{
+  if (connectionStatus == GFX_CONNECTION_UNKNOWN) {
+    return LV_SYMBOL_BLUETOOTH;
+  }
+  if (connectionStatus == 1) {
+    return LV_SYMBOL_EYE_CLOSE;
   }
-  // Remove it all
-  guiParticipants[handleGFX].inRace = false;
-  lv_obj_t * panel1 = guiParticipants[handleGFX].objRace;
-  guiParticipants[handleGFX].objRace = nullptr;
-  guiParticipants[handleGFX].ledRaceColor0 = nullptr;
-  guiParticipants[handleGFX].ledRaceColor1 = nullptr;
-  guiParticipants[handleGFX].labelRaceName = nullptr;
-  guiParticipants[handleGFX].labelRaceDist = nullptr;
-  guiParticipants[handleGFX].labelRaceLaps = nullptr;
-  guiParticipants[handleGFX].labelRaceTime = nullptr;
-  guiParticipants[handleGFX].labelRaceConnectionStatus = nullptr;
-  if (panel1) {
-    lv_obj_del(panel1);
+  if (connectionStatus == 0) {
+    return "";
   }
-  lv_label_set_text(guiParticipants[handleGFX].labelToRace, LV_SYMBOL_UPLOAD );
+  // if connectionStatus < 0 (as it should) it is the RSSI value of the tag
+  return LV_SYMBOL_EYE_OPEN;
 }
 
-static void gfxAddUserToRace(lv_obj_t * parent, uint32_t handleGFX)
+void guiParticipantList::create(lv_obj_t * parentTab, bool isRaceTab)
 {
-  if (!guiParticipants[handleGFX].inRace) {
-    lv_obj_t * panel1 = lv_obj_create(parent);
-    lv_obj_set_size(panel1, LV_PCT(100),LV_SIZE_CONTENT);
-    lv_obj_set_style_pad_all(panel1, 5,0); 
+  parent = parentTab;
+  raceTab = isRaceTab;
+
+  // Rows are placed by us (no flex layout), the spacer gives the tab its scroll height
+  spacer = lv_obj_create(parent);
+  lv_obj_remove_style_all(spacer);
+  lv_obj_set_size(spacer, 1, 1);
+  lv_obj_clear_flag(spacer, LV_OBJ_FLAG_CLICKABLE);
+  lv_obj_add_flag(spacer, LV_OBJ_FLAG_HIDDEN);
+
+  // Measure a row with its tallest content (see updateRow()) to know how many are needed to
+  // fill the screen, all rows get that fixed height so rows placed at index*rowHeight never overlap
+  guiListRow * row = createRow();
+  if (!raceTab) {
+    lv_label_set_text(row->labelLapStats, "best 0:00.0\navg 0:00.0\ngoal +0.0km");
+    lv_label_set_text(row->labelBattery, "100%\n~99h");
+  }
+  lv_obj_update_layout(row->obj);
+  lv_coord_t rowSpace = lv_obj_get_style_pad_row(parent, LV_PART_MAIN);
+  lv_coord_t objHeight = std::max(lv_obj_get_height(row->obj), static_cast<lv_coord_t>(1));
+  rowHeight = objHeight + rowSpace;
+  if (!raceTab) {
+    lv_label_set_text(row->labelLapStats, "");
+    lv_label_set_text(row->labelBattery, "");
+  }
+  uint32_t rowCount = LV_VER_RES / rowHeight + 2; // +2 for partly visible rows at top and bottom
+
+  rows.push_back(row);
+  while (rows.size() < rowCount) {
+    rows.push_back(createRow());
+  }
+  for (guiListRow * r : rows) {
+    lv_obj_set_height(r->obj, objHeight);
+    lv_obj_add_flag(r->obj, LV_OBJ_FLAG_HIDDEN);
+  }
+  lv_obj_add_event_cb(parent, scroll_event_cb, LV_EVENT_SCROLL, this);
+  layout(); // Participants added before the tab was created
+  ESP_LOGI(TAG,"guiParticipantList::create() raceTab:%d rows:%" PRIu32 " rowHeight:%" PRId32 "", raceTab, static_cast<uint32_t>(rows.size()), static_cast<int32_t>(rowHeight));
+}
+
+guiListRow * guiParticipantList::createRow()
+{
+  guiListRow * row = new guiListRow();
+  lv_obj_t * btn;
+  lv_obj_t * label;
+  lv_obj_t * panel1 = lv_obj_create(parent);
+  lv_obj_set_width(panel1, LV_PCT(100));
+  lv_obj_set_height(panel1, LV_SIZE_CONTENT);
+  int x_pos = 0;
 
+  if (raceTab) {
+    lv_obj_set_style_pad_all(panel1, 5,0);
     static lv_coord_t grid_1_col_dsc[] = {LV_GRID_CONTENT, LV_GRID_FR(1), LV_GRID_CONTENT,LV_GRID_CONTENT, LV_GRID_CONTENT, 30, LV_GRID_TEMPLATE_LAST};
     static lv_coord_t grid_1_row_dsc[] = {LV_GRID_CONTENT, LV_GRID_TEMPLATE_LAST};
+    lv_obj_set_grid_dsc_array(panel1, grid_1_col_dsc, grid_1_row_dsc);
+  }
+  else {
+    lv_obj_set_style_pad_all(panel1, 6,0);
+    static lv_coord_t grid_1_col_dsc[] = {LV_GRID_CONTENT, LV_GRID_CONTENT, LV_GRID_FR(1), LV_GRID_CONTENT,LV_GRID_CONTENT, LV_GRID_CONTENT, LV_GRID_CONTENT, 30, 40, LV_GRID_CONTENT, LV_GRID_CONTENT, LV_GRID_TEMPLATE_LAST};
+    static lv_coord_t grid_1_row_dsc[] = {LV_GRID_CONTENT, LV_GRID_TEMPLATE_LAST};
+    lv_obj_set_grid_dsc_array(panel1, grid_1_col_dsc, grid_1_row_dsc);
 
-    int x_pos = 0;
+    // ------ Add/Remove from Race Page
+    btn = lv_btn_create(panel1);
+    lv_obj_add_event_cb(btn, btnTagAddToRace_event_cb, LV_EVENT_ALL, row);
 
-    lv_obj_set_grid_cell(panel1, LV_GRID_ALIGN_STRETCH, 0, 2, LV_GRID_ALIGN_CENTER, 0, 1);
-    lv_obj_set_grid_dsc_array(panel1, grid_1_col_dsc, grid_1_row_dsc);
+    row->labelToRace = lv_label_create(btn);
+    lv_label_set_text(row->labelToRace, LV_SYMBOL_UPLOAD );
+    lv_obj_center(row->labelToRace);
+    lv_obj_add_style(row->labelToRace, &styleTagSmallText, 0);
+
+    lv_obj_set_grid_cell(btn, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+  }
+
+  // ------ Tag
+  row->ledColor1 = lv_obj_create(panel1);
+  lv_obj_add_style(row->ledColor1, &style_iTag1, 0);
+  lv_obj_remove_style(row->ledColor1, NULL, LV_PART_SCROLLBAR);
+  lv_obj_set_grid_cell(row->ledColor1, LV_GRID_ALIGN_CENTER, x_pos, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+
+  row->ledColor0 = lv_obj_create(panel1);
+  lv_obj_add_style(row->ledColor0, &style_iTag0, 0);
+  lv_obj_remove_style(row->ledColor0, NULL, LV_PART_SCROLLBAR);
+  lv_obj_set_grid_cell(row->ledColor0, LV_GRID_ALIGN_CENTER, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
 
-    lv_obj_t * ledColor1 = lv_obj_create(panel1);
-    lv_obj_add_style(ledColor1, &style_iTag1, 0);
-    lv_obj_remove_style(ledColor1, NULL, LV_PART_SCROLLBAR);
-    //lv_obj_set_style_bg_color(ledColor1, color1,0);
-    lv_obj_set_grid_cell(ledColor1, LV_GRID_ALIGN_CENTER, x_pos, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-    lv_obj_t * ledColor0 = lv_obj_create(panel1);
-    lv_obj_add_style(ledColor0, &style_iTag0, 0);
-    lv_obj_remove_style(ledColor0, NULL, LV_PART_SCROLLBAR);
-    //lv_obj_set_style_bg_color(ledColor0, color0,0);
-    lv_obj_set_grid_cell(ledColor0, LV_GRID_ALIGN_CENTER, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-    lv_obj_t * labelName = lv_label_create(panel1);
-    //lv_label_set_text(labelName, nameParticipant.c_str());
-    lv_obj_add_style(labelName, &styleTagText, 0);
-    lv_label_set_long_mode(labelName, LV_LABEL_LONG_CLIP);
-    lv_obj_set_grid_cell(labelName, LV_GRID_ALIGN_START, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-    lv_obj_t * labelDist = lv_label_create(panel1);
-    lv_obj_add_style(labelDist, &styleTagText, 0);
-    //lv_label_set_text_fmt(labelDist, "   -.--- km");
-    lv_obj_set_grid_cell(labelDist, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-    lv_obj_t * labelLaps = lv_label_create(panel1);
-    //lv_label_set_text_fmt(labelLaps, "(%2d/%2d)",0,guiRace.getLaps());
-    lv_obj_add_style(labelLaps, &styleTagText, 0);
-    lv_obj_set_grid_cell(labelLaps, LV_GRID_ALIGN_START, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-    lv_obj_t * labelTime = lv_label_create(panel1);
-    lv_obj_add_style(labelTime, &styleTagText, 0);
-    //struct tm timeinfo;
-    //time_t tt = 0;//msgParticipant.lastlaptime;
-    //localtime_r(&tt, &timeinfo);
-    //lv_label_set_text_fmt(labelTime, "%3d:%02d:%02d", (timeinfo.tm_mday-1)*24+timeinfo.tm_hour,timeinfo.tm_min,timeinfo.tm_sec);
-    lv_obj_set_grid_cell(labelTime, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-    lv_obj_t * labelConnectionStatus = lv_label_create(panel1);
-    lv_obj_add_style(labelConnectionStatus, &styleIcon, 0);
-    lv_label_set_text(labelConnectionStatus, LV_SYMBOL_BLUETOOTH);
-    lv_obj_set_grid_cell(labelConnectionStatus, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-    // All well so far, lets update the internal struct with the info.
-    guiParticipants[handleGFX].objRace = panel1;
-    guiParticipants[handleGFX].ledRaceColor0 = ledColor0;
-    guiParticipants[handleGFX].ledRaceColor1 = ledColor1;
-    guiParticipants[handleGFX].labelRaceName = labelName;
-    guiParticipants[handleGFX].labelRaceDist = labelDist;
-    guiParticipants[handleGFX].labelRaceLaps = labelLaps;
-    guiParticipants[handleGFX].labelRaceTime = labelTime;
-    guiParticipants[handleGFX].labelRaceConnectionStatus = labelConnectionStatus;
-    guiParticipants[handleGFX].inRace = true;
+  // ------ Name
+  if (raceTab) {
+    row->labelName = lv_label_create(panel1);
+    lv_obj_add_style(row->labelName, &styleTagText, 0);
+    lv_label_set_long_mode(row->labelName, LV_LABEL_LONG_CLIP);
+    lv_obj_set_grid_cell(row->labelName, LV_GRID_ALIGN_START, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
   }
   else {
-    // Already added make sure all fiealds are valid
-    if (!(guiParticipants[handleGFX].objRace &&
-        guiParticipants[handleGFX].ledRaceColor0 &&
-        guiParticipants[handleGFX].ledRaceColor1 &&
-        guiParticipants[handleGFX].labelRaceName &&
-        guiParticipants[handleGFX].labelRaceDist &&
-        guiParticipants[handleGFX].labelRaceLaps &&
-        guiParticipants[handleGFX].labelRaceTime &&
-        guiParticipants[handleGFX].labelRaceConnectionStatus)) {
-        ESP_LOGE(TAG,"ERROR calling gfxAddUserToRace() again on a already added object AND all fields are not set as they should, will try to remove and re-add");
-        gfxRemoveUserFromRace(handleGFX);
-        gfxAddUserToRace(parent, handleGFX);
-        //the recursive call to gfxAddUserToRace() above have handled all the rest of the stuff so return here
-        return;
-      }
+    row->textAreaName = lv_textarea_create(panel1);
+    lv_obj_add_style(row->textAreaName, &styleTagSmallText, 0);
+    lv_textarea_set_one_line(row->textAreaName, true);
+    lv_textarea_set_password_mode(row->textAreaName, false);
+    lv_obj_add_event_cb(row->textAreaName, taEdit_event_cb, LV_EVENT_ALL, row);
+    lv_obj_set_grid_cell(row->textAreaName, LV_GRID_ALIGN_START, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
   }
 
-  lv_label_set_text(guiParticipants[handleGFX].labelToRace, LV_SYMBOL_OK );
+  // ------ Dist
+  row->labelDist = lv_label_create(panel1);
+  lv_obj_add_style(row->labelDist, &styleTagText, 0);
+  lv_label_set_text(row->labelDist, "   -.--- km");
+  lv_obj_set_grid_cell(row->labelDist, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+
+  // ------ Laps
+  row->labelLaps = lv_label_create(panel1);
+  lv_obj_add_style(row->labelLaps, &styleTagText, 0);
+  lv_label_set_text(row->labelLaps, "");
+  lv_obj_set_grid_cell(row->labelLaps, LV_GRID_ALIGN_START, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+
+  // ------ Last time
+  row->labelTime = lv_label_create(panel1);
+  lv_obj_add_style(row->labelTime, &styleTagText, 0);
+  gfxSetLabelRaceTime(row->labelTime, 0);
+  lv_obj_set_grid_cell(row->labelTime, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+
+  if (!raceTab) {
+    // ------ Best/Average lap
+    row->labelLapStats = lv_label_create(panel1);
+    lv_label_set_text(row->labelLapStats, "");
+    lv_obj_add_style(row->labelLapStats, &styleTagSmallText, 0);
+    lv_obj_set_grid_cell(row->labelLapStats, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+  }
+
+  row->labelConnectionStatus = lv_label_create(panel1);
+  lv_obj_add_style(row->labelConnectionStatus, &styleIcon, 0);
+  lv_label_set_text(row->labelConnectionStatus, LV_SYMBOL_BLUETOOTH);
+  lv_obj_set_grid_cell(row->labelConnectionStatus, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+
+  if (!raceTab) {
+    // ------ BT Battery
+    row->labelBattery = lv_label_create(panel1);
+    lv_label_set_text(row->labelBattery, "");
+    lv_obj_add_style(row->labelBattery, &styleTagSmallText, 0);
+    lv_obj_set_grid_cell(row->labelBattery, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
 
-  // Copy content from Particapand GUI
-  lv_color_t color0 = lv_obj_get_style_bg_color(guiParticipants[handleGFX].ledColor0, LV_PART_MAIN);
-  lv_color_t color1 = lv_obj_get_style_bg_color(guiParticipants[handleGFX].ledColor1, LV_PART_MAIN);
-  std::string nameParticipant = std::string(lv_textarea_get_text(guiParticipants[handleGFX].textAreaName));
-  std::string RaceDist = std::string(lv_label_get_text(guiParticipants[handleGFX].labelDist));
-  std::string RaceLaps = std::string(lv_label_get_text(guiParticipants[handleGFX].labelLaps));
-  std::string RaceTime = std::string(lv_label_get_text(guiParticipants[handleGFX].labelTime));
-  std::string RaceConnectionStatus = std::string(lv_label_get_text(guiParticipants[handleGFX].labelConnectionStatus));
+    // ------ Add/Sub lap (In case of error)
+    btn = lv_btn_create(panel1);
+    lv_obj_add_event_cb(btn, btnTagSub_event_cb, LV_EVENT_ALL, row);
 
-  // Update fields
-  lv_obj_set_style_bg_color(guiParticipants[handleGFX].ledRaceColor1, color1,0);
-  lv_obj_set_style_bg_color(guiParticipants[handleGFX].ledRaceColor0, color0,0);
-  lv_label_set_text(guiParticipants[handleGFX].labelRaceName, nameParticipant.c_str());
-  lv_label_set_text(guiParticipants[handleGFX].labelRaceDist, RaceDist.c_str());
-  lv_label_set_text(guiParticipants[handleGFX].labelRaceLaps, RaceLaps.c_str());
-  lv_label_set_text(guiParticipants[handleGFX].labelRaceTime, RaceTime.c_str());
-  lv_label_set_text(guiParticipants[handleGFX].labelRaceConnectionStatus, RaceConnectionStatus.c_str());
+    label = lv_label_create(btn);
+    lv_label_set_text(label, LV_SYMBOL_MINUS );
+    lv_obj_center(label);
+    lv_obj_add_style(label, &styleTagSmallText, 0);
+
+    lv_obj_set_grid_cell(btn, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+
+    // ------
+    btn = lv_btn_create(panel1);
+    lv_obj_add_event_cb(btn, btnTagAdd_event_cb, LV_EVENT_ALL, row);
+
+    label = lv_label_create(btn);
+    lv_label_set_text(label, LV_SYMBOL_PLUS);
+    lv_obj_center(label);
+    lv_obj_add_style(label, &styleTagSmallText, 0);
+
+    lv_obj_set_grid_cell(btn, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+  }
+
+  row->obj = panel1;
+  return row;
 }
 
-static void gfxUpdateInRace(bool newInRace, uint32_t handleGFX)
+void guiParticipantList::bindRow(guiListRow &row, uint32_t index)
 {
-  if(newInRace)
-  {
-    if (!guiParticipants[handleGFX].inRace) {
-      //make sure participant is on race page
-      gfxAddUserToRace(tabRace, handleGFX);  // and updated fields
-    }
-  }
-  else {
-    if (guiParticipants[handleGFX].inRace) {
-      //make sure participant is NOT on race page
-      gfxRemoveUserFromRace(handleGFX);
+  uint32_t handleGFX = items[index];
+  if (row.index != index) {
+    lv_obj_set_y(row.obj, index * rowHeight);
+    row.index = index;
+  }
+  if (row.handleGFX != handleGFX) {
+    if (row.textAreaName && lv_obj_has_state(row.textAreaName, LV_STATE_FOCUSED)) {
+      // Finish editing before the row is reused, this sends the name to RaceDB
+      lv_event_send(row.textAreaName, LV_EVENT_READY, nullptr);
     }
+    row.handleGFX = handleGFX;
+    lv_obj_clear_flag(row.obj, LV_OBJ_FLAG_HIDDEN);
+    updateRow(row);
   }
 }
 
-static bool gfxAddUserToParticipants(lv_obj_t * parent, msg_AddParticipant &msgParticipant, uint32_t handleGFX)
+void guiParticipantList::unbindRow(guiListRow &row)
 {
-  lv_obj_t * btn;
-  lv_obj_t *label;
-  lv_obj_t * panel1 = lv_obj_create(parent);
-  lv_obj_set_size(panel1, LV_PCT(100),LV_SIZE_CONTENT);
-  lv_obj_set_style_pad_all(panel1, 6,0);
-
-  static lv_coord_t grid_1_col_dsc[] = {LV_GRID_CONTENT, LV_GRID_CONTENT, LV_GRID_FR(1), LV_GRID_CONTENT,LV_GRID_CONTENT, LV_GRID_CONTENT, 30, 40, LV_GRID_CONTENT, LV_GRID_CONTENT, LV_GRID_TEMPLATE_LAST};
-  static lv_coord_t grid_1_row_dsc[] = {LV_GRID_CONTENT, LV_GRID_TEMPLATE_LAST};
-
-  int x_pos = 0;
-
-  lv_obj_set_grid_cell(panel1, LV_GRID_ALIGN_STRETCH, 0, 2, LV_GRID_ALIGN_CENTER, 0, 1);
-  lv_obj_set_grid_dsc_array(panel1, grid_1_col_dsc, grid_1_row_dsc);
-
-  // ------ Add/Remove from Race Page
-  btn = lv_btn_create(panel1); 
-  lv_obj_align_to(btn, parent, LV_ALIGN_OUT_RIGHT_BOTTOM, 0, 0);
-  lv_obj_add_event_cb(btn, btnTagAddToRace_event_cb, LV_EVENT_ALL, reinterpret_cast<void *>(handleGFX));
+  if (row.handleGFX == UINT32_MAX) {
+    return;
+  }
+  if (row.textAreaName && lv_obj_has_state(row.textAreaName, LV_STATE_FOCUSED)) {
+    lv_event_send(row.textAreaName, LV_EVENT_READY, nullptr);
+  }
+  row.handleGFX = UINT32_MAX;
+  row.index = UINT32_MAX;
+  lv_obj_add_flag(row.obj, LV_OBJ_FLAG_HIDDEN);
+}
 
-  lv_obj_t * labelToRace = lv_label_create(btn);
-  lv_label_set_text(labelToRace, LV_SYMBOL_UPLOAD );
-  lv_obj_center(labelToRace);
-  lv_obj_add_style(labelToRace, &styleTagSmallText, 0);
+void guiParticipantList::updateRow(guiListRow &row)
+{
+  const guiParticipant &participant = guiParticipants[row.handleGFX];
 
-  lv_obj_set_grid_cell(btn, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+  gfxSetBgColor(row.ledColor1, lv_color_hex(participant.color1));
+  gfxSetBgColor(row.ledColor0, lv_color_hex(participant.color0));
+  if (row.labelToRace) {
+    gfxSetLabelText(row.labelToRace, participant.inRace ? LV_SYMBOL_OK : LV_SYMBOL_UPLOAD);
+  }
+  if (row.textAreaName) {
+    gfxSetTextAreaText(row.textAreaName, participant.name);
+  }
+  if (row.labelName) {
+    gfxSetLabelText(row.labelName, participant.name);
+  }
 
-  // ------ Tag
-  lv_obj_t * ledColor1 = lv_obj_create(panel1);
-  lv_obj_add_style(ledColor1, &style_iTag1, 0);
-  lv_obj_remove_style(ledColor1, NULL, LV_PART_SCROLLBAR);
-  lv_obj_set_style_bg_color(ledColor1, lv_color_hex(msgParticipant.color1),0);
-  lv_obj_set_grid_cell(ledColor1, LV_GRID_ALIGN_CENTER, x_pos, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-  lv_obj_t * ledColor0 = lv_obj_create(panel1);
-  lv_obj_add_style(ledColor0, &style_iTag0, 0);
-  lv_obj_remove_style(ledColor0, NULL, LV_PART_SCROLLBAR);
-  lv_obj_set_style_bg_color(ledColor0, lv_color_hex(msgParticipant.color0),0);
-  lv_obj_set_grid_cell(ledColor0, LV_GRID_ALIGN_CENTER, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+  gfxSetLabelTextFmt(row.labelDist, "%4.3fkm",participant.distance/1000.0);
+  if (!guiRace.isTimeBasedRace()) {
+    gfxSetLabelTextFmt(row.labelLaps, "(%2" PRId32 "/%2" PRId32 ")",participant.laps,guiRace.getLaps());
+  }
+  else {
+    gfxSetLabelTextFmt(row.labelLaps, "(%2" PRId32 ")",participant.laps);
+  }
+  gfxSetLabelRaceTime(row.labelTime, participant.thisLapStart);
+  if (row.labelLapStats) {
+    gfxSetLabelLapStats(row.labelLapStats, participant.lapStats);
+  }
+  gfxSetLabelText(row.labelConnectionStatus, gfxConnectionSymbol(participant.connectionStatus));
 
-  // ------ Name
-  lv_obj_t * textAreaName = lv_textarea_create(panel1);
-  lv_obj_add_style(textAreaName, &styleTagSmallText, 0);
-  lv_textarea_set_text(textAreaName, msgParticipant.name);
-  lv_textarea_set_one_line(textAreaName, true);
-  lv_textarea_set_password_mode(textAreaName, false);
-  lv_obj_add_event_cb(textAreaName, taEdit_event_cb, LV_EVENT_ALL, reinterpret_cast<void *>(handleGFX));
-  lv_obj_set_grid_cell(textAreaName, LV_GRID_ALIGN_START, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-  // ------ Dist 
-  lv_obj_t * labelDist = lv_label_create(panel1);
-  lv_obj_add_style(labelDist, &styleTagText, 0);
-  lv_label_set_text_fmt(labelDist, "   -.--- km");
-  lv_obj_set_grid_cell(labelDist, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+  if (row.labelBattery) {
+    if (participant.battery < 0) {
+      gfxSetLabelText(row.labelBattery, "");
+    }
+    else if (participant.batteryHoursLeft >= 0) {
+      gfxSetLabelTextFmt(row.labelBattery, "%3d%%\n~%dh",participant.battery,participant.batteryHoursLeft);
+    }
+    else {
+      gfxSetLabelTextFmt(row.labelBattery, "%3d%%",participant.battery);
+    }
+    if (row.batteryLow != participant.batteryLow) {
+      row.batteryLow = participant.batteryLow;
+      if (participant.batteryLow) {
+        lv_obj_add_style(row.labelBattery, &styleBatteryLow, 0);
+      }
+      else {
+        lv_obj_remove_style(row.labelBattery, &styleBatteryLow, 0);
+      }
+      gfxInvalidations++;
+    }
+  }
+}
 
-  // ------ Laps
-  lv_obj_t * labelLaps = lv_label_create(panel1);
-  lv_label_set_text_fmt(labelLaps, "(%2d/%2ld)",0,guiRace.getLaps());
-  lv_obj_add_style(labelLaps, &styleTagText, 0);
-  lv_obj_set_grid_cell(labelLaps, LV_GRID_ALIGN_START, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+void guiParticipantList::layout()
+{
+  if (rows.empty() || inLayout) {
+    return;
+  }
+  inLayout = true;
+  if (items.empty()) {
+    lv_obj_add_flag(spacer, LV_OBJ_FLAG_HIDDEN);
+  }
+  else {
+    lv_obj_set_y(spacer, items.size() * rowHeight - 1);
+    lv_obj_clear_flag(spacer, LV_OBJ_FLAG_HIDDEN);
+  }
 
-  // ------ Last time
-  lv_obj_t * labelTime = lv_label_create(panel1);
-  lv_obj_add_style(labelTime, &styleTagText, 0);
-  struct tm timeinfo;
-  time_t tt = 0;//msgParticipant.lastlaptime;
-  localtime_r(&tt, &timeinfo);
-  lv_label_set_text_fmt(labelTime, "%3d:%02d:%02d", (timeinfo.tm_mday-1)*24+timeinfo.tm_hour,timeinfo.tm_min,timeinfo.tm_sec);
-  lv_obj_set_grid_cell(labelTime, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-  lv_obj_t * labelConnectionStatus = lv_label_create(panel1);
-  lv_obj_add_style(labelConnectionStatus, &styleIcon, 0);
-  lv_label_set_text(labelConnectionStatus, LV_SYMBOL_BLUETOOTH);
-  lv_obj_set_grid_cell(labelConnectionStatus, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
-
-  // ------ BT Battery
-  lv_obj_t * labelBattery = lv_label_create(panel1);
-  lv_label_set_text(labelBattery, "");
-  lv_obj_add_style(labelBattery, &styleTagSmallText, 0);
-  lv_obj_set_grid_cell(labelBattery, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+  lv_coord_t scrollY = std::max(lv_obj_get_scroll_y(parent), static_cast<lv_coord_t>(0));
+  uint32_t first = scrollY / rowHeight;
+  for (uint32_t index = first; index < first + rows.size(); index++) {
+    guiListRow &row = *rows[index % rows.size()];
+    if (index < items.size()) {
+      bindRow(row, index);
+    }
+    else {
+      unbindRow(row);
+    }
+  }
+  inLayout = false;
+}
 
-  // ------ Add/Sub lap (In case of error)
-  btn = lv_btn_create(panel1); 
-  lv_obj_align_to(btn, parent, LV_ALIGN_OUT_RIGHT_BOTTOM, 0, 0);
-  lv_obj_add_event_cb(btn, btnTagSub_event_cb, LV_EVENT_ALL, reinterpret_cast<void *>(handleGFX));
+void guiParticipantList::scroll_event_cb(lv_event_t * e)
+{
+  guiParticipantList * list = reinterpret_cast<guiParticipantList *>(lv_event_get_user_data(e));
+  list->layout();
+}
 
-  label = lv_label_create(btn);
-  lv_label_set_text(label, LV_SYMBOL_MINUS );
-  lv_obj_center(label);
-  lv_obj_add_style(label, &styleTagSmallText, 0);
+void guiParticipantList::add(uint32_t handleGFX)
+{
+  if (std::find(items.begin(), items.end(), handleGFX) != items.end()) {
+    return; // Already in list
+  }
+  items.push_back(handleGFX);
+  layout();
+}
 
-  lv_obj_set_grid_cell(btn, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+void guiParticipantList::remove(uint32_t handleGFX)
+{
+  auto item = std::find(items.begin(), items.end(), handleGFX);
+  if (item == items.end()) {
+    return;
+  }
+  items.erase(item);
+  layout();
+}
 
-  // ------
-  btn = lv_btn_create(panel1); 
-  lv_obj_align_to(btn, parent, LV_ALIGN_OUT_RIGHT_BOTTOM, 0, 0);
-  lv_obj_add_event_cb(btn, btnTagAdd_event_cb, LV_EVENT_ALL, reinterpret_cast<void *>(handleGFX));
+// Move participant to position, participants in between shift one step
+void guiParticipantList::move(uint32_t handleGFX, uint32_t position)
+{
+  auto item = std::find(items.begin(), items.end(), handleGFX);
+  if (item == items.end()) {
+    return; // Not in list
+  }
+  position = std::min(position, static_cast<uint32_t>(items.size() - 1));
+  uint32_t current = item - items.begin();
+  if (current == position) {
+    return;
+  }
+  items.erase(item);
+  items.insert(items.begin() + position, handleGFX);
+  layout();
+}
 
-  label = lv_label_create(btn);
-  lv_label_set_text(label, LV_SYMBOL_PLUS);
-  lv_obj_center(label);
-  lv_obj_add_style(label, &styleTagSmallText, 0);
+void guiParticipantList::refresh(uint32_t handleGFX)
+{
+  for (guiListRow * row : rows) {
+    if (row->handleGFX == handleGFX) {
+      updateRow(*row);
+    }
+  }
+}
 
-  lv_obj_set_grid_cell(btn, LV_GRID_ALIGN_END, x_pos++, 1, LV_GRID_ALIGN_CENTER, 0, 1);
+void guiParticipantList::refreshAll()
+{
+  for (guiListRow * row : rows) {
+    if (row->handleGFX != UINT32_MAX) {
+      updateRow(*row);
+    }
+  }
+}
 
-  lv_chart_series_t * seriesLaps = lv_chart_add_series(chartLaps, lv_color_hex(msgParticipant.color0), LV_CHART_AXIS_PRIMARY_Y);
-  //lv_chart_series_t * seriesRSSI = lv_chart_add_series(chartRSSI, lv_color_hex(msgParticipant.color0), LV_CHART_AXIS_PRIMARY_Y);
+static void gfxRefreshParticipant(uint32_t handleGFX)
+{
+  guiParticipantsList.refresh(handleGFX);
+  guiRaceList.refresh(handleGFX);
+}
 
-  guiRace.updateGUITabRaceGraphGoalLines();
-
-  // All well so far, lets update the internal struct with the info.
-  guiParticipants[handleGFX].handleDB = msgParticipant.handleDB;
-  guiParticipants[handleGFX].laps = 0;
-  guiParticipants[handleGFX].thisLapStart = 0;
-  guiParticipants[handleGFX].seriesLaps = seriesLaps;
-  //guiParticipants[handleGFX].seriesRSSI = seriesRSSI;
-  guiParticipants[handleGFX].labelToRace = labelToRace;
-  guiParticipants[handleGFX].ledColor0 = ledColor0;
-  guiParticipants[handleGFX].ledColor1 = ledColor1;
-  guiParticipants[handleGFX].textAreaName = textAreaName;
-  guiParticipants[handleGFX].labelDist = labelDist;
-  guiParticipants[handleGFX].labelLaps = labelLaps;
-  guiParticipants[handleGFX].labelTime = labelTime;
-  guiParticipants[handleGFX].labelConnectionStatus = labelConnectionStatus;
-  guiParticipants[handleGFX].labelBattery = labelBattery;
-  guiParticipants[handleGFX].inRace = false;
-  guiParticipants[handleGFX].objRace = nullptr;
-  guiParticipants[handleGFX].ledRaceColor0 = nullptr;
-  guiParticipants[handleGFX].ledRaceColor1 = nullptr;
-  guiParticipants[handleGFX].labelRaceName = nullptr;
-  guiParticipants[handleGFX].labelRaceDist = nullptr;
-  guiParticipants[handleGFX].labelRaceLaps = nullptr;
-  guiParticipants[handleGFX].labelRaceTime = nullptr;
-  guiParticipants[handleGFX].labelRaceConnectionStatus = nullptr;
-  return true;
+static void gfxUpdateInRace(bool newInRace, uint32_t handleGFX)
+{
+  if (guiParticipants[handleGFX].inRace == newInRace) {
+    return;
+  }
+  guiParticipants[handleGFX].inRace = newInRace;
+  if(newInRace) {
+    //make sure participant is on race page
+    guiRaceList.add(handleGFX);
+  }
+  else {
+    //make sure participant is NOT on race page
+    guiRaceList.remove(handleGFX);
+  }
+  guiParticipantsList.refresh(handleGFX); // Add/Remove from race button
 }
 
 void guiRace::createGUITabRaceGraph()
@@ -842,6 +1180,7 @@ void guiRace::createGUITabRaceGraph()
   // Do not display points on the data
   lv_obj_set_style_size(chartLaps, 2, LV_PART_INDICATOR);
   //lv_obj_set_style_line_width(chartLaps, 2, LV_PART_ITEMS); 
+  lv_obj_add_event_cb(chartLaps, chartLaps_event_cb, LV_EVENT_SIZE_CHANGED, NULL); // Redraw static layer
 
 
 
@@ -875,28 +1214,97 @@ void guiRace::createGUITabRaceGraph()
 
   labelCurrentUserGoal = lv_label_create(selectedUser2);
   lv_obj_add_style(labelCurrentUserGoal, &styleTagText, 0);
-  lv_label_set_text_fmt(labelCurrentUserGoal, "Goal: %" PRId32 " km",personalGoal/1000);
+  updateCurrentUserGoalLabel();
 
 
   if(isDataValid()) {
     updateGUITabRaceGraph();
   }
+
+  // Participants added before (or while the graph was released) get their series back
+  for(uint32_t handleGFX = 0; handleGFX < globalHandleGFX; handleGFX++) {
+    guiParticipant &participant = guiParticipants[handleGFX];
+    participant.seriesLaps = lv_chart_add_series(chartLaps, lv_color_hex(participant.color0), LV_CHART_AXIS_PRIMARY_Y);
+    participant.lapSeries.setSeries(participant.seriesLaps);
+  }
+  if (globalHandleGFX > 0) {
+    UpdateCurrentUserInfo(getCurrentUserHandleGFX());
+  }
+}
+
+// Delete the graph tab content, lap data is kept in lapGraphSeries so it can be created again
+void guiRace::releaseGUITabRaceGraph()
+{
+  ESP_LOGI(TAG,"releaseGUITabRaceGraph()");
+  for(uint32_t handleGFX = 0; handleGFX < globalHandleGFX; handleGFX++) {
+    guiParticipants[handleGFX].seriesLaps = nullptr;
+    guiParticipants[handleGFX].lapSeries.setSeries(nullptr);
+  }
+  lv_obj_clean(tabGraph); // chartLaps, selectedUser and staticLayer
+  chartLaps = nullptr;
+  selectedUser = nullptr;
+  labelCurrentUserName = nullptr;
+  labelCurrentUserGoal = nullptr;
+  staticLayer = nullptr;
+  if (staticLayerBuf != nullptr) {
+    heap_caps_free(staticLayerBuf);
+    staticLayerBuf = nullptr;
+  }
+  staticLayerW = 0;
+  staticLayerH = 0;
 }
 
+uint32_t guiRace::getCurrentUserPersonalGoal()
+{
+  return guiParticipants[getCurrentUserHandleGFX()].lapStats.goal;
+}
+
+// Goals are kept by RaceDB, the GUI is updated when the MSG_GFX_UPDATE_USER_STATS with the new goal arrives
 void guiRace::setCurrentUserPersonalGoal(uint32_t goal)
 {
-  personalGoal = goal; 
-  updateGUITabRaceGraphGoalLines();
-  UpdateCurrentUserInfo(getCurrentUserHandleGFX());
-  lv_label_set_text_fmt(labelCurrentUserGoal, "Goal: %" PRId32 " km",goal/1000);
+  uint32_t handleGFX = getCurrentUserHandleGFX();
+  msg_RaceDB msg;
+  msg.UpdateParticipantGoal.header.msgType = MSG_ITAG_UPDATE_USER_GOAL;
+  msg.UpdateParticipantGoal.handleDB = guiParticipants[handleGFX].handleDB;
+  msg.UpdateParticipantGoal.handleGFX = handleGFX;
+  msg.UpdateParticipantGoal.goal = goal;
+  BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 1000 ));
+  if (!xReturned) {
+    // it it fails let the user click again
+    ESP_LOGW(TAG,"WARNING: Send: MSG_ITAG_UPDATE_USER_GOAL MSG:0x%" PRIx32 " handleGFX:0x%08" PRIx32 " goal:%" PRIu32 " could not be sent in 1000ms. USER need to retry",
+                  msg.UpdateParticipantGoal.header.msgType, handleGFX, goal);
+  }
+}
+
+void guiRace::currentUserPersonalGoalChanged()
+{
+  if (labelCurrentUserGoal == nullptr) {
+    return; // Graph tab not created yet
+  }
+  updateCurrentUserGoalLabel();
   if(isDataValid()) {
-    updateGUITabRaceGraph();
+    updateGUITabRaceGraph(); // Also updates goal lines
+  }
+}
+
+void guiRace::updateCurrentUserGoalLabel()
+{
+  uint32_t goal = getCurrentUserPersonalGoal();
+  if (goal == 0) {
+    lv_label_set_text(labelCurrentUserGoal, "Goal: none"); // e.g. from the race file, + sets one
+  }
+  else {
+    lv_label_set_text_fmt(labelCurrentUserGoal, "Goal: %" PRId32 " km",goal/1000);
   }
 }
 
 void guiRace::UpdateCurrentUserInfo(uint32_t handleGFX)
 {
-    // ---- Pace from start
+  if (labelCurrentUserName == nullptr) {
+    return; // Graph tab not created, updated when it is
+  }
+  // Pace is calculated by RaceDB for each lap, see MSG_GFX_UPDATE_USER_STATS
+  const msg_UpdateParticipantLapStats &stats = guiParticipants[handleGFX].lapStats;
   uint32_t lapDist = getDistance();
   if (!isTimeBasedRace()) {
     uint32_t laps = getLaps();
@@ -906,91 +1314,44 @@ void guiRace::UpdateCurrentUserInfo(uint32_t handleGFX)
   }
 
   double dist = guiParticipants[handleGFX].laps * lapDist;
-  double timeUntilNow = guiParticipants[handleGFX].thisLapStart;
 
-  if (dist < 1) dist=1.0; //division protection            
-  uint32_t paceFromStartTotSeconds = timeUntilNow / (dist/1000.0);
+  // ---- Pace from start
+  uint32_t paceFromStartTotSeconds = stats.averagePace;
   uint32_t paceFromStartMin = paceFromStartTotSeconds / 60;
   uint32_t paceFromStartSec = paceFromStartTotSeconds - (paceFromStartMin * 60);
-  
-  // ---- Current pace
-  // Just take pace from the last 4 passings (e.g. 3 laps)
-  static double distLap1=1;
-  static double timeLap1=1;
-  static double distLap2=2;
-  static double timeLap2=2;
-  static double distLap3=3;
-  static double timeLap3=3;
-  static double distLap4=4;
-  static double timeLap4=4;
-  timeLap1 = timeLap2;
-  timeLap2 = timeLap3;
-  timeLap3 = timeLap4;
-  timeLap4 = timeUntilNow;
-
-  distLap1 = distLap2;
-  distLap2 = distLap3;
-  distLap3 = distLap4;
-  distLap4 = dist;
-
-  double deltaTime= timeLap4 - timeLap1;
-  double deltaDist= distLap4 - distLap1;
-  if (deltaDist < 1) deltaDist=1.0; //division protection            
-  uint32_t paceNowTotSeconds = deltaTime / (deltaDist/1000.0);
+
+  // ---- Current pace (last LAP_STATS_LAST_N laps)
+  uint32_t paceNowTotSeconds = stats.currentPace;
   uint32_t paceNowMin = paceNowTotSeconds / 60;
   uint32_t paceNowSec = paceNowTotSeconds - (paceNowMin * 60);
-  
-  // ---- Needed pace rest of race to achive goal!
-
-  //Break left pace up in 2 parts, one for firt half goal, and one for the rest of the race 
-  double timeLeft;
-  double distLeft;
-  bool firstHalf=false;
-  // Adjust to first half if needed (if in first half AND first half goal has not been meet already)
-  if ((timeUntilNow < (getMaxTime()*60*60/2)) && (dist < (0.60 * getCurrentUserPersonalGoal()) ) ) {
-    firstHalf=true;
-    //halftime to 0.60 * getCurrentUserPersonalGoal()
-    //and after 12h guiRace.getCurrentUserPersonalGoal()
-    timeLeft = (getMaxTime()*60*60/2) - timeUntilNow;
-    distLeft = (0.60 * getCurrentUserPersonalGoal()) - dist;
-  }
-  else {
-    // 2:nd half, just use rest up to goal
-    // Total race
-    timeLeft = (24*60*60) - timeUntilNow;
-    distLeft = getCurrentUserPersonalGoal() - dist;
-  }
 
-  if (distLeft < 1.0) distLeft=1.0; //division protection            
-  uint32_t paceLeftTotSeconds = timeLeft / (distLeft/1000.0);
+  // ---- Needed pace to reach next goal checkpoint (calculated by RaceDB)
+  uint32_t paceLeftTotSeconds = stats.goalPace;
   uint32_t paceLeftMin = paceLeftTotSeconds / 60;
   uint32_t paceLeftSec = paceLeftTotSeconds - (paceLeftMin * 60);
 
-  if (paceNowTotSeconds < paceLeftTotSeconds ) {
-    // Current pace is faster then what is needed
-    lv_obj_set_style_bg_color(selectedUser, lv_palette_main(LV_PALETTE_GREEN), 0);
+  if (stats.goalAhead >= 0 || paceNowTotSeconds < paceLeftTotSeconds ) {
+    // Ahead of plan or current pace is faster then what is needed
+    gfxSetBgColor(selectedUser, lv_palette_main(LV_PALETTE_GREEN));
   }
   else {
-    // Current pace is slower then what is needed
-    lv_obj_set_style_bg_color(selectedUser, lv_palette_main(LV_PALETTE_RED), 0);
+    // Behind plan and current pace is slower then what is needed
+    gfxSetBgColor(selectedUser, lv_palette_main(LV_PALETTE_RED));
   }
 
-  //ESP_LOGI(TAG,"gfxUpdateParticipantData() MATCH-------------firstHalf:%" PRId32 "  msg.lastLapTime:%" PRId32 " < (guiRace.getMaxTime()*60*60/2) %" PRId32 "" ,firstHalf, msg.lastLapTime, (guiRace.getMaxTime()*60*60/2));
-  ESP_LOGI(TAG,"gfxUpdateParticipantData() MATCH-------------lap:%3" PRId32 " -- %4.3f km -- Pace [%" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 "] firstHalf:%d lapDist:%" PRId32 " guiParticipants[handleGFX].laps: %" PRId32 "" ,guiParticipants[handleGFX].laps , dist/1000.0,paceFromStartMin,paceFromStartSec,paceNowMin, paceNowSec, paceLeftMin,paceLeftSec,firstHalf,lapDist,guiParticipants[handleGFX].laps);
-  lv_label_set_text_fmt(labelCurrentUserName,  "lap:%3" PRId32 " -- %4.3f km -- Pace [%" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 "]" ,guiParticipants[handleGFX].laps , dist/1000.0,paceFromStartMin,paceFromStartSec,paceNowMin, paceNowSec, paceLeftMin,paceLeftSec);
+  ESP_LOGI(TAG,"UpdateCurrentUserInfo() lap:%3" PRId32 " -- %4.3f km -- Pace [%" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 "] goal:%" PRIu32 " ahead:%" PRId32 " lapDist:%" PRId32 "" ,guiParticipants[handleGFX].laps , dist/1000.0,paceFromStartMin,paceFromStartSec,paceNowMin, paceNowSec, paceLeftMin,paceLeftSec,stats.goal,stats.goalAhead,lapDist);
+  gfxSetLabelTextFmt(labelCurrentUserName,  "lap:%3" PRId32 " -- %4.3f km -- Pace [%" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 ", %" PRId32 ":%02" PRId32 "] %+.1f km -> %4.1f km" ,guiParticipants[handleGFX].laps , dist/1000.0,paceFromStartMin,paceFromStartSec,paceNowMin, paceNowSec, paceLeftMin,paceLeftSec, stats.goalAhead/1000.0, stats.projectedDistance/1000.0);
 }
 
 
-uint32_t guiRace::getMaxGraphLaps()
+// Chart x range in s
+uint32_t guiRace::getGraphTimeRange()
 {
-  return 300;
-/*  if (!isTimeBasedRace()) {
-    return getLaps();
-  }
-  else {
-    return 300; //TODO use 999, 300 should be enough for VXO24h for now so lets keep it safe and test more before going bananas
+  time_t maxTime = getMaxTime();
+  if (!isTimeBasedRace()) {
+    maxTime +=1; // add some space for slow runners to still be visiable
   }
-*/
+  return maxTime*60*60;
 }
 
 void guiRace::updateGUITabRaceGraph()
@@ -1000,21 +1361,26 @@ void guiRace::updateGUITabRaceGraph()
     ESP_LOGE(TAG,"createGUITabRaceGraph() called before all data is valid, do nothing");
     return;
   }
+  if (chartLaps == nullptr) {
+    return; // Graph tab not created, updated when it is
+  }
 
   bool timeBasedRace = isTimeBasedRace();
   time_t maxTime = getMaxTime();
-  uint32_t laps = getMaxGraphLaps();
+  uint32_t laps = getLaps();
   uint32_t raceDist = getDistance();
 
   if (!timeBasedRace) {
     maxTime +=1; // add some space for slow runners to still be visiable
   }
   else {
-    raceDist = 1.2 * getCurrentUserPersonalGoal();
+    uint32_t goal = getCurrentUserPersonalGoal();
+    raceDist = 1.2 * (goal > 0 ? goal : DEFAULT_PARTICIPANT_GOAL);
   }
 
   if (!timeBasedRace) {
-    lv_chart_set_div_line_count(chartLaps, laps+1, maxTime+1);  //reversed order Y-Horizontal first
+    graphHDiv = laps+1; //reversed order Y-Horizontal first
+    graphVDiv = maxTime+1;
     lv_chart_set_axis_tick(chartLaps, LV_CHART_AXIS_PRIMARY_X, 20, 10, maxTime+1, 4, true, 50);
     lv_chart_set_axis_tick(chartLaps, LV_CHART_AXIS_PRIMARY_Y, 5, 3, laps+1, 1, true, 50);
     lv_chart_set_range(chartLaps, LV_CHART_AXIS_PRIMARY_X, 0, maxTime*60*60);
@@ -1023,130 +1389,307 @@ void guiRace::updateGUITabRaceGraph()
     ESP_LOGI(TAG,"createGUITabRaceGraph() x:[0,%lld] y:[0,%" PRId32 "]",maxTime*60*60,raceDist);
   }
   else {
-    lv_chart_set_div_line_count(chartLaps, maxTime+1, maxTime+1); //reversed order Y-Horizontal first
+    graphHDiv = maxTime+1; //reversed order Y-Horizontal first
+    graphVDiv = maxTime+1;
     lv_chart_set_axis_tick(chartLaps, LV_CHART_AXIS_PRIMARY_X, 20, 10, (maxTime/2)+1, 2, false, 25);
     lv_chart_set_axis_tick(chartLaps, LV_CHART_AXIS_SECONDARY_Y, 20, 10, (maxTime/4)+1, 4, true, 150);
     lv_chart_set_range(chartLaps, LV_CHART_AXIS_PRIMARY_X, 0, maxTime*60*60);
     lv_chart_set_range(chartLaps, LV_CHART_AXIS_PRIMARY_Y, 0, raceDist);
     //lv_chart_set_range(chartLaps, LV_CHART_AXIS_SECONDARY_X, 0, raceDist);
     lv_chart_set_range(chartLaps, LV_CHART_AXIS_SECONDARY_Y, 0, raceDist/1000);
-    ESP_LOGI(TAG,"createGUITabRaceGraph() x:[0,%lld] y:[0,%" PRId32 "] maxLaps:%" PRId32 "",maxTime*60*60,raceDist,laps);
+    ESP_LOGI(TAG,"createGUITabRaceGraph() x:[0,%lld] y:[0,%" PRId32 "]",maxTime*60*60,raceDist);
   }
 
-  if (!timeBasedRace) {
-    // Save 2 points per lap, "Arrive" and "Leave", with long few laps you take a short refill break
-    lv_chart_set_point_count(chartLaps, 5*(laps*2)+2); //add 2 to avoid crashes if we add one extra value
-  }
-  else {
-    // Save 1 point per lap, "Arrive" with sort laps you usually just pass by this make it use a lot less data in the graph
-    lv_chart_set_point_count(chartLaps, 5*laps+2); //add 2 to avoid crashes if we add one extra value
+  graphDistRange = raceDist > 0 ? raceDist : 1;
+
+  // Fixed number of points independent of race length, see lapGraphSeries
+  lv_chart_set_point_count(chartLaps, GRAPH_CHART_POINTS);
+  uint32_t timeRange = getGraphTimeRange();
+  for(uint32_t handleGFX = 0; handleGFX < ITAG_COUNT; handleGFX++) {
+    guiParticipants[handleGFX].lapSeries.setTimeRange(timeRange);
   }
   updateGUITabRaceGraphGoalLines();
 }
 
 void guiRace::updateGUITabRaceGraphGoalLines()
 {
-#if 1
-  // Add goals TODO make dynamic or configuare per user
-  if (seriesGraphGoal!=nullptr) {
-    lv_chart_remove_series(chartLaps, seriesGraphGoal);
-    seriesGraphGoal=nullptr;
+  // Goal lines are part of the static layer
+  updateGUITabRaceGraphStaticLayer();
+}
+
+void guiRace::updateGUITabRaceGraphStaticLayer()
+{
+  if (chartLaps == nullptr || !isDataValid()) {
+    return;
   }
-  if (seriesGraphGoalFaster!=nullptr) {
-    lv_chart_remove_series(chartLaps, seriesGraphGoalFaster);
-    seriesGraphGoalFaster=nullptr;
+  lv_obj_update_layout(chartLaps);
+  lv_coord_t w = lv_obj_get_width(chartLaps);
+  lv_coord_t h = lv_obj_get_height(chartLaps);
+  if (w <= 0 || h <= 0) {
+    return;
   }
-  if (seriesGraphGoalSlower!=nullptr) {
-    lv_chart_remove_series(chartLaps, seriesGraphGoalSlower);
-    seriesGraphGoalSlower=nullptr;
+
+  if (staticLayerBuf == nullptr || w != staticLayerW || h != staticLayerH) {
+    if (staticLayerBuf != nullptr) {
+      heap_caps_free(staticLayerBuf);
+    }
+    size_t bufferSize = LV_CANVAS_BUF_SIZE_TRUE_COLOR_ALPHA(w, h);
+    staticLayerBuf = (uint8_t *)heap_caps_malloc(bufferSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (staticLayerBuf == nullptr) {
+      // Let the chart draw the grid itself, goal lines are lost
+      ESP_LOGE(TAG,"updateGUITabRaceGraphStaticLayer() allocate %d bytes failed, using chart grid", bufferSize);
+      staticLayerW = 0;
+      staticLayerH = 0;
+      lv_obj_set_style_bg_img_src(chartLaps, nullptr, 0);
+      lv_chart_set_div_line_count(chartLaps, graphHDiv, graphVDiv);
+      return;
+    }
+    if (staticLayer == nullptr) {
+      staticLayer = lv_canvas_create(tabGraph);
+      lv_obj_add_flag(staticLayer, LV_OBJ_FLAG_HIDDEN);
+    }
+    lv_canvas_set_buffer(staticLayer, staticLayerBuf, w, h, LV_IMG_CF_TRUE_COLOR_ALPHA);
+    staticLayerW = w;
+    staticLayerH = h;
+    ESP_LOGI(TAG,"updateGUITabRaceGraphStaticLayer() %dx%d %d bytes in PSRAM", w, h, bufferSize);
+  }
+  lv_chart_set_div_line_count(chartLaps, 0, 0);
+  lv_canvas_fill_bg(staticLayer, lv_color_black(), LV_OPA_TRANSP);
+
+  // Same positions as lv_chart use for the data and its own grid, relative chart coords
+  lv_coord_t border = lv_obj_get_style_border_width(chartLaps, LV_PART_MAIN);
+  lv_coord_t xOfs = lv_obj_get_style_pad_left(chartLaps, LV_PART_MAIN) + border;
+  lv_coord_t yOfs = lv_obj_get_style_pad_top(chartLaps, LV_PART_MAIN) + border;
+  lv_coord_t contentW = lv_obj_get_content_width(chartLaps);
+  lv_coord_t contentH = lv_obj_get_content_height(chartLaps);
+
+  lv_draw_line_dsc_t lineDsc;
+  lv_draw_line_dsc_init(&lineDsc);
+  lineDsc.color = lv_obj_get_style_line_color(chartLaps, LV_PART_MAIN);
+  lineDsc.width = lv_obj_get_style_line_width(chartLaps, LV_PART_MAIN);
+  lineDsc.opa = lv_obj_get_style_line_opa(chartLaps, LV_PART_MAIN);
+  for (uint32_t i = 0; graphHDiv > 1 && i < graphHDiv; i++) {
+    lv_coord_t y = yOfs + (contentH * i) / (graphHDiv - 1);
+    lv_point_t line[2] = {{0, y}, {static_cast<lv_coord_t>(w - 1), y}};
+    lv_canvas_draw_line(staticLayer, line, 2, &lineDsc);
+  }
+  for (uint32_t i = 0; graphVDiv > 1 && i < graphVDiv; i++) {
+    lv_coord_t x = xOfs + (contentW * i) / (graphVDiv - 1);
+    lv_point_t line[2] = {{x, 0}, {x, static_cast<lv_coord_t>(h - 1)}};
+    lv_canvas_draw_line(staticLayer, line, 2, &lineDsc);
+  }
+
+  // Goal plan of the shown participant, see GOAL_HALFTIME_SHARE
+  uint32_t goal = getCurrentUserPersonalGoal();
+  if (goal > 0) {
+    int64_t timeRange = getGraphTimeRange();
+    int64_t endTime = getMaxTime()*60*60;
+    const double bands[] = {1.0, GOAL_BAND_FASTER, GOAL_BAND_SLOWER};
+    lineDsc.color = lv_color_hex(0xdddddd);
+    lineDsc.width = lv_obj_get_style_line_width(chartLaps, LV_PART_ITEMS);
+    lineDsc.opa = LV_OPA_COVER;
+    for (double band : bands) {
+      int64_t times[3] = {0, endTime/2, endTime};
+      double dists[3] = {0.0, band * GOAL_HALFTIME_SHARE * goal, band * goal};
+      lv_point_t line[3];
+      for (int i = 0; i < 3; i++) {
+        line[i].x = xOfs + (contentW * times[i]) / timeRange;
+        line[i].y = yOfs + contentH - static_cast<lv_coord_t>(contentH * dists[i] / graphDistRange);
+      }
+      lv_canvas_draw_line(staticLayer, line, 3, &lineDsc);
+    }
   }
 
-  seriesGraphGoal = lv_chart_add_series(chartLaps, lv_color_hex(0xdddddd), LV_CHART_AXIS_PRIMARY_Y);
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoal, 0, 0);
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoal, 12*60*60, 0.60 * getCurrentUserPersonalGoal());
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoal, 24*60*60, getCurrentUserPersonalGoal());
+  lv_obj_set_style_bg_img_src(chartLaps, lv_canvas_get_img(staticLayer), 0);
+  lv_obj_invalidate(chartLaps);
+}
 
-  seriesGraphGoalFaster = lv_chart_add_series(chartLaps, lv_color_hex(0xdddddd), LV_CHART_AXIS_PRIMARY_Y);
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoalFaster, 0, 0);
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoalFaster, 12*60*60, 1.1 * 0.60 * getCurrentUserPersonalGoal());
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoalFaster, 24*60*60, 1.1 * getCurrentUserPersonalGoal());
+static void chartLaps_event_cb(lv_event_t * e)
+{
+  if (lv_event_get_code(e) == LV_EVENT_SIZE_CHANGED) {
+    guiRace.updateGUITabRaceGraphStaticLayer();
+  }
+}
 
-  seriesGraphGoalSlower = lv_chart_add_series(chartLaps, lv_color_hex(0xdddddd), LV_CHART_AXIS_PRIMARY_Y);
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoalSlower, 0, 0);
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoalSlower, 12*60*60, 0.95 * 0.60 *getCurrentUserPersonalGoal());
-  lv_chart_set_next_value2(chartLaps, seriesGraphGoalSlower, 24*60*60, 0.95 * getCurrentUserPersonalGoal());
-#endif
+// Area of chartLaps that needs to be redrawn, collected from all series changes and
+// flushed once per GUI tick by gfxChartFlushDirty() so only changed segments are redrawn.
+static lv_area_t chartDirtyArea;
+static bool chartDirty = false;
+#define CHART_DIRTY_MARGIN 4 // px around a point, covers line width and point size
 
+// Mark point and the line segments to its neighbours
+static void gfxChartMarkDirty(lv_chart_series_t * series, uint32_t slot)
+{
+  if (chartLaps == nullptr || series == nullptr) {
+    return;
+  }
+  uint32_t pointCount = lv_chart_get_point_count(chartLaps);
+  lv_area_t chartCoords;
+  lv_obj_get_coords(chartLaps, &chartCoords);
+  for (uint32_t id = (slot > 0 ? slot - 1 : 0); id <= slot + 1 && id < pointCount; id++) {
+    if (series->x_points[id] == LV_CHART_POINT_NONE || series->y_points[id] == LV_CHART_POINT_NONE) {
+      continue;
+    }
+    lv_point_t pos;
+    lv_chart_get_point_pos_by_id(chartLaps, series, id, &pos);
+    lv_coord_t x = chartCoords.x1 + pos.x;
+    lv_coord_t y = chartCoords.y1 + pos.y;
+    if (!chartDirty) {
+      lv_area_set(&chartDirtyArea, x, y, x, y);
+      chartDirty = true;
+    }
+    chartDirtyArea.x1 = std::min(chartDirtyArea.x1, static_cast<lv_coord_t>(x - CHART_DIRTY_MARGIN));
+    chartDirtyArea.y1 = std::min(chartDirtyArea.y1, static_cast<lv_coord_t>(y - CHART_DIRTY_MARGIN));
+    chartDirtyArea.x2 = std::max(chartDirtyArea.x2, static_cast<lv_coord_t>(x + CHART_DIRTY_MARGIN));
+    chartDirtyArea.y2 = std::max(chartDirtyArea.y2, static_cast<lv_coord_t>(y + CHART_DIRTY_MARGIN));
+  }
 }
 
+static void gfxChartFlushDirty()
+{
+  if (!chartDirty) {
+    return;
+  }
+  if (chartLaps == nullptr) {
+    chartDirty = false; // Graph was released
+    return;
+  }
+  lv_obj_invalidate_area(chartLaps, &chartDirtyArea);
+  chartDirty = false;
+}
 
-// Update Graphs 
-// TODO handle subtraction of lap
+void lapGraphSeries::setTimeRange(uint32_t seconds)
+{
+  if (seconds == 0) seconds = 1; //division protection
+  if (seconds != timeRange) {
+    timeRange = seconds;
+  }
+  rebuildFrom(0); // Chart point count might also have changed
+}
 
-static void gfxUpdateParticipantChartNewLap(uint32_t handleGFX, uint32_t lap, time_t time, uint32_t dist)
+void lapGraphSeries::setPoint(uint32_t index, lv_coord_t time, lv_coord_t dist)
 {
-  if(lap > guiRace.getMaxGraphLaps()) {
-    ESP_LOGI(TAG,"gfxUpdateParticipantChartNewLap(handleGFX:%" PRId32 ", lap:%" PRId32 ",...) ERROR above maxLaps:%" PRId32 " DO NOTHING",handleGFX,lap,guiRace.getMaxGraphLaps());
+  graphPoint point = {time, dist};
+  if (index < points.size()) {
+    points[index] = point;
+    rebuildFrom(index);
     return;
   }
-  if (!guiRace.isTimeBasedRace()) {
-    ESP_LOGI(TAG,"gfxUpdateParticipantChartNewLap(handleGFX:%" PRId32 ", lap:%" PRId32 ", time:%lld, dist: %" PRId32 ")",handleGFX,lap,time,dist);
-    
-    if((2*lap+1) > lv_chart_get_point_count(chartLaps)) {
-      ESP_LOGE(TAG,"gfxUpdateParticipantChartNewLap(handleGFX:%" PRId32 ", lap:%" PRId32 ",...) ERROR (2*lap+1) is above lv_chart_get_point_count():%d DO NOTHING",handleGFX,lap,lv_chart_get_point_count(chartLaps));
-      return;
-    }
+  // Append, fill any gap with the new point
+  uint32_t first = points.size();
+  points.resize(index + 1, point);
+  for (uint32_t i = first; i <= index; i++) {
+    addToBuckets(i);
+  }
+}
 
-    guiParticipants[handleGFX].seriesLaps->x_points[2*lap] = time;
-    guiParticipants[handleGFX].seriesLaps->y_points[2*lap] = dist;
-    guiParticipants[handleGFX].seriesLaps->x_points[2*lap+1] = time;
-    guiParticipants[handleGFX].seriesLaps->y_points[2*lap+1] = dist;
+void lapGraphSeries::truncate(uint32_t count)
+{
+  if (count >= points.size()) {
+    return;
   }
-  else {
-    //time=time/100;
-    //dist=dist/100;
-    ESP_LOGI(TAG,"gfxUpdateParticipantChartNewLap(handleGFX:%" PRId32 ", lap:%" PRId32 ", time:%lld, dist: %" PRId32 ") (timebased only save arrive)",handleGFX,lap,time,dist);
+  points.resize(count);
+  rebuildFrom(count);
+}
 
-    if(lap > lv_chart_get_point_count(chartLaps)) {
-      ESP_LOGE(TAG,"gfxUpdateParticipantChartNewLap(handleGFX:%" PRId32 ", lap:%" PRId32 ",...) ERROR lap is above lv_chart_get_point_count():%d DO NOTHING",handleGFX,lap,lv_chart_get_point_count(chartLaps));
-      return;
-    }
+uint32_t lapGraphSeries::bucketOf(lv_coord_t time)
+{
+  if (time <= 0) {
+    return 0;
+  }
+  uint64_t bucket = static_cast<uint64_t>(time) * GRAPH_TIME_BUCKETS / timeRange;
+  return std::min(bucket, static_cast<uint64_t>(GRAPH_TIME_BUCKETS - 1)); // Late points end up in the last bucket
+}
 
-    guiParticipants[handleGFX].seriesLaps->x_points[lap] = time;
-    guiParticipants[handleGFX].seriesLaps->y_points[lap] = dist;
+void lapGraphSeries::addToBuckets(uint32_t index)
+{
+  uint32_t bucket = bucketOf(points[index].time);
+  if (!buckets.empty() && bucket <= buckets.back().bucket) {
+    // Same bucket (or a point a bit back in time) extend it
+    buckets.back().last = index;
+    writeSlot(2*(buckets.size()-1) + 1, index);
+    return;
   }
-  lv_chart_refresh(chartLaps); //Required after direct set
+  buckets.push_back({bucket, index, index});
+  writeSlot(2*(buckets.size()-1), index);
+  writeSlot(2*(buckets.size()-1) + 1, index);
 }
 
-static void gfxUpdateParticipantChartLastSeen(uint32_t handleGFX, uint32_t lap, time_t time, uint32_t dist)
+// Redo all buckets from the one containing point index (normally the last one or two)
+void lapGraphSeries::rebuildFrom(uint32_t index)
+{
+  uint32_t keep = buckets.size();
+  while (keep > 0 && buckets[keep-1].last >= index) {
+    keep--;
+  }
+  uint32_t start = (keep < buckets.size()) ? buckets[keep].first : points.size();
+  if (index == 0) {
+    keep = 0;
+    start = 0;
+  }
+  for (uint32_t slot = 2*keep; slot < 2*buckets.size(); slot++) {
+    clearSlot(slot);
+  }
+  buckets.resize(keep);
+  for (uint32_t i = start; i < points.size(); i++) {
+    addToBuckets(i);
+  }
+}
+
+void lapGraphSeries::writeSlot(uint32_t slot, uint32_t index)
 {
-  if(lap > guiRace.getMaxGraphLaps()) {
-    ESP_LOGI(TAG,"gfxUpdateParticipantChartLastSeen(handleGFX:%" PRId32 ", lap:%" PRId32 ",...) ERROR above maxLaps:%" PRId32 " DO NOTHING",handleGFX,lap,guiRace.getMaxGraphLaps());
+  if (series == nullptr || chartLaps == nullptr || slot >= lv_chart_get_point_count(chartLaps)) {
     return;
   }
-  if (!guiRace.isTimeBasedRace()) {
-    ESP_LOGI(TAG,"gfxUpdateParticipantChartLastSeen(handleGFX:%" PRId32 ", lap:%" PRId32 ", time:%lld, dist: %" PRId32 ")",handleGFX,lap,time,dist);
-    if((2*lap+1) > lv_chart_get_point_count(chartLaps)) {
-      ESP_LOGE(TAG,"gfxUpdateParticipantChartLastSeen(handleGFX:%" PRId32 ", lap:%" PRId32 ",...) ERROR (2*lap+1) is above lv_chart_get_point_count():%d DO NOTHING",handleGFX,lap,lv_chart_get_point_count(chartLaps));
-      return;
-    }
-    guiParticipants[handleGFX].seriesLaps->x_points[2*lap+1] = time;
-    guiParticipants[handleGFX].seriesLaps->y_points[2*lap+1] = dist;
-    lv_chart_refresh(chartLaps); //Required after direct set
+  // Direct set, so we invalidate the old and new segments our self instead of lv_chart_refresh()
+  gfxChartMarkDirty(series, slot);
+  series->x_points[slot] = points[index].time;
+  series->y_points[slot] = points[index].dist;
+  gfxChartMarkDirty(series, slot);
+}
+
+void lapGraphSeries::clearSlot(uint32_t slot)
+{
+  if (series == nullptr || chartLaps == nullptr || slot >= lv_chart_get_point_count(chartLaps)) {
+    return;
   }
-  else {
-    //time=time/100;
-    //dist=dist/100;
-    ESP_LOGI(TAG,"gfxUpdateParticipantChartLastSeen(handleGFX:%" PRId32 ", lap:%" PRId32 ", time:%lld, dist: %" PRId32 ") (timebased do nothing)",handleGFX,lap,time,dist);
-    if(lap > lv_chart_get_point_count(chartLaps)) {
-      ESP_LOGE(TAG,"gfxUpdateParticipantChartLastSeen(handleGFX:%" PRId32 ", lap:%" PRId32 ",...) ERROR lap is above lv_chart_get_point_count():%d DO NOTHING",handleGFX,lap,lv_chart_get_point_count(chartLaps));
-      return;
-    }
-    //TODO or do nothing here ????
-    //guiParticipants[handleGFX].seriesLaps->x_points[lap] = time;
-    //guiParticipants[handleGFX].seriesLaps->y_points[lap] = dist;
-    //lv_chart_refresh(chartLaps); //Required after direct set
+  gfxChartMarkDirty(series, slot);
+  series->x_points[slot] = LV_CHART_POINT_NONE;
+  series->y_points[slot] = LV_CHART_POINT_NONE;
+}
+
+// Update Graphs, in distance races each lap has 2 points "Arrive" and "Leave" as with long
+// few laps you take a short refill break, in time based races only "Arrive" as you usually
+// just pass by.
+static uint32_t gfxChartPointsPerLap()
+{
+  return guiRace.isTimeBasedRace() ? 1 : 2;
+}
+
+static void gfxUpdateParticipantChartNewLap(uint32_t handleGFX, uint32_t lap, time_t time, uint32_t dist)
+{
+  lapGraphSeries &lapSeries = guiParticipants[handleGFX].lapSeries;
+  uint32_t perLap = gfxChartPointsPerLap();
+  //ESP_LOGI(TAG,"gfxUpdateParticipantChartNewLap(handleGFX:%" PRId32 ", lap:%" PRId32 ", time:%lld, dist: %" PRId32 ")",handleGFX,lap,time,dist);
+
+  // A new or moved lap is always the last one
+  lapSeries.truncate(perLap*lap);
+  for (uint32_t i = 0; i < perLap; i++) {
+    lapSeries.setPoint(perLap*lap + i, time, dist);
+  }
+}
+
+static void gfxUpdateParticipantChartLastSeen(uint32_t handleGFX, uint32_t lap, time_t time, uint32_t dist)
+{
+  if (guiRace.isTimeBasedRace()) {
+    return; // Only "Arrive" is saved
+  }
+  lapGraphSeries &lapSeries = guiParticipants[handleGFX].lapSeries;
+  if (lapSeries.size() < 2*lap+1) {
+    ESP_LOGW(TAG,"gfxUpdateParticipantChartLastSeen(handleGFX:%" PRId32 ", lap:%" PRId32 ",...) lap not in graph yet DO NOTHING",handleGFX,lap);
+    return;
   }
+  lapSeries.setPoint(2*lap+1, time, dist);
 }
 
 /*
@@ -1170,9 +1713,7 @@ static void gfxClearAllParticipantData()
   for(uint32_t handleGFX = 0; handleGFX < ITAG_COUNT; handleGFX++)
   {
     guiParticipants[handleGFX].laps = 0;
-    if(guiParticipants[handleGFX].seriesLaps) {
-      lv_chart_set_all_value(chartLaps, guiParticipants[handleGFX].seriesLaps, LV_CHART_POINT_NONE);
-    }
+    guiParticipants[handleGFX].lapSeries.clear();
     //Keep this ??  lv_chart_set_all_value(chartRSSI, guiParticipants[handleGFX].seriesRSSI, LV_CHART_POINT_NONE)
   }
 }
@@ -1180,43 +1721,13 @@ static void gfxClearAllParticipantData()
 static void gfxClearParticipantData(uint32_t handleGFX, uint32_t fromLap)
 {
   ESP_LOGI(TAG,"gfxClearParticipantData(handleGFX:%" PRId32 ",fromLap:%" PRId32 ")",handleGFX,fromLap);
-
-  uint32_t maxLaps = guiRace.getMaxGraphLaps();
-  if (fromLap > maxLaps) {
-    ESP_LOGI(TAG,"gfxClearParticipantData(handleGFX:%" PRId32 ",fromLap:%" PRId32 ") ERROR above maxLaps:%" PRId32 " DO NOTHING",handleGFX,fromLap,maxLaps);
-    return;
-  }
-  for(uint32_t lap = fromLap; lap <= maxLaps; lap++)
-  {
-    if (!guiRace.isTimeBasedRace()) {
-      if((2*lap+1) > lv_chart_get_point_count(chartLaps)) {
-        ESP_LOGE(TAG,"gfxClearParticipantData(handleGFX:%" PRId32 ", fromLap:%" PRId32 ",...) ERROR (2*lap+1) is above lv_chart_get_point_count():%d DO NOTHING",handleGFX,fromLap,lv_chart_get_point_count(chartLaps));
-        return;
-      }
-      guiParticipants[handleGFX].seriesLaps->x_points[2*lap] = LV_CHART_POINT_NONE;
-      guiParticipants[handleGFX].seriesLaps->y_points[2*lap] = LV_CHART_POINT_NONE;
-      guiParticipants[handleGFX].seriesLaps->x_points[2*lap+1] = LV_CHART_POINT_NONE;
-      guiParticipants[handleGFX].seriesLaps->y_points[2*lap+1] = LV_CHART_POINT_NONE;
-    }
-    else {
-      if(lap > lv_chart_get_point_count(chartLaps)) {
-        ESP_LOGE(TAG,"gfxClearParticipantData(handleGFX:%" PRId32 ", fromLap:%" PRId32 ",...) ERROR lap is above lv_chart_get_point_count():%d DO NOTHING",handleGFX,fromLap,lv_chart_get_point_count(chartLaps));
-        return;
-      }
-      guiParticipants[handleGFX].seriesLaps->x_points[lap] = LV_CHART_POINT_NONE;
-      guiParticipants[handleGFX].seriesLaps->y_points[lap] = LV_CHART_POINT_NONE;
-    }
-  }
-  ESP_LOGI(TAG,"gfxClearParticipantData(handleGFX:%" PRId32 ",fromLap:%" PRId32 ") lv_chart_refresh()",handleGFX,fromLap);
-  lv_chart_refresh(chartLaps); //Required after direct set
-  ESP_LOGI(TAG,"gfxClearParticipantData(handleGFX:%" PRId32 ",fromLap:%" PRId32 ") Done",handleGFX,fromLap);
+  guiParticipants[handleGFX].lapSeries.truncate(gfxChartPointsPerLap()*fromLap);
 }
 
 // Update Race info (Laps/Dist)
 static void gfxUpdateParticipantData(msg_UpdateParticipantData msg)
 {
   uint32_t handleGFX = msg.handleGFX;
-  bool newLap=false;
 
     gfxUpdateInRace(msg.inRace, handleGFX);
 
@@ -1224,73 +1735,49 @@ static void gfxUpdateParticipantData(msg_UpdateParticipantData msg)
 
     if (msg.laps > guiParticipants[handleGFX].laps) {
       // new lap
-      newLap=true;
-      gfxUpdateParticipantChartNewLap(handleGFX, msg.laps, msg.lastLapTime, msg.distance);
+      gfxUpdateParticipantChartNewLap(handleGFX, msg.laps, msg.lastLapTimeMs / 1000, msg.distance);
     }
     else if (msg.laps < guiParticipants[handleGFX].laps) {
       // lap deleted
-      gfxClearParticipantData(handleGFX, msg.laps); 
+      gfxClearParticipantData(handleGFX, msg.laps+1);
     }
-    else if ( msg.lastLapTime != guiParticipants[handleGFX].thisLapStart) {
+    else if ( msg.lastLapTimeMs != guiParticipants[handleGFX].thisLapStart) {
       // lap updated
-      gfxUpdateParticipantChartNewLap(handleGFX, msg.laps, msg.lastLapTime, msg.distance);
+      gfxUpdateParticipantChartNewLap(handleGFX, msg.laps, msg.lastLapTimeMs / 1000, msg.distance);
     }
     
     guiParticipants[handleGFX].laps = msg.laps;
-    guiParticipants[handleGFX].thisLapStart = msg.lastLapTime;
-
-    lv_label_set_text_fmt(guiParticipants[handleGFX].labelDist, "%4.3fkm",msg.distance/1000.0); //ZINGO?? 
-    if (guiParticipants[handleGFX].inRace) {
-      lv_label_set_text_fmt(guiParticipants[handleGFX].labelRaceDist, "%4.3fkm",msg.distance/1000.0);
-    }
+    guiParticipants[handleGFX].thisLapStart = msg.lastLapTimeMs;
+    guiParticipants[handleGFX].distance = msg.distance;
+    guiParticipants[handleGFX].connectionStatus = msg.connectionStatus;
 
-    if (!guiRace.isTimeBasedRace()) {
-      lv_label_set_text_fmt(guiParticipants[handleGFX].labelLaps, "(%2" PRId32 "/%2" PRId32 ")",msg.laps,guiRace.getLaps());
-      if ( guiParticipants[handleGFX].inRace) {
-        lv_label_set_text_fmt(guiParticipants[handleGFX].labelRaceLaps, "(%2" PRId32 "/%2" PRId32 ")",msg.laps,guiRace.getLaps());
-      }
-    }
-    else {
-      lv_label_set_text_fmt(guiParticipants[handleGFX].labelLaps, "(%2" PRId32 ")",msg.laps);
-      if (guiParticipants[handleGFX].inRace) {
-        lv_label_set_text_fmt(guiParticipants[handleGFX].labelRaceLaps, "(%2" PRId32 ")",msg.laps);
-      }
-    }
-    struct tm timeinfo;
-    time_t tt = msg.lastLapTime;
-    localtime_r(&tt, &timeinfo);
-    lv_label_set_text_fmt(guiParticipants[handleGFX].labelTime, "%3d:%02d:%02d", (timeinfo.tm_mday-1)*24+timeinfo.tm_hour,timeinfo.tm_min,timeinfo.tm_sec);
-    if (guiParticipants[handleGFX].inRace) {
-      lv_label_set_text_fmt(guiParticipants[handleGFX].labelRaceTime, "%3d:%02d:%02d", (timeinfo.tm_mday-1)*24+timeinfo.tm_hour,timeinfo.tm_min,timeinfo.tm_sec);
-    }
-
-    std::string conn;
-    if (msg.connectionStatus == 1)
-    {
-      conn = std::string(LV_SYMBOL_EYE_CLOSE);
-    }
-    else if (msg.connectionStatus == 0)
-    {
-      conn = std::string("");
-    } else {
+    if (msg.connectionStatus < 0) {
       // if msg.connectionStatus < 0 (as it should) it is the RSSI value of the tag
-      gfxUpdateParticipantChartLastSeen(handleGFX, msg.laps, msg.lastSeenTime, msg.distance);
-      conn = std::string(LV_SYMBOL_EYE_OPEN);
+      gfxUpdateParticipantChartLastSeen(handleGFX, msg.laps, msg.lastSeenTimeMs / 1000, msg.distance);
       // TODO plot RSSI??
     }
 
-    lv_label_set_text(guiParticipants[handleGFX].labelConnectionStatus, conn.c_str());
-    if (guiParticipants[handleGFX].inRace) {
-      lv_label_set_text(guiParticipants[handleGFX].labelRaceConnectionStatus, conn.c_str());
-    }
+    gfxRefreshParticipant(handleGFX);
     //gfxUpdateParticipantChartRSSI(handleGFX,msg.connectionStatus);
+    // Selected user info is updated when the lap statistics arrive, see gfxUpdateParticipantLapStats()
+}
 
-    // If this is selected User update that field in the graph
-#if 1
-    if (newLap && raceOngoing && guiRace.getCurrentUserHandleGFX() == handleGFX) {
+static void gfxUpdateParticipantLapStats(msg_UpdateParticipantLapStats &msg)
+{
+  uint32_t handleGFX = msg.handleGFX;
+  bool goalChanged = guiParticipants[handleGFX].lapStats.goal != msg.goal;
+  guiParticipants[handleGFX].lapStats = msg;
+  guiParticipantsList.refresh(handleGFX);
+
+  // If this is selected User update that field in the graph
+  if (guiRace.getCurrentUserHandleGFX() == handleGFX) {
+    if (goalChanged) {
+      guiRace.currentUserPersonalGoalChanged();
+    }
+    if (raceOngoing) {
       guiRace.UpdateCurrentUserInfo(handleGFX);
     }
-#endif
+  }
 }
 
 static void gfxUpdateParticipantStatus(msg_UpdateParticipantStatus msg)
@@ -1299,31 +1786,24 @@ static void gfxUpdateParticipantStatus(msg_UpdateParticipantStatus msg)
 
   gfxUpdateInRace(msg.inRace, handleGFX);
 
-  std::string conn;
-  if (msg.connectionStatus == 1)
-  {
-    conn = std::string(LV_SYMBOL_EYE_CLOSE);
-  }
-  else if (msg.connectionStatus == 0)
-  {
-    conn = std::string("");
-  } else {
-    // if msg.connectionStatus < 0 (as it should) it is the RSSI value of the tag
-    conn = std::string(LV_SYMBOL_EYE_OPEN);
-  }
-  
-  lv_label_set_text(guiParticipants[handleGFX].labelConnectionStatus, conn.c_str());
-  if (guiParticipants[handleGFX].inRace) {
-    lv_label_set_text(guiParticipants[handleGFX].labelRaceConnectionStatus, conn.c_str());
-  }
-
+  guiParticipants[handleGFX].connectionStatus = msg.connectionStatus;
   if(msg.battery >= 0 && msg.battery <=100) {
-    lv_label_set_text_fmt(guiParticipants[handleGFX].labelBattery, "%3d%%",msg.battery);
+    guiParticipants[handleGFX].battery = msg.battery;
+    guiParticipants[handleGFX].batteryHoursLeft = msg.batteryHoursLeft;
+    guiParticipants[handleGFX].batteryLow = msg.batteryLow;
   }
+  gfxRefreshParticipant(handleGFX);
 
   //gfxUpdateParticipantChartRSSI(handleGFX,msg.connectionStatus);
 }
 
+// Move the participants row in the race tab, rows in between shift one step so only the
+// participant that changed position is sent from RaceDB
+static void gfxStandingsMove(msg_StandingsMove &msg)
+{
+  guiRaceList.move(msg.handleGFX, msg.position);
+}
+
 // updated same fields as gfxAddParticipant() but without creating a new 
 static void gfxUpdateParticipant(msg_UpdateParticipant &msgParticipant)
 {
@@ -1331,40 +1811,52 @@ static void gfxUpdateParticipant(msg_UpdateParticipant &msgParticipant)
 
   gfxUpdateInRace(msgParticipant.inRace, handleGFX);
 
-  lv_obj_set_style_bg_color(guiParticipants[handleGFX].ledColor1, lv_color_hex(msgParticipant.color1),0);
-  lv_obj_set_style_bg_color(guiParticipants[handleGFX].ledColor0, lv_color_hex(msgParticipant.color0),0);
-  lv_textarea_set_text(guiParticipants[handleGFX].textAreaName, msgParticipant.name);
-  
-  if (guiParticipants[handleGFX].inRace) {
-    lv_obj_set_style_bg_color(guiParticipants[handleGFX].ledRaceColor1, lv_color_hex(msgParticipant.color1),0);
-    lv_obj_set_style_bg_color(guiParticipants[handleGFX].ledRaceColor0, lv_color_hex(msgParticipant.color0),0);
-    lv_label_set_text(guiParticipants[handleGFX].labelRaceName, msgParticipant.name);
-  }
+  guiParticipants[handleGFX].color0 = msgParticipant.color0;
+  guiParticipants[handleGFX].color1 = msgParticipant.color1;
+  strncpy(guiParticipants[handleGFX].name, msgParticipant.name, PARTICIPANT_NAME_LENGTH);
+  guiParticipants[handleGFX].name[PARTICIPANT_NAME_LENGTH] = '\0';
+  gfxRefreshParticipant(handleGFX);
 }
 
 // return used handleGFX or negative value in case of error
-static uint32_t gfxAddParticipant(msg_AddParticipant &msgParticipant)
+static uint32_t gfxAddParticipant(participantRegistration &msgParticipant)
 {
   uint32_t handleGFX = globalHandleGFX;
 
   if(handleGFX >= ITAG_COUNT) {
-    ESP_LOGE(TAG," ERROR to may user added handleGFX:%" PRId32 " >= ITAG_COUNT:%d for msg_AddParticipant MSG:0x%" PRIx32 " handleDB:0x%08" PRIx32 " color:(0x%06" PRIx32 ",0x%06" PRIx32 ") Name:%s inRace:%d  ---> Do nothing",handleGFX, ITAG_COUNT,
-               msgParticipant.header.msgType, msgParticipant.handleDB, msgParticipant.color0, msgParticipant.color1, msgParticipant.name, msgParticipant.inRace);
+    ESP_LOGE(TAG," ERROR to may user added handleGFX:%" PRId32 " >= ITAG_COUNT:%d for handleDB:0x%08" PRIx32 " color:(0x%06" PRIx32 ",0x%06" PRIx32 ") Name:%s inRace:%d  ---> Do nothing",handleGFX, ITAG_COUNT,
+               msgParticipant.handleDB, msgParticipant.color0, msgParticipant.color1, msgParticipant.name, msgParticipant.inRace);
     return UINT32_MAX; // indicates error
   }
 //  else {
-//    ESP_LOGI(TAG," handleGFX:%" PRId32 " < ITAG_COUNT:%d for msg_AddParticipant MSG:0x%" PRIx32 " handleDB:0x%08x color:(0x%06x,0x%06x) Name:%s inRace:%d  ---> Add",handleGFX, ITAG_COUNT,
-//               msgParticipant.header.msgType, msgParticipant.handleDB, msgParticipant.color0, msgParticipant.color1, msgParticipant.name, msgParticipant.inRace);
+//    ESP_LOGI(TAG," handleGFX:%" PRId32 " < ITAG_COUNT:%d for handleDB:0x%08x color:(0x%06x,0x%06x) Name:%s inRace:%d  ---> Add",handleGFX, ITAG_COUNT,
+//               msgParticipant.handleDB, msgParticipant.color0, msgParticipant.color1, msgParticipant.name, msgParticipant.inRace);
 //  }
-  gfxAddUserToParticipants(tabParticipants, msgParticipant, handleGFX);
+  lv_chart_series_t * seriesLaps = nullptr; // Added when the graph tab is created if it's not now
+  if (chartLaps != nullptr) {
+    seriesLaps = lv_chart_add_series(chartLaps, lv_color_hex(msgParticipant.color0), LV_CHART_AXIS_PRIMARY_Y);
+  }
+  //lv_chart_series_t * seriesRSSI = lv_chart_add_series(chartRSSI, lv_color_hex(msgParticipant.color0), LV_CHART_AXIS_PRIMARY_Y);
+
+  guiParticipant &participant = guiParticipants[handleGFX];
+  participant.handleDB = msgParticipant.handleDB;
+  participant.laps = 0;
+  participant.thisLapStart = 0;
+  participant.lapStats = {};
+  participant.color0 = msgParticipant.color0;
+  participant.color1 = msgParticipant.color1;
+  strncpy(participant.name, msgParticipant.name, PARTICIPANT_NAME_LENGTH);
+  participant.name[PARTICIPANT_NAME_LENGTH] = '\0';
+  participant.distance = 0;
+  participant.seriesLaps = seriesLaps;
+  participant.lapSeries.setSeries(seriesLaps);
+  //participant.seriesRSSI = seriesRSSI;
+  participant.inRace = false;
+
+  guiParticipantsList.add(handleGFX);
   gfxUpdateInRace(msgParticipant.inRace, handleGFX);
   gfxUpdateParticipantChartNewLap(handleGFX,0,0,0);
   globalHandleGFX++;
-  if(handleGFX >= ITAG_COUNT) {
-    ESP_LOGI(TAG,"Added all Users handleGFX:%" PRId32 " from MSG:0x%" PRIx32 " handleDB:0x%08" PRIx32 " color:(0x%06" PRIx32 ",0x%06" PRIx32 ") Name:%s inRace:%d --------- COME ON LETS PARTY!!!!!!!!!!!!!!!!!!", handleGFX,
-               msgParticipant.header.msgType, msgParticipant.handleDB, msgParticipant.color0, msgParticipant.color1, msgParticipant.name, msgParticipant.inRace);
-
-  }
 
   // All Ok return used handleGFX
   return handleGFX;
@@ -1372,18 +1864,18 @@ static uint32_t gfxAddParticipant(msg_AddParticipant &msgParticipant)
 
 static void createGUITabRace(lv_obj_t * parent)
 {
-  lv_obj_set_flex_flow(parent, LV_FLEX_FLOW_COLUMN);
   lv_obj_set_style_pad_column(parent,0,0);
   lv_obj_set_style_pad_row(parent,0,0);
   lv_obj_set_style_pad_all(parent, 5,0);
+  guiRaceList.create(parent, true);
 }
 
 static void createGUITabParticipant(lv_obj_t * parent)
 {
-  lv_obj_set_flex_flow(parent, LV_FLEX_FLOW_COLUMN);
   lv_obj_set_style_pad_column(parent, 2,0);
   lv_obj_set_style_pad_row(parent, 2,0);
   lv_obj_set_style_pad_all(parent, 2,0);
+  guiParticipantsList.create(parent, false);
 }
 
 void guiRace::receiveConfigRace(msg_RaceConfig *raceConfig)
@@ -1394,38 +1886,49 @@ void guiRace::receiveConfigRace(msg_RaceConfig *raceConfig)
   //ESP_LOGI(TAG,"Received: MSG_RACE_CONFIG MSG:0x%" PRIx32 " filename:%s name:%s distace:%" PRId32 " laps:%" PRId32 " blockNewLapTime:%" PRId32 " updateCloserTime:%" PRId32 ", raceStartInTime:%" PRId32 "",
   //      raceConfig->header.msgType, raceConfig->fileName, raceConfig->name,raceConfig->distance, raceConfig->laps, 
   //      raceConfig->blockNewLapTime, raceConfig->updateCloserTime, raceConfig->raceStartInTime);
-  std::string fileName = std::string(raceConfig->fileName);
-  std::string name = std::string(raceConfig->name);
-  bool timeBasedRace = raceConfig->timeBasedRace;
-  std::string maxTime = std::to_string(raceConfig->maxTime);
-  std::string distance = std::to_string(raceConfig->distance);
+  configFileName = std::string(raceConfig->fileName);
+  configName = std::string(raceConfig->name);
+  configTimeBased = raceConfig->timeBasedRace;
+  configMaxTime = raceConfig->maxTime;
   laps = raceConfig->laps;
-  time_t blockNewLapTime = raceConfig->blockNewLapTime;
-  std::string updateCloserTime = std::to_string(raceConfig->updateCloserTime);
-  std::string raceStartInTime = std::to_string(raceConfig->raceStartInTime);
+  configBlockNewLapTime = raceConfig->blockNewLapTime;
+  configUpdateCloserTime = raceConfig->updateCloserTime;
+  configRaceStartInTime = raceConfig->raceStartInTime;
 
   if (laps == 0) {
     // Laps can't be 0 assume 1
     laps = 1;
   }
+  setDistance(raceConfig->distance);
+
+  // Genaral info page
+  lv_label_set_text(globalLabelRaceName, configName.c_str());
+
+  updateGUITabConfig();
+  dataValid = true;
+  updateGUITabRaceGraph(); // Update graph to new race dimensions
+  guiRaceList.refreshAll(); // Laps column
+  guiParticipantsList.refreshAll();
+}
+
+// Race config info page, if it is created
+void guiRace::updateGUITabConfig()
+{
+  if (textAreaConfigRaceFileName == nullptr) {
+    return; // Config tab not created yet, it is filled in when created
+  }
   uint32_t lapsDistances;
-  if (timeBasedRace) {
-    lapsDistances = raceConfig->distance;
+  if (configTimeBased) {
+    lapsDistances = distance;
   }
   else {
-    lapsDistances = raceConfig->distance / laps;
+    lapsDistances = distance / laps;
   }
 
-  setDistance(raceConfig->distance);
-
-  // Genaral info page
-  lv_label_set_text(globalLabelRaceName, name.c_str());
-
-  // Race config info page
-  lv_textarea_set_text(textAreaConfigRaceFileName,fileName.c_str());
-  lv_textarea_set_text(textAreaConfigRaceName,name.c_str());
+  lv_textarea_set_text(textAreaConfigRaceFileName,configFileName.c_str());
+  lv_textarea_set_text(textAreaConfigRaceName,configName.c_str());
 
-  if (timeBasedRace) {
+  if (configTimeBased) {
     lv_obj_add_state(textAreaConfigRaceTimebased, LV_STATE_CHECKED);
     lv_textarea_set_text(textAreaConfigRaceLaps,std::to_string(laps).c_str());
     lv_obj_add_state(textAreaConfigRaceLaps, LV_STATE_DISABLED);
@@ -1436,26 +1939,34 @@ void guiRace::receiveConfigRace(msg_RaceConfig *raceConfig)
     lv_obj_clear_state(textAreaConfigRaceLaps, LV_STATE_DISABLED);
   }
 
-  lv_textarea_set_text(textAreaConfigRaceMaxTime,maxTime.c_str());
-  lv_textarea_set_text(textAreaConfigRaceDistance,distance.c_str());
+  lv_textarea_set_text(textAreaConfigRaceMaxTime,std::to_string(configMaxTime).c_str());
+  lv_textarea_set_text(textAreaConfigRaceDistance,std::to_string(distance).c_str());
   lv_label_set_text(textAreaConfigRaceLapsDistances,std::to_string(lapsDistances).c_str());
-  setBlockNewLapTime(blockNewLapTime);
-  lv_textarea_set_text(textAreaConfigRaceUpdateCloserTime,updateCloserTime.c_str());
-  lv_textarea_set_text(textAreaConfigRaceRaceStartIn,raceStartInTime.c_str());
-  dataValid = true;
-  updateGUITabRaceGraph(); // Update graph to new race dimensions
+  lv_textarea_set_text(textAreaConfigRaceBlockNewLapTime,std::to_string(configBlockNewLapTime).c_str());
+  lv_textarea_set_text(textAreaConfigRaceUpdateCloserTime,std::to_string(configUpdateCloserTime).c_str());
+  lv_textarea_set_text(textAreaConfigRaceRaceStartIn,std::to_string(configRaceStartInTime).c_str());
+}
+
+void guiRace::setBlockNewLapTime(time_t newTime)
+{
+  configBlockNewLapTime = newTime;
+  if (textAreaConfigRaceBlockNewLapTime != nullptr) {
+    lv_textarea_set_text(textAreaConfigRaceBlockNewLapTime,std::to_string(newTime).c_str());
+  }
 }
 
 time_t guiRace::getMaxTime()
 {
-  time_t maxTime = std::stoi( std::string(lv_textarea_get_text(textAreaConfigRaceMaxTime)));
-  return maxTime;
+  return configMaxTime;
 }
 
 time_t guiRace::getRaceStartCountdown()
 {
-  time_t thetime = std::stoi( std::string(lv_textarea_get_text(textAreaConfigRaceRaceStartIn)));
-  return thetime;
+  if (textAreaConfigRaceRaceStartIn != nullptr) {
+    // Use what is shown, the user may have edited it without sending the config
+    return std::strtol(lv_textarea_get_text(textAreaConfigRaceRaceStartIn), nullptr, 10);
+  }
+  return configRaceStartInTime; // Config tab not created yet, last received config
 }
 
 void guiRace::sendConfigRace()
@@ -1512,24 +2023,24 @@ static void taConfigText_event_cb(lv_event_t * e)
   //uint32_t handleGFX = reinterpret_cast<uint32_t>(lv_event_get_user_data(e));
   if(code == LV_EVENT_FOCUSED) {
     if(lv_indev_get_type(lv_indev_get_act()) != LV_INDEV_TYPE_KEYPAD) {
-      lv_keyboard_set_mode(keyboard, LV_KEYBOARD_MODE_TEXT_LOWER);
-      lv_keyboard_set_textarea(keyboard, ta);
-      lv_obj_set_style_max_height(keyboard, LV_HOR_RES * 2 / 3, 0);
+      lv_keyboard_set_mode(gfxKeyboard(), LV_KEYBOARD_MODE_TEXT_LOWER);
+      lv_keyboard_set_textarea(gfxKeyboard(), ta);
+      lv_obj_set_style_max_height(gfxKeyboard(), LV_HOR_RES * 2 / 3, 0);
       lv_obj_update_layout(tabView);   /*Be sure the sizes are recalculated*/
-      lv_obj_set_height(tabView, LV_VER_RES - lv_obj_get_height(keyboard));
-      lv_obj_clear_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+      lv_obj_set_height(tabView, LV_VER_RES - lv_obj_get_height(gfxKeyboard()));
+      lv_obj_clear_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
       lv_obj_scroll_to_view_recursive(ta, LV_ANIM_ON);
     }
   }
   else if(code == LV_EVENT_DEFOCUSED) {
-    lv_keyboard_set_textarea(keyboard, NULL);
+    lv_keyboard_set_textarea(gfxKeyboard(), NULL);
     lv_obj_set_height(tabView, LV_VER_RES);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
     lv_indev_reset(NULL, ta);
   }
   else if(code == LV_EVENT_READY || code == LV_EVENT_CANCEL) {
     lv_obj_set_height(tabView, LV_VER_RES);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
     lv_obj_clear_state(ta, LV_STATE_FOCUSED);
     lv_indev_reset(NULL, ta);   /*To forget the last clicked object to make it focusable again*/
   }
@@ -1549,24 +2060,24 @@ static void taConfigNum_event_cb(lv_event_t * e)
   //uint32_t handleGFX = reinterpret_cast<uint32_t>(lv_event_get_user_data(e));
   if(code == LV_EVENT_FOCUSED) {
     if(lv_indev_get_type(lv_indev_get_act()) != LV_INDEV_TYPE_KEYPAD) {
-      lv_keyboard_set_mode(keyboard, LV_KEYBOARD_MODE_NUMBER);
-      lv_keyboard_set_textarea(keyboard, ta);
-      lv_obj_set_style_max_height(keyboard, LV_HOR_RES * 2 / 3, 0);
+      lv_keyboard_set_mode(gfxKeyboard(), LV_KEYBOARD_MODE_NUMBER);
+      lv_keyboard_set_textarea(gfxKeyboard(), ta);
+      lv_obj_set_style_max_height(gfxKeyboard(), LV_HOR_RES * 2 / 3, 0);
       lv_obj_update_layout(tabView);   /*Be sure the sizes are recalculated*/
-      lv_obj_set_height(tabView, LV_VER_RES - lv_obj_get_height(keyboard));
-      lv_obj_clear_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+      lv_obj_set_height(tabView, LV_VER_RES - lv_obj_get_height(gfxKeyboard()));
+      lv_obj_clear_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
       lv_obj_scroll_to_view_recursive(ta, LV_ANIM_ON);
     }
   }
   else if(code == LV_EVENT_DEFOCUSED) {
-    lv_keyboard_set_textarea(keyboard, NULL);
+    lv_keyboard_set_textarea(gfxKeyboard(), NULL);
     lv_obj_set_height(tabView, LV_VER_RES);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
     lv_indev_reset(NULL, ta);
   }
   else if(code == LV_EVENT_READY || code == LV_EVENT_CANCEL) {
     lv_obj_set_height(tabView, LV_VER_RES);
-    lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_add_flag(gfxKeyboard(), LV_OBJ_FLAG_HIDDEN);
     lv_obj_clear_state(ta, LV_STATE_FOCUSED);
     lv_indev_reset(NULL, ta);   /*To forget the last clicked object to make it focusable again*/
   }
@@ -1626,6 +2137,7 @@ static void taConfigBool_event_cb(lv_event_t * e)
   {
     // Check if we should update block time
     if (guiRace.isCheckBoxTimeBased(cb)) {
+      guiRace.setTimeBasedRace(lv_obj_get_state(cb) & LV_STATE_CHECKED);
       uint32_t laps = 1;
       if (!guiRace.isTimeBasedRace()) {
         laps = guiRace.getLaps();
@@ -1833,6 +2345,7 @@ void guiRace::createGUITabConfig(lv_obj_t * settingTab)
   textAreaConfigRaceBlockNewLapTime  = addConfigNumber(configGrid, row++, "Block new lap until:", 0, "s", true);
   textAreaConfigRaceUpdateCloserTime = addConfigNumber(configGrid, row++, "Participand closing in time:", 0, "s", true);
   textAreaConfigRaceRaceStartIn      = addConfigNumber(configGrid, row++, "Race start countdown:", 0, "s", true);
+  updateGUITabConfig();
 
   // ------------------------------ TagSignal
   //createGUITabRSSI(tabSignalStrenght);
@@ -1882,6 +2395,173 @@ void guiRace::createGUITabRSSI(lv_obj_t * parent)
 */
 
 
+// Diagnostics tab, task load and stack from sysStats and GUI metrics
+#define DIAG_COLUMNS 6
+
+static void gfxSetTableCell(lv_obj_t * table, uint16_t row, uint16_t col, const char * text)
+{
+  const char * current = lv_table_get_cell_value(table, row, col);
+  if (current != nullptr && strcmp(current, text) == 0) {
+    return;
+  }
+  lv_table_set_cell_value(table, row, col, text);
+  gfxInvalidations++;
+}
+
+static void createGUITabDiagnostics(lv_obj_t * parent)
+{
+  lv_obj_set_flex_flow(parent, LV_FLEX_FLOW_COLUMN);
+  lv_obj_set_style_pad_row(parent, 5,0);
+  lv_obj_set_style_pad_all(parent, 5,0);
+
+  labelDiagnostics = lv_label_create(parent);
+  lv_obj_add_style(labelDiagnostics, &styleTagSmallText, 0);
+  lv_label_set_text(labelDiagnostics, "");
+
+  labelHeap = lv_label_create(parent);
+  lv_obj_add_style(labelHeap, &styleTagSmallText, 0);
+  lv_label_set_text(labelHeap, "");
+
+  labelHeapSubsystems = lv_label_create(parent);
+  lv_obj_add_style(labelHeapSubsystems, &styleTagSmallText, 0);
+  lv_label_set_text(labelHeapSubsystems, "");
+
+  tableDiagnostics = lv_table_create(parent);
+  lv_obj_add_style(tableDiagnostics, &styleTagSmallText, 0);
+  lv_table_set_col_cnt(tableDiagnostics, DIAG_COLUMNS);
+  lv_table_set_col_width(tableDiagnostics, 0, 200);
+  for (uint16_t col = 1; col < DIAG_COLUMNS; col++) {
+    lv_table_set_col_width(tableDiagnostics, col, 110);
+  }
+  lv_table_set_cell_value(tableDiagnostics, 0, 0, "Task");
+  lv_table_set_cell_value(tableDiagnostics, 0, 1, "Core");
+  lv_table_set_cell_value(tableDiagnostics, 0, 2, "Prio");
+  lv_table_set_cell_value(tableDiagnostics, 0, 3, "Load %");
+  lv_table_set_cell_value(tableDiagnostics, 0, 4, "Stack free");
+  lv_table_set_cell_value(tableDiagnostics, 0, 5, "Switches");
+}
+
+// Called once per second, only updates the tab while it is shown
+static void gfxUpdateDiagnostics()
+{
+  if (tableDiagnostics == nullptr || lv_tabview_get_tab_act(tabView) != GUI_TAB_DIAGNOSTICS) {
+    return;
+  }
+  static sysStatsSnapshot stats; // Static, to big for the stack
+  sysStatsGet(stats);
+
+  char text[GFX_LABEL_TEXT_MAX];
+  int len = 0;
+  for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (stats.coreLoad[core] == SYS_STATS_LOAD_UNKNOWN) {
+      len += snprintf(text + len, sizeof(text) - len, "Core %" PRIu32 ": -   ", core);
+    }
+    else {
+      len += snprintf(text + len, sizeof(text) - len, "Core %" PRIu32 ": %u%%   ", core, stats.coreLoad[core]);
+    }
+  }
+  snprintf(text + len, sizeof(text) - len, "Tasks: %" PRIu32 "   Widget updates: %" PRIu32 "/s",
+           stats.taskCount, guiInvalidationsPerSecond());
+  gfxSetLabelText(labelDiagnostics, text);
+
+  heapStatsSnapshot heap;
+  heapStatsGet(heap);
+  gfxSetLabelTextFmt(labelHeap, "RAM: %u free, largest %u (%u%% frag), min %u, trend %" PRId32 " B/h%s",
+                     heap.internalFree, heap.internalLargest, heap.internalFrag, heap.internalMinFree,
+                     heap.internalTrend, heap.alarm ? "  ALARM" : "");
+  gfxSetLabelTextFmt(labelHeapSubsystems, "PSRAM: %u free (%u%% frag)  LVGL: %u used (%u%% frag)  JSON %" PRId64 "  Last %ds: RaceDB %+" PRId64 " GUI %+" PRId64 " BT %+" PRId64,
+                     heap.psramFree, heap.psramFrag, heap.lvglUsed, heap.lvglFrag,
+                     heap.subsystems[HEAP_PERSISTENCE].bytes, HEAP_STATS_PERIOD, heap.subsystems[HEAP_RACEDB].window,
+                     heap.subsystems[HEAP_GUI].window, heap.subsystems[HEAP_BT].window);
+
+  if (lv_table_get_row_cnt(tableDiagnostics) != stats.taskCount + 1) {
+    lv_table_set_row_cnt(tableDiagnostics, stats.taskCount + 1);
+  }
+  for (uint32_t i = 0; i < stats.taskCount; i++) {
+    const sysTaskStats &task = stats.tasks[i];
+    uint16_t row = i + 1;
+    gfxSetTableCell(tableDiagnostics, row, 0, task.name);
+    if (task.core == tskNO_AFFINITY) {
+      strcpy(text, "-");
+    }
+    else {
+      snprintf(text, sizeof(text), "%d", static_cast<int>(task.core));
+    }
+    gfxSetTableCell(tableDiagnostics, row, 1, text);
+    snprintf(text, sizeof(text), "%u", static_cast<unsigned>(task.priority));
+    gfxSetTableCell(tableDiagnostics, row, 2, text);
+    if (task.load == SYS_STATS_LOAD_UNKNOWN) {
+      strcpy(text, "-");
+    }
+    else {
+      snprintf(text, sizeof(text), "%u", task.load);
+    }
+    gfxSetTableCell(tableDiagnostics, row, 3, text);
+    snprintf(text, sizeof(text), "%" PRIu32, task.stackFree);
+    gfxSetTableCell(tableDiagnostics, row, 4, text);
+    gfxSetTableCell(tableDiagnostics, row, 5, "n/a"); // See sysStats.h
+  }
+}
+
+// Tabs are created the first time they are shown, so boot is faster and LVGL memory is
+// only used for tabs that are used. With GUI_RELEASE_HIDDEN_GRAPH the graph (the largest
+// tab) is also deleted when another tab is shown, the lap data is kept in lapGraphSeries
+// and the chart is rebuilt from it when shown again.
+static void gfxCreateTab(uint32_t tab)
+{
+  if (tab >= GUI_TAB_COUNT || tabCreated[tab]) {
+    return;
+  }
+  lv_mem_monitor_t memBefore;
+  lv_mem_monitor(&memBefore);
+  uint64_t start_time = micros();
+  switch(tab) {
+    case GUI_TAB_RACE:
+      createGUITabRace(tabRace);
+      break;
+    case GUI_TAB_PARTICIPANTS:
+      createGUITabParticipant(tabParticipants);
+      break;
+    case GUI_TAB_GRAPH:
+      guiRace.createGUITabRaceGraph(); // Will be re-configurated later with when we get the race config msg
+      break;
+    case GUI_TAB_CONFIG:
+      guiRace.createGUITabConfig(tabConfig);
+      break;
+    case GUI_TAB_DIAGNOSTICS:
+      createGUITabDiagnostics(tabDiagnostics);
+      break;
+  }
+  tabCreated[tab] = true;
+  uint32_t tot_time = micros() - start_time;
+  lv_mem_monitor_t memAfter;
+  lv_mem_monitor(&memAfter);
+  ESP_LOGI(TAG,"Created tab %" PRIu32 " in %" PRIu32 " us using %d bytes LVGL memory", tab, tot_time,
+           static_cast<int>(memBefore.free_size) - static_cast<int>(memAfter.free_size));
+}
+
+static void gfxTabShown(uint32_t tab)
+{
+  gfxCreateTab(tab);
+#if GUI_RELEASE_HIDDEN_GRAPH
+  if (tab != GUI_TAB_GRAPH && tabCreated[GUI_TAB_GRAPH]) {
+    guiRace.releaseGUITabRaceGraph();
+    tabCreated[GUI_TAB_GRAPH] = false;
+  }
+#endif
+}
+
+static void gfxShowTab(uint32_t tab)
+{
+  gfxTabShown(tab);
+  lv_tabview_set_act(tabView, tab, LV_ANIM_ON);
+}
+
+static void tabView_event_cb(lv_event_t * e)
+{
+  gfxTabShown(lv_tabview_get_tab_act(tabView));
+}
+
 void createGUI(void)
 {
 #if LV_USE_THEME_DEFAULT
@@ -1915,6 +2595,9 @@ void createGUI(void)
   lv_style_set_text_opa(&styleIconOff, LV_OPA_50);
   lv_style_set_text_font(&styleIconOff, fontLarge);
 
+  lv_style_init(&styleBatteryLow);
+  lv_style_set_text_color(&styleBatteryLow, lv_palette_main(LV_PALETTE_RED));
+
   lv_style_init(&styleBullet);
   lv_style_set_border_width(&styleBullet, 0);
   lv_style_set_radius(&styleBullet, LV_RADIUS_CIRCLE);
@@ -1939,9 +2622,6 @@ void createGUI(void)
 #define TAB_HIGHT 70
 #define TAB_TIME_WIDTH 200
 
-  keyboard = lv_keyboard_create(lv_scr_act());
-  lv_obj_add_flag(keyboard, LV_OBJ_FLAG_HIDDEN);
-
   tabView = lv_tabview_create(lv_scr_act(), LV_DIR_TOP, TAB_HIGHT); // height of tab area
   lv_obj_set_style_text_font(lv_scr_act(), fontTag, 0);
 
@@ -1980,163 +2660,234 @@ void createGUI(void)
   lv_obj_center(globalLabelRaceTime);
   lv_obj_add_style(globalLabelRaceTime, &styleTime, 0);
 
+  // Same order as GUI_TAB_*
   tabRace = lv_tabview_add_tab(tabView, "Race"); 
   tabParticipants = lv_tabview_add_tab(tabView, LV_SYMBOL_LIST );
   tabGraph = lv_tabview_add_tab(tabView, LV_SYMBOL_EYE_OPEN );
-  lv_obj_t *tabConf = lv_tabview_add_tab(tabView, LV_SYMBOL_EDIT );
+  tabConfig = lv_tabview_add_tab(tabView, LV_SYMBOL_EDIT );
+  tabDiagnostics = lv_tabview_add_tab(tabView, LV_SYMBOL_SETTINGS );
+  guiRace.setTabGraph(tabGraph);
+  lv_obj_add_event_cb(tabView, tabView_event_cb, LV_EVENT_VALUE_CHANGED, NULL);
 
-  createGUITabRace(tabRace);
-  createGUITabParticipant(tabParticipants);
-  guiRace.setTabGraph(tabGraph); // Will be re-configurated later with when we get the race config msg
-  guiRace.createGUITabConfig(tabConf);
-
-  lv_obj_scroll_to_view_recursive(tabGraph, LV_ANIM_ON);
+  // Only the graph is shown at start, the rest is created when first shown
+  gfxShowTab(GUI_TAB_GRAPH);
 }
 
 void updateGUITime()
 {
   char buff[30];
-  time_t now = rtc.getEpoch();
+  time_t now = timebaseNowMs() / 1000;
 
   if (raceOngoing) {
-    time_t currentRaceTime = difftime(now, guiRace.getRaceStart());
+    time_t currentRaceTime = now - guiRace.getRaceStart();
     strftime (buff, 30, "%H:%M:%S", localtime(&currentRaceTime));
-    lv_label_set_text(globalLabelRaceTime, buff);
+    gfxSetLabelText(globalLabelRaceTime, buff);
   }
   else if(raceStartIn) {
-    lv_label_set_text_fmt(globalLabelRaceTime, ">>  %" PRId32 "  <<", raceStartIn);
+    gfxSetLabelTextFmt(globalLabelRaceTime, ">>  %" PRId32 "  <<", raceStartIn);
   }
   else {
-    lv_label_set_text(globalLabelRaceTime, "Start!");
+    gfxSetLabelText(globalLabelRaceTime, "Start!");
   }
 
   strftime (buff, 30, "%Y-%m-%d %H:%M:%S", localtime(&now));
-  lv_label_set_text(globalLabelRaceTag, buff);
+  gfxSetLabelText(globalLabelRaceTag, buff);
 }
 
+static void gfxHandleMsg(msg_GFX &msg)
+{
+  //ESP_LOGI(TAG,"----- loopHandlLVGL() msg.header.msgType = 0x%" PRIx32 " -----",msg.header.msgType);
+  switch(msg.header.msgType) {
+    case MSG_GFX_UPDATE_USER_DATA:
+    {
+      //ESP_LOGI(TAG,"Recived MSG_GFX_UPDATE_USER_DATA: MSG:0x%" PRIx32 " handleGFX:0x%08x distance:%d laps:%d lastlaptime:%d,connectionStatus:%d",
+      //        msg.Update.header.msgType, msg.Update.handleGFX, msg.Update.distance, msg.Update.laps, msg.Update.lastlaptime, msg.Update.connectionStatus);
+      gfxUpdateParticipantData(msg.UpdateUserData);
+      // Done! No response on this msg
+      break;
+    }
+    case MSG_GFX_UPDATE_USER_STATUS:
+    {
+      //ESP_LOGI(TAG,"Recived MSG_GFX_UPDATE_USER_STATUS: MSG:0x%" PRIx32 " handleGFX:0x%08x connectionStatus:%d battery:%d inRace:%d",
+      //              msg.UpdateStatus.header.msgType, msg.UpdateStatus.handleGFX, msg.UpdateStatus.connectionStatus, msg.UpdateStatus.battery, msg.UpdateStatus.inRace);
+      gfxUpdateParticipantStatus(msg.UpdateStatus);
+      break;
+    }
+    case MSG_GFX_UPDATE_USER_STATS:
+    {
+      gfxUpdateParticipantLapStats(msg.UpdateLapStats);
+      break;
+    }
+    case MSG_GFX_STANDINGS_MOVE:
+    {
+      gfxStandingsMove(msg.StandingsMove);
+      break;
+    }
+    case MSG_GFX_UPDATE_USER:
+    {
+      //ESP_LOGI(TAG,"Received: MSG_GFX_UPDATE_USER MSG:0x%" PRIx32 " handleGFX:0x%08x color:(0x%" PRIx32 ",0x%" PRIx32 ") Name:%s inRace:%d", 
+      //             msg.UpdateUser.header.msgType, msg.UpdateUser.handleGFX, msg.UpdateUser.color0, msg.UpdateUser.color1, msg.UpdateUser.name, msg.UpdateUser.inRace);
+      gfxUpdateParticipant(msg.UpdateUser);
+      // Done! No response on this msg
+      break;
+    }
+    case MSG_GFX_ADD_USERS:
+    {
+      ESP_LOGI(TAG,"Received: MSG_GFX_ADD_USERS MSG:0x%" PRIx32 " count:%" PRIu32, msg.AddUsers.header.msgType, msg.AddUsers.count);
+      uint32_t added = 0;
+      for (uint32_t i = 0; i < msg.AddUsers.count; i++) {
+        participantRegistration &reg = msg.AddUsers.participants[i];
+        reg.handleGFX = gfxAddParticipant(reg);
+        reg.wasOK = (reg.handleGFX != UINT32_MAX);
+        if (reg.wasOK) {
+          added++;
+        }
+      }
+      ESP_LOGI(TAG,"Added %" PRIu32 "/%" PRIu32 " Users --------- COME ON LETS PARTY!!!!!!!!!!!!!!!!!!", added, msg.AddUsers.count);
+      // Table is handed back to the sender, don't touch it after this
+      xTaskNotifyGive(msg.AddUsers.replyTask);
+      break;
+    }
+      // Broadcast Messages
+      case MSG_RACE_START:
+      {
+        //ESP_LOGI(TAG,"Received: MSG_RACE_START MSG:0x%" PRIx32 " startTime:%d", msg.Broadcast.RaceStart.header.msgType,msg.Broadcast.RaceStart.startTime);
+        guiRace.setRaceStart(msg.Broadcast.RaceStart.startTime);
+        break;
+      }
+      case MSG_RACE_STOP:
+      {
+        //ESP_LOGI(TAG,"Received: MSG_RACE_STOP MSG:0x%" PRIx32 " ", msg.Broadcast.RaceStop.header.msgType);
+        // Do nothing
+        // TODO keep our on raceOngoing state and set it here.
+        break;
+      }
+      case MSG_RACE_CLEAR:
+      {
+        ESP_LOGI(TAG,"Received: MSG_RACE_CLEAR MSG:0x%" PRIx32 "", msg.Broadcast.RaceStart.header.msgType);
+        gfxClearAllParticipantData();
+        break;
+      }
+      case MSG_RACE_CONFIG:
+      {
+        //ESP_LOGI(TAG,"Received: MSG_RACE_CONFIG MSG:0x%" PRIx32 "", msg.Broadcast.RaceConfig.header.msgType);
+        guiRace.receiveConfigRace(&msg.Broadcast.RaceConfig);
+        break;
+      }
+      default:
+      ESP_LOGE(TAG,"ERROR received bad msg: 0x%" PRIx32 "",msg.header.msgType);
+      //break;
+  }
+  //ESP_LOGE(TAG,"----- gfxHandleMsg() msg.header.msgType = 0x%" PRIx32 " DONE -----",msg.header.msgType);
+}
+
+// Block until a message arrives or LVGL has a timer due (display refresh, touch read, animations)
+// whatever comes first. Messages are handled in batches of up to GUI_MSG_BATCH before LVGL get to
+// run again so a burst of updates (e.g. loading a race) is drawn once and not per message.
+#define GUI_MSG_BATCH 32
+#define GUI_LVGL_MEM_PERIOD 10 // s, LVGL memory pool usage reported to heapStats
+
 void loopHandlLVGL()
 {
+  uint32_t timeTillNextLVGL = 0; // ms
+  int64_t lastTimeUpdate = 0;
+  uint32_t lastMetricsMs = millis();
   for( ;; )
   {
+    // Also wake up on each new second to update the clock
+    int64_t nowMs = timebaseNowMs();
+    uint32_t timeTillNextSecond = 1000 - (nowMs % 1000);
+    uint32_t waitMs = std::min(timeTillNextLVGL, timeTillNextSecond);
+    TickType_t waitTicks = std::max(pdMS_TO_TICKS(waitMs), static_cast<TickType_t>(1));
+
     msg_GFX msg;
-    while ( xQueueReceive(queueGFX, &(msg), (TickType_t)portMAX_DELAY) == pdPASS)
+    if (xQueueReceive(queueGFX, &(msg), waitTicks) == pdPASS)
     {
-      //ESP_LOGI(TAG,"----- loopHandlLVGL() msg.header.msgType = 0x%" PRIx32 " -----",msg.header.msgType);
-      switch(msg.header.msgType) {
-        case MSG_GFX_TIMER:
-        {
-          //ESP_LOGI(TAG,"Recived MSG_GFX_TIMER: MSG:0x%" PRIx32 "", msg.UpdateStatus.header.msgType);
-          lv_timer_handler();
-
-          static unsigned long lastTimeUpdate = 0;
-          unsigned long now = rtc.getEpoch();
-          if (lastTimeUpdate != now) {
-            lastTimeUpdate = now;
-            updateGUITime();
-          }
-          // Done! No response on this msg
-          break;        
-        }
-        case MSG_GFX_UPDATE_USER_DATA:
-        {
-          //ESP_LOGI(TAG,"Recived MSG_GFX_UPDATE_USER_DATA: MSG:0x%" PRIx32 " handleGFX:0x%08x distance:%d laps:%d lastlaptime:%d,connectionStatus:%d",
-          //        msg.Update.header.msgType, msg.Update.handleGFX, msg.Update.distance, msg.Update.laps, msg.Update.lastlaptime, msg.Update.connectionStatus);
-          gfxUpdateParticipantData(msg.UpdateUserData);
-          // Done! No response on this msg
-          break;
-        }
-        case MSG_GFX_UPDATE_USER_STATUS:
-        {
-          //ESP_LOGI(TAG,"Recived MSG_GFX_UPDATE_USER_STATUS: MSG:0x%" PRIx32 " handleGFX:0x%08x connectionStatus:%d battery:%d inRace:%d",
-          //              msg.UpdateStatus.header.msgType, msg.UpdateStatus.handleGFX, msg.UpdateStatus.connectionStatus, msg.UpdateStatus.battery, msg.UpdateStatus.inRace);
-          gfxUpdateParticipantStatus(msg.UpdateStatus);
-          break;
-        }
-        case MSG_GFX_UPDATE_USER:
-        {
-          //ESP_LOGI(TAG,"Received: MSG_GFX_UPDATE_USER MSG:0x%" PRIx32 " handleGFX:0x%08x color:(0x%" PRIx32 ",0x%" PRIx32 ") Name:%s inRace:%d", 
-          //             msg.UpdateUser.header.msgType, msg.UpdateUser.handleGFX, msg.UpdateUser.color0, msg.UpdateUser.color1, msg.UpdateUser.name, msg.UpdateUser.inRace);
-          gfxUpdateParticipant(msg.UpdateUser);
-          // Done! No response on this msg
-          break;
-        }
-        case MSG_GFX_ADD_USER:
+      TRACE_COUNTER(TRACE_GFX_QUEUED, uxQueueMessagesWaiting(queueGFX) + 1);
+      uint32_t handled = 0;
+      do {
+        //ESP_LOGI(TAG,"----- loopHandlLVGL() msg.header.msgType = 0x%" PRIx32 " -----",msg.header.msgType);
         {
-          ESP_LOGI(TAG,"Received: MSG_GFX_ADD_USER MSG:0x%" PRIx32 " handleDB:0x%" PRIx32 " color:(0x%" PRIx32 ",0x%" PRIx32 ") Name:%s inRace:%d", 
-                       msg.AddUser.header.msgType, msg.AddUser.handleDB, msg.AddUser.color0, msg.AddUser.color1, msg.AddUser.name, msg.AddUser.inRace);
-          uint32_t handle = gfxAddParticipant(msg.AddUser);
-
-          msg_RaceDB msgResponse;
-          msgResponse.AddedToGFX.header.msgType = MSG_ITAG_GFX_ADD_USER_RESPONSE;
-          msgResponse.AddedToGFX.handleDB = msg.AddUser.handleDB;
-          msgResponse.AddedToGFX.handleGFX = handle;
-          if (handle != UINT32_MAX) {
-            msgResponse.AddedToGFX.wasOK = true;
-          }
-          else {
-            msgResponse.AddedToGFX.wasOK = false;
-          }
-          // ESP_LOGI(TAG,"Send: MSG_ITAG_GFX_ADD_USER_RESPONSE MSG:0x%" PRIx32 " handleDB:0x%08x handleGFX:0x%08x wasOK:%d", 
-          //              msgResponse.AddedToGFX.header.msgType, msgResponse.AddedToGFX.handleDB, msgResponse.AddedToGFX.handleGFX, msgResponse.AddedToGFX.wasOK);
-          /*BaseType_t xReturned =*/ xQueueSend(queueRaceDB, (void*)&msgResponse, (TickType_t)pdMS_TO_TICKS( 2000 ));
-          // TODO handle error? xReturned;
-
-          break;
+          HEAP_TRACK_SCOPE(HEAP_GUI);
+          TRACE_SCOPE(TRACE_GFX_MSG, msg.header.msgType);
+          gfxHandleMsg(msg);
         }
-          // Broadcast Messages
-          case MSG_RACE_START:
-          {
-            //ESP_LOGI(TAG,"Received: MSG_RACE_START MSG:0x%" PRIx32 " startTime:%d", msg.Broadcast.RaceStart.header.msgType,msg.Broadcast.RaceStart.startTime);
-            guiRace.setRaceStart(msg.Broadcast.RaceStart.startTime);
-            break;
-          }
-          case MSG_RACE_STOP:
-          {
-            //ESP_LOGI(TAG,"Received: MSG_RACE_STOP MSG:0x%" PRIx32 " ", msg.Broadcast.RaceStop.header.msgType);
-            // Do nothing
-            // TODO keep our on raceOngoing state and set it here.
-            break;
-          }
-          case MSG_RACE_CLEAR:
-          {
-            ESP_LOGI(TAG,"Received: MSG_RACE_CLEAR MSG:0x%" PRIx32 "", msg.Broadcast.RaceStart.header.msgType);
-            gfxClearAllParticipantData();
-            break;
-          }
-          case MSG_RACE_CONFIG:
-          {
-            //ESP_LOGI(TAG,"Received: MSG_RACE_CONFIG MSG:0x%" PRIx32 "", msg.Broadcast.RaceConfig.header.msgType);
-            guiRace.receiveConfigRace(&msg.Broadcast.RaceConfig);
-            break;
-          }
-          default:
-          ESP_LOGE(TAG,"ERROR received bad msg: 0x%" PRIx32 "",msg.header.msgType);
-          //break;
+        handled++;
+      } while (handled < GUI_MSG_BATCH && xQueueReceive(queueGFX, &(msg), 0) == pdPASS);
+    }
+
+    int64_t nowSecond = timebaseNowMs() / 1000;
+    if (lastTimeUpdate != nowSecond) {
+      lastTimeUpdate = nowSecond;
+      updateGUITime();
+    }
+
+    // Metrics are measured on uptime, the timebase may be a scaled test clock
+    uint32_t uptimeMs = millis();
+    uint32_t metricsElapsedMs = uptimeMs - lastMetricsMs;
+    if (metricsElapsedMs >= 1000) {
+      lastMetricsMs = uptimeMs;
+      gfxInvalidationsPerSecond = (static_cast<uint64_t>(gfxInvalidations) * 1000) / metricsElapsedMs;
+      gfxInvalidations = 0;
+      gfxUpdateDiagnostics();
+      if (nowSecond % GUI_LVGL_MEM_PERIOD == 0) {
+        lv_mem_monitor_t mem;
+        lv_mem_monitor(&mem);
+        heapStatsSetLvgl(mem.total_size - mem.free_size, mem.frag_pct);
       }
-      //ESP_LOGE(TAG,"----- loopHandlLVGL() msg.header.msgType = 0x%" PRIx32 " DONE -----",msg.header.msgType);
+      ESP_LOGD(TAG,"Widget invalidations: %" PRIu32 "/s", gfxInvalidationsPerSecond);
     }
+
+    gfxChartFlushDirty();
+    TRACE_BEGIN(TRACE_LV_TIMER_HANDLER, 0);
+    timeTillNextLVGL = lv_timer_handler(); // LV_NO_TIMER_READY (0xFFFFFFFF) if nothing is scheduled
+    TRACE_END(TRACE_LV_TIMER_HANDLER);
   }
 }
 
 // ######################################################## GFX & Touch Driver stuff
 
-// Display callback to flush the buffer to screen
+// Display callback to flush the buffer to screen, hands it to the GFXFlush task so LVGL can
+// render the next area into the other draw buffer meanwhile
 
 void lvgl_displayFlushCallBack(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p)
 {
-  uint32_t w = (area->x2 - area->x1 + 1);
-  uint32_t h = (area->y2 - area->y1 + 1);
+  gfxFlushJob job;
+  job.disp = disp;
+  job.area = *area;
+  job.color_p = color_p;
+  xQueueSend(queueGFXFlush, (void*)&job, portMAX_DELAY); // LVGL has at most one flush ongoing
+}
+
+// Called by LVGL while it waits for the flush of a draw buffer, sleep instead of spinning
+void lvgl_displayFlushWait(lv_disp_drv_t *disp)
+{
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GFX_FLUSH_WAIT));
+}
 
+static void vTaskGFXFlush( void *pvParameters )
+{
+  for( ;; )
+  {
+    gfxFlushJob job;
+    if (xQueueReceive(queueGFXFlush, &(job), portMAX_DELAY) != pdPASS) {
+      continue;
+    }
+    {
+      TRACE_SCOPE(TRACE_DISP_FLUSH, lv_area_get_size(&job.area));
+      uint32_t w = (job.area.x2 - job.area.x1 + 1);
+      uint32_t h = (job.area.y2 - job.area.y1 + 1);
 #if (LV_COLOR_16_SWAP != 0)
-  gfx->draw16bitBeRGBBitmap(area->x1, area->y1, (uint16_t *)&color_p->full, w, h);
+      gfx->draw16bitBeRGBBitmap(job.area.x1, job.area.y1, (uint16_t *)&job.color_p->full, w, h);
 #else
-//  gfx->draw16bitRGBBitmap(area->x1, area->y1, (uint16_t *)&color_p->full, w, h);
-  gfx->draw16bitRGBBitmap(area->x1, area->y1, (uint16_t *)&color_p->full,
-                          area->x2 - area->x1 + 1, area->y2 - area->y1 + 1);
+      gfx->draw16bitRGBBitmap(job.area.x1, job.area.y1, (uint16_t *)&job.color_p->full, w, h);
 #endif
-  gfx->flush(); // Flush the buffer to the screen
-
-  lv_disp_flush_ready(disp);
+      gfx->flush(); // Flush the buffer to the screen
+    }
+    lv_disp_flush_ready(job.disp);
+    xTaskNotifyGive(xHandleGUI); // Wake lvgl_displayFlushWait()
+  }
+  vTaskDelete( NULL ); // Should never be reached
 }
 
 // Touchpad callback to read the touchpad
@@ -2170,6 +2921,7 @@ void vTaskLVGL( void *pvParameters )
   */
   //configASSERT( ( ( uint32_t ) pvParameters ) == 2 );
 
+  uint32_t stage = bootStageStart("GUI");
   ESP_LOGI(TAG, "Setup GFX");
 
 gfx = new Arduino_RGB_Display(
@@ -2190,6 +2942,7 @@ gfx->fillScreen(BLACK);
 
   lv_init();
   touch_init();
+  bootSignal(BOOT_I2C_READY);
 
 //#ifdef ESP32
   uint32_t buffersize = sizeof(lv_color_t) * screenWidth * screenHeight / 4;
@@ -2209,8 +2962,17 @@ gfx->fillScreen(BLACK);
   else
   {
     ESP_LOGI(TAG, "LVGL disp_draw_buf allocate OK size:%d",buffersize);
-    lv_disp_draw_buf_init(&draw_buf, disp_draw_buf, NULL, screenWidth * screenHeight / 4);
+    // Second buffer to render into while the first is flushed, works with one if it don't fit
+    disp_draw_buf2 = (lv_color_t *)heap_caps_malloc(buffersize, MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT);
+    if (!disp_draw_buf2)
+    {
+      ESP_LOGW(TAG, "WARNING: LVGL disp_draw_buf2 allocate failed! size:%d, flush will not overlap rendering",buffersize);
+    }
+    lv_disp_draw_buf_init(&draw_buf, disp_draw_buf, disp_draw_buf2, screenWidth * screenHeight / 4);
+  }
 
+  if (disp_draw_buf)
+  {
     /* Initialize the display */
     lv_disp_drv_init(&disp_drv);
     /* Change the following line to your display resolution */
@@ -2218,6 +2980,7 @@ gfx->fillScreen(BLACK);
     disp_drv.ver_res = screenHeight;
     disp_drv.flush_cb = lvgl_displayFlushCallBack;
     disp_drv.draw_buf = &draw_buf;
+    disp_drv.wait_cb = lvgl_displayFlushWait;
 //    disp_drv.rotated = LV_DISP_ROT_90;
 //    disp_drv.sw_rotate = 1;
   ESP_LOGI(TAG, "lv_disp_drv_register()");
@@ -2236,6 +2999,8 @@ gfx->fillScreen(BLACK);
 
   createGUI(); // MUST be done before adding participants
   ESP_LOGI(TAG, "Setup GFX done");
+  bootStageDone(stage);
+  bootSignal(BOOT_GUI_READY);
 
   for(;;)
   {
@@ -2251,25 +3016,33 @@ gfx->fillScreen(BLACK);
   vTaskDelete( NULL ); // Should never be reached in the good case
 }
 
-// WARNING Executes in the timer deamon contex, NO blocking and NO touching of our data, we will just send a msg to out thread and handle everything there.
-void vTaskGUITimer( TimerHandle_t xTimer )
+void initLVGL()
 {
-  //Send a tick message to our message queue to do all work in our own thread
-  msg_GFX msg;
-  msg.Timer.header.msgType = MSG_GFX_TIMER;
-  //ESP_LOGI(TAG,"Send: MSG_GFX_TIMER MSG:0x%" PRIx32 "", msg.Timer.header.msgType);
-  BaseType_t xReturned = xQueueSend(queueGFX, (void*)&msg, (TickType_t)0); //No blocking
+  BaseType_t xReturned;
+
+  // The flush task must be ready before the GUI task draws anything
+  queueGFXFlush = xQueueCreate(1, sizeof(gfxFlushJob));
+  if (queueGFXFlush == nullptr)
+  {
+    ESP_LOGE(TAG,"FATAL ERROR: xQueueCreate(queueGFXFlush) Failed");
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
+  }
+  xReturned = xTaskCreate(
+                  vTaskGFXFlush,          /* Function that implements the task. */
+                  "GFXFlush",             /* Text name for the task. */
+                  TASK_GUI_FLUSH_STACK,   /* Stack size in words, not bytes. */
+                  NULL,                   /* Parameter passed into the task. */
+                  TASK_GUI_FLUSH_PRIO,    /* Priority  0-(configMAX_PRIORITIES-1)   idle = 0 = tskIDLE_PRIORITY*/
+                  NULL );                 /* Used to pass out the created task's handle. */
   if( xReturned != pdPASS )
   {
-    ESP_LOGW(TAG,"WARNING: Send: MSG_GFX_TIMER MSG:0x%" PRIx32 "  Failed, do nothing, we try again in 2000ms", msg.Timer.header.msgType);
+    ESP_LOGE(TAG,"FATAL ERROR: xTaskCreate(vTaskGFXFlush, GFXFlush,..) Failed");
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
   }
-}
 
-void initLVGL()
-{
   // Start LVGL Task
-  BaseType_t xReturned;
-  
   /* Create the task, storing the handle. */
   xReturned = xTaskCreate(
                   vTaskLVGL,         /* Function that implements the task. */
@@ -2286,19 +3059,5 @@ void initLVGL()
     esp_restart();
   }
 
-  TimerHandle_t timerHandle = xTimerCreate("GUITimer", pdMS_TO_TICKS(200),pdTRUE, (void *) 0, vTaskGUITimer);
-  if( timerHandle == NULL ) {
-    ESP_LOGE(TAG,"FATAL ERROR: xTimerCreate(GUITimer,...) Failed");
-    ESP_LOGE(TAG,"----- esp_restart() -----");
-    esp_restart();
-  }
-  ESP_LOGI(TAG,"xTimerCreate(GUITimer,...) Ok");
-
-  if( xTimerStart( timerHandle, pdMS_TO_TICKS(2000) ) != pdPASS ) {
-    ESP_LOGE(TAG,"FATAL ERROR: xTimerStart(GUITimer) Failed");
-    ESP_LOGE(TAG,"----- esp_restart() -----");
-    esp_restart();
-  }
-  ESP_LOGI(TAG,"initLVGL() xTimerStart(GUITimer) Ok");
   ESP_LOGI(TAG,"initLVGL() Finished");
 }
@@ -0,0 +1,205 @@
+/*
+  Heap accounting and fragmentation, see heapStats.h
+*/
+#include <algorithm>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "common.h"
+#include "heapStats.h"
+
+#define TAG "Heap"
+
+#define HEAP_STATS_LINE_LENGTH 512
+#define HEAP_TREND_MIN_SAMPLES 10  // Don't guess a trend from less then this
+#define HEAP_ALARM_LOG_EVERY   10  // Samples, repeat the alarm while it's active
+
+static const char *subsystemNames[HEAP_SUBSYSTEMS] = {"RaceDB", "Persistence", "GUI", "BT"};
+
+static portMUX_TYPE heapStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static heapSubsystemStats subsystemStats[HEAP_SUBSYSTEMS] = {};
+static size_t lvglUsed = 0;
+static uint8_t lvglFrag = 0;
+static heapStatsSnapshot lastSnapshot = {};
+
+// Only used by heapStatsSample()
+static size_t trendSamples[HEAP_TREND_SAMPLES];
+static uint32_t trendCount = 0;
+static uint32_t trendNext = 0;
+static uint32_t alarmCount = 0;
+
+const char *heapSubsystemName(heapSubsystem subsystem)
+{
+  if (subsystem >= HEAP_SUBSYSTEMS) {
+    return "?";
+  }
+  return subsystemNames[subsystem];
+}
+
+static void heapTrackNet(heapSubsystem subsystem, int64_t bytes)
+{
+  if (subsystem >= HEAP_SUBSYSTEMS) {
+    return;
+  }
+  portENTER_CRITICAL(&heapStatsMux);
+  heapSubsystemStats &stats = subsystemStats[subsystem];
+  stats.bytes += bytes;
+  stats.peak = std::max(stats.peak, stats.bytes);
+  if (bytes > 0) {
+    stats.allocs++;
+  }
+  portEXIT_CRITICAL(&heapStatsMux);
+}
+
+void heapTrackAlloc(heapSubsystem subsystem, size_t bytes)
+{
+  heapTrackNet(subsystem, static_cast<int64_t>(bytes));
+}
+
+void heapTrackFree(heapSubsystem subsystem, size_t bytes)
+{
+  heapTrackNet(subsystem, -static_cast<int64_t>(bytes));
+}
+
+void heapStatsSetLvgl(size_t used, uint8_t frag)
+{
+  portENTER_CRITICAL(&heapStatsMux);
+  lvglUsed = used;
+  lvglFrag = frag;
+  portEXIT_CRITICAL(&heapStatsMux);
+}
+
+heapTrackScope::heapTrackScope(heapSubsystem inSubsystem) :
+  subsystem(inSubsystem),
+  freeAtStart(heap_caps_get_free_size(MALLOC_CAP_DEFAULT))
+{
+}
+
+heapTrackScope::~heapTrackScope()
+{
+  int64_t freeNow = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  int64_t used = static_cast<int64_t>(freeAtStart) - freeNow;
+  if (subsystem >= HEAP_SUBSYSTEMS) {
+    return;
+  }
+  portENTER_CRITICAL(&heapStatsMux);
+  subsystemStats[subsystem].window += used;
+  subsystemStats[subsystem].windowScopes++;
+  portEXIT_CRITICAL(&heapStatsMux);
+}
+
+static uint8_t heapFragmentation(size_t freeBytes, size_t largest)
+{
+  if (freeBytes == 0) {
+    return 0;
+  }
+  return 100 - static_cast<uint8_t>((static_cast<uint64_t>(largest) * 100) / freeBytes);
+}
+
+// Least squares slope of the trend samples in bytes/hour
+static int32_t heapTrend()
+{
+  if (trendCount < HEAP_TREND_MIN_SAMPLES) {
+    return 0;
+  }
+  uint32_t oldest = (trendNext + HEAP_TREND_SAMPLES - trendCount) % HEAP_TREND_SAMPLES;
+  double meanX = (trendCount - 1) / 2.0;
+  double meanY = 0;
+  for (uint32_t i = 0; i < trendCount; i++) {
+    meanY += trendSamples[(oldest + i) % HEAP_TREND_SAMPLES];
+  }
+  meanY /= trendCount;
+  double sumXY = 0;
+  double sumXX = 0;
+  for (uint32_t i = 0; i < trendCount; i++) {
+    double dx = i - meanX;
+    sumXY += dx * (trendSamples[(oldest + i) % HEAP_TREND_SAMPLES] - meanY);
+    sumXX += dx * dx;
+  }
+  double perSample = sumXY / sumXX;
+  return static_cast<int32_t>(perSample * (3600 / HEAP_STATS_PERIOD));
+}
+
+static bool heapAlarm(size_t internalFree, int32_t trend)
+{
+  if (internalFree < HEAP_INTERNAL_RESERVE) {
+    return true;
+  }
+  if (trend >= 0) {
+    return false;
+  }
+  // Hours until we hit the reserve with the current trend
+  int64_t left = static_cast<int64_t>(internalFree) - HEAP_INTERNAL_RESERVE;
+  return left < static_cast<int64_t>(-trend) * HEAP_ALARM_HOURS;
+}
+
+static void heapStatsLog(const heapStatsSnapshot &snapshot)
+{
+  static char line[HEAP_STATS_LINE_LENGTH];
+  int len = snprintf(line, sizeof(line), "HEAP,%" PRId64 ",%u,%u,%u,%u,%u,%u,%u,%u,%u,%" PRId32 ",%d",
+                     snapshot.uptimeMs, snapshot.internalFree, snapshot.internalLargest, snapshot.internalMinFree,
+                     snapshot.internalFrag, snapshot.psramFree, snapshot.psramLargest, snapshot.psramFrag,
+                     snapshot.lvglUsed, snapshot.lvglFrag, snapshot.internalTrend, snapshot.alarm ? 1 : 0);
+  for (uint32_t i = 0; i < HEAP_SUBSYSTEMS && len < static_cast<int>(sizeof(line)); i++) {
+    const heapSubsystemStats &stats = snapshot.subsystems[i];
+    len += snprintf(line + len, sizeof(line) - len, ",%s:%" PRId64 ":%" PRId64 ":%" PRIu32 ":%" PRId64 ":%" PRIu32,
+                    subsystemNames[i], stats.bytes, stats.peak, stats.allocs, stats.window, stats.windowScopes);
+  }
+  ESP_LOGI(TAG,"%s", line);
+}
+
+void heapStatsSample()
+{
+  heapStatsSnapshot snapshot = {};
+  snapshot.uptimeMs = esp_timer_get_time() / 1000;
+  snapshot.internalFree = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  snapshot.internalLargest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+  snapshot.internalMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+  snapshot.internalFrag = heapFragmentation(snapshot.internalFree, snapshot.internalLargest);
+  snapshot.psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  snapshot.psramLargest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+  snapshot.psramFrag = heapFragmentation(snapshot.psramFree, snapshot.psramLargest);
+
+  trendSamples[trendNext] = snapshot.internalFree;
+  trendNext = (trendNext + 1) % HEAP_TREND_SAMPLES;
+  trendCount = std::min(trendCount + 1, static_cast<uint32_t>(HEAP_TREND_SAMPLES));
+  snapshot.internalTrend = heapTrend();
+  snapshot.alarm = heapAlarm(snapshot.internalFree, snapshot.internalTrend);
+
+  portENTER_CRITICAL(&heapStatsMux);
+  snapshot.lvglUsed = lvglUsed;
+  snapshot.lvglFrag = lvglFrag;
+  std::copy(subsystemStats, subsystemStats + HEAP_SUBSYSTEMS, snapshot.subsystems);
+  for (uint32_t i = 0; i < HEAP_SUBSYSTEMS; i++) {
+    subsystemStats[i].window = 0; // Scopes are only reported per period, see heapStats.h
+    subsystemStats[i].windowScopes = 0;
+  }
+  lastSnapshot = snapshot;
+  portEXIT_CRITICAL(&heapStatsMux);
+
+  heapStatsLog(snapshot);
+
+  if (snapshot.alarm) {
+    if (alarmCount % HEAP_ALARM_LOG_EVERY == 0) {
+      ESP_LOGE(TAG,"HEAP ALARM: Internal RAM free %u bytes (largest block %u, %u%% fragmented), trend %" PRId32 " bytes/h, reserve %d bytes",
+               snapshot.internalFree, snapshot.internalLargest, snapshot.internalFrag, snapshot.internalTrend, HEAP_INTERNAL_RESERVE);
+      for (uint32_t i = 0; i < HEAP_SUBSYSTEMS; i++) {
+        ESP_LOGE(TAG,"HEAP ALARM:   %-12s %8" PRId64 " bytes (peak %" PRId64 ") last period %+" PRId64 " bytes in %" PRIu32 " scopes",
+                 subsystemNames[i], snapshot.subsystems[i].bytes, snapshot.subsystems[i].peak,
+                 snapshot.subsystems[i].window, snapshot.subsystems[i].windowScopes);
+      }
+    }
+    alarmCount++;
+  }
+  else if (alarmCount > 0) {
+    ESP_LOGW(TAG,"Heap alarm cleared, internal RAM free %u bytes, trend %" PRId32 " bytes/h",
+             snapshot.internalFree, snapshot.internalTrend);
+    alarmCount = 0;
+  }
+}
+
+void heapStatsGet(heapStatsSnapshot &snapshot)
+{
+  portENTER_CRITICAL(&heapStatsMux);
+  snapshot = lastSnapshot;
+  portEXIT_CRITICAL(&heapStatsMux);
+}
@@ -5,14 +5,23 @@
   https://www.youtube.com/watch?v=uNGMq_U3ydw
 
 */
+#include <algorithm>
 #include <mutex>
 #include <string>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
 #include <ArduinoJson.h>
 #include <LittleFS.h>
+#include "esp_heap_caps.h"
 #include "common.h"
 #include "iTag.h"
 #include "messages.h"
 #include "bluetooth.h"
+#include "timebase.h"
+#include "boot.h"
+#include "heapStats.h"
+#include "trace.h"
+#include "deferredLog.h"
 
 #define TAG "iTAG"
 
@@ -31,6 +40,18 @@ static void DBsaveGlobalConfig();
  //Hopefully good enough for any 6D race
 
 #define MAX_SAVED_LAPS 1000
+#define LAP_STATS_LAST_N 3 // Laps used for current pace and projections
+
+// Background battery polling, a BT connect stops the scanning for a few seconds so this is
+// done seldom, one tag at the time and only when no participant is expected to pass the unit.
+#define BATTERY_POLL_INTERVAL   (30*60) // Refresh battery level of each active tag this often (seconds)
+#define BATTERY_POLL_RETRY      (5*60)  // Retry this long after a failed read (seconds)
+#define BATTERY_POLL_RATE_LIMIT 60      // Never connect to any tag more often then this (seconds)
+#define BATTERY_POLL_GUARD      60      // Don't poll if a participant is expected to pass within this time (seconds)
+#define BATTERY_TREND_MIN_TIME  (60*60) // Need this long between readings before the drain trend is trusted (seconds)
+#define BATTERY_LOW_LEVEL       20      // Always show as low below this level (%)
+
+#define RECEIVER_DEDUP_TIME 1000 // Same tag heard by another receiver within this time is the same advertisement (ms)
 
 class Race {
   public:
@@ -45,7 +66,9 @@ class Race {
       updateCloserTime(30),
       raceStartInTime(RACE_COUNTDOWN),
       raceOngoing(false),
-      raceStart(0)
+      raceStart(0),
+      nowMs(0),
+      timeSinceStartMs(0)
     {
       if(laps == 0) {  //TODO make this a compiler check
         laps = 1; // Should never be 0 but if it is lets fix it
@@ -161,9 +184,25 @@ class Race {
     void setRaceStartInTime(time_t inTime) {raceStartInTime=inTime;}
     void setUpdateCloserTime(time_t inTime) {updateCloserTime=inTime;}
 
-    void setRaceStart(time_t inStart) {raceStart=inStart;}
+    void setRaceStart(time_t inStart)
+    {
+      raceStart=inStart;
+      timeSinceStartMs = nowMs - static_cast<int64_t>(raceStart) * 1000;
+    }
     void setRaceOngoing(bool race) {raceOngoing=race;}
 
+    // Race clock, the time is read once for each message handled by RaceDB (tick()) so
+    // everything done for a message use the same "now" and per tag time math is just
+    // integer subtraction.
+    void tick()
+    {
+      nowMs = timebaseNowMs();
+      timeSinceStartMs = nowMs - static_cast<int64_t>(raceStart) * 1000;
+    }
+    time_t getNow() {return nowMs / 1000;} // s since epoch
+    int getNowMinute() {return (nowMs / (60*1000)) % 60;}
+    int64_t getTimeSinceStartMs() {return timeSinceStartMs;}
+
   private:
     std::string fileName;
     std::string name;
@@ -177,48 +216,168 @@ class Race {
     // Ongoing Race stuff
     bool raceOngoing;
     time_t raceStart;
+    // Race clock, see tick()
+    int64_t nowMs;            // ms since epoch
+    int64_t timeSinceStartMs; // ms since raceStart, negative before start
 };
 
 static Race theRace;
 
 
 
+// All times in ms
 class lapData {
   public:
-    lapData(): StartTime(0), LastSeen(0) {}
-    time_t getLapStart() {return StartTime;}
-    time_t getLastSeen() {return LastSeen;}
-    void setLap(time_t timeSinceRaceStart,time_t timeSinceLapStart) {StartTime = timeSinceRaceStart; LastSeen = timeSinceLapStart;}
-    void setLapStart(time_t timeSinceRaceStart) {StartTime = timeSinceRaceStart;}
-    void setLastSeen(time_t timeSinceLapStart) {LastSeen = timeSinceLapStart;}
+    lapData(): StartTime(0), LastSeen(0), BestLap(INT64_MAX) {}
+    int64_t getLapStart() {return StartTime;}
+    int64_t getLastSeen() {return LastSeen;}
+    int64_t getBestLap() {return BestLap;}
+    void setBestLap(int64_t lapTime) {BestLap = lapTime;}
+    void setLap(int64_t timeSinceRaceStart,int64_t timeSinceLapStart) {StartTime = timeSinceRaceStart; LastSeen = timeSinceLapStart;}
+    void setLapStart(int64_t timeSinceRaceStart) {StartTime = timeSinceRaceStart;}
+    void setLastSeen(int64_t timeSinceLapStart) {LastSeen = timeSinceLapStart;}
   private:
-    time_t StartTime; // Start and End time of last lap
-    time_t LastSeen;  // Start time of running lap e.g. last time Tag was seen (noot needed to save for lap but could be good for debug)
+    int64_t StartTime; // Start and End time of last lap
+    int64_t LastSeen;  // Start time of running lap e.g. last time Tag was seen (noot needed to save for lap but could be good for debug)
+    int64_t BestLap;   // Best lap time of all laps up to and including this one, INT64_MAX for none. Kept per lap so prevLap() is O(1)
     //time_t LapTime; // Not needed next entry will contain this
     //uint32_t Distance; // Not neede for now all laps have equal length
 };
 
+// Collects the RSSI samples during theRace.getUpdateCloserTime() after a new lap is detected and
+// estimate the moment the tag passed closest to the unit. A median of 3 filter removes single
+// noisy samples and the peak is interpolated with a parabola through the strongest filtered
+// sample and its neighbours to get a time between the samples.
+#define RSSI_WINDOW_SIZE 128
+
+class rssiPeakEstimator {
+  public:
+    rssiPeakEstimator(): count(0) {}
+
+    void clear() {count = 0;}
+    uint32_t getSampleCount() {return count;}
+
+    void start(int64_t timeMs, int8_t rssi)
+    {
+      clear();
+      addSample(timeMs, rssi);
+    }
+
+    // Samples are kept in time order (detections from other receivers can arrive a bit late),
+    // samples with the same time are averaged
+    void addSample(int64_t timeMs, int8_t rssi)
+    {
+      uint32_t pos = count;
+      while (pos > 0 && sampleTime[pos-1] > timeMs) {
+        pos--;
+      }
+      if (pos > 0 && sampleTime[pos-1] == timeMs) {
+        if (sampleRSSICount[pos-1] < UINT16_MAX) { // Enough for an average, don't let the count wrap to 0
+          sampleRSSISum[pos-1] += rssi;
+          sampleRSSICount[pos-1]++;
+        }
+        return;
+      }
+      if (count >= RSSI_WINDOW_SIZE) {
+        return; // Window is full, the pass should be over by now anyway
+      }
+      for (uint32_t i = count; i > pos; i--) {
+        sampleTime[i] = sampleTime[i-1];
+        sampleRSSISum[i] = sampleRSSISum[i-1];
+        sampleRSSICount[i] = sampleRSSICount[i-1];
+      }
+      sampleTime[pos] = timeMs;
+      sampleRSSISum[pos] = rssi;
+      sampleRSSICount[pos] = 1;
+      count++;
+    }
+
+    // Returns false if there are no samples
+    bool estimatePeak(int64_t &peakTimeMs)
+    {
+      if (count == 0) {
+        return false;
+      }
+
+      float filtered[RSSI_WINDOW_SIZE];
+      for (uint32_t i = 0; i < count; i++) {
+        float prev = getRSSI(i > 0 ? i-1 : i);
+        float curr = getRSSI(i);
+        float next = getRSSI(i+1 < count ? i+1 : i);
+        filtered[i] = std::max(std::min(prev, curr), std::min(std::max(prev, curr), next)); // median of 3
+      }
+
+      // Strongest filtered sample, if several in a row are equal use the middle of them
+      uint32_t peak = 0;
+      for (uint32_t i = 1; i < count; i++) {
+        if (filtered[i] > filtered[peak]) {
+          peak = i;
+        }
+      }
+      uint32_t peakEnd = peak;
+      while (peakEnd+1 < count && filtered[peakEnd+1] == filtered[peak]) {
+        peakEnd++;
+      }
+      if (peakEnd != peak) {
+        peakTimeMs = (sampleTime[peak] + sampleTime[peakEnd]) / 2;
+        return true;
+      }
+
+      peakTimeMs = sampleTime[peak];
+      if (peak == 0 || peak+1 >= count) {
+        return true; // Peak at the edge, nothing to interpolate with
+      }
+
+      // Parabola through the three points, x relative to the peak sample (samples are not evenly spaced)
+      float x0 = static_cast<float>(sampleTime[peak-1] - sampleTime[peak]);
+      float x2 = static_cast<float>(sampleTime[peak+1] - sampleTime[peak]);
+      float y0 = filtered[peak-1] - filtered[peak];
+      float y2 = filtered[peak+1] - filtered[peak];
+      float denom = x0 * x2 * (x0 - x2);
+      float a = (y0 * x2 - y2 * x0) / denom;
+      float b = (y2 * x0 * x0 - y0 * x2 * x2) / denom;
+      if (a < 0.0f) {
+        float vertex = -b / (2.0f * a);
+        vertex = std::min(std::max(vertex, x0), x2);
+        peakTimeMs += static_cast<int64_t>(lroundf(vertex));
+      }
+      return true;
+    }
+
+  private:
+    float getRSSI(uint32_t i) {return static_cast<float>(sampleRSSISum[i]) / sampleRSSICount[i];}
+
+    int64_t sampleTime[RSSI_WINDOW_SIZE];
+    int32_t sampleRSSISum[RSSI_WINDOW_SIZE];
+    uint16_t sampleRSSICount[RSSI_WINDOW_SIZE];
+    uint32_t count;
+};
+
 class participantData {
   public:
-    participantData(): name("Name"), laps(0), timeCurrentLapFirstDetected(0), timeSinceLastSeen(0) { handleGFX_isValid = false;  inRace = false; updated = false; lapsData.resize(MAX_SAVED_LAPS); clearLaps(); }
+    participantData(): name("Name"), laps(0), goal(0), timeCurrentLapFirstDetected(0), timeSinceLastSeen(0) { handleGFX_isValid = false;  inRace = false; updated = false; lapsData.resize(MAX_SAVED_LAPS); clearLaps(); }
     std::string getName() {return name;}
     void setName(std::string inName) {name = inName;}
     uint32_t getLapCount() {return laps;}
+    uint32_t getGoal() {return goal;}
+    void setGoal(uint32_t inGoal) {goal = inGoal;}
 
     void prevLap()
     {
+      // Statistics of the previous lap are still valid as they only depend on earlier laps
       if (laps>0) laps--;
       setUpdated();
       refreshTagGUI();
     }
 
     // usefull when loading a lap and lapstart is not "now"
-    bool nextLap(time_t lapStart,time_t lastSeen)
+    bool nextLap(int64_t lapStart,int64_t lastSeen)
     {
       timeCurrentLapFirstDetected = lapStart;
       if ((laps + 1) < (MAX_SAVED_LAPS)) {
         laps++;
         setCurrentLap(lapStart, lastSeen);
+        updateBestLap();
         setUpdated();
         refreshTagGUI();
         return true;
@@ -233,17 +392,18 @@ class participantData {
     }
 
     // usefull for triggering a new lap "now" (during race)
-    bool nextLap(time_t newLapTime)
+    bool nextLap(int64_t newLapTime)
     {
       return nextLap(newLapTime, 0);
     }
 
-    // Called when we close to a new lap get stringer RSSI so we assume the new lap is "now" instead of a few seconds ago
+    // Called when the estimated closest pass moves, so we assume the new lap is then instead of the first detection.
     // This is used to get a closer lap time to the unit and try to avoid saving early BT detections.
-    // Used together with bestRSSInearNewLap
-    void updateLapTagIsCloser(time_t newLapTime)
+    // Used together with rssiPeak
+    void updateLapTagIsCloser(int64_t newLapTime)
     {
       setCurrentLap(newLapTime, 0);
+      updateBestLap();
       setUpdated();
       refreshTagGUI();
     }
@@ -252,24 +412,37 @@ class participantData {
       laps = 0;
       timeCurrentLapFirstDetected = 0;
       timeSinceLastSeen = 0;
+      rssiPeak.clear();
       for (lapData& lap : lapsData) {
         lap.setLap(0,0);
+        lap.setBestLap(INT64_MAX);
       }
     }
 
+    // Running lap statistics, all in ms and O(1) as lap start times are a prefix sum of the lap times
+    // and the best lap is kept per lap. All return 0 if there is no lap yet.
+    int64_t getLapTime(uint32_t lap) {return (lap == 0) ? 0 : lapsData.at(lap).getLapStart() - lapsData.at(lap-1).getLapStart();}
+    int64_t getLastLapTime() {return getLapTime(laps);}
+    int64_t getBestLapTime() {return (laps == 0) ? 0 : lapsData.at(laps).getBestLap();}
+    int64_t getAverageLapTime() {return (laps == 0) ? 0 : getCurrentLapStart() / laps;}
+    int64_t getLastNAverageLapTime()
+    {
+      uint32_t n = std::min(laps, static_cast<uint32_t>(LAP_STATS_LAST_N));
+      return (n == 0) ? 0 : (getCurrentLapStart() - lapsData.at(laps-n).getLapStart()) / n;
+    }
+
     lapData& getLap(uint32_t lap) { return lapsData.at(lap);}
 
-    time_t getCurrentLapFirstDetected() {return timeCurrentLapFirstDetected;}
-    int8_t getBestRSSInearNewLap() {return bestRSSInearNewLap;}
-    void setBestRSSInearNewLap(int8_t newRSSI) {bestRSSInearNewLap = newRSSI;}
+    int64_t getCurrentLapFirstDetected() {return timeCurrentLapFirstDetected;}
+    rssiPeakEstimator& getRSSIPeak() {return rssiPeak;}
 
-    time_t getCurrentLapStart() {return lapsData.at(laps).getLapStart();}
-    void setCurrentLapStart(time_t timeSinceRaceStart) {lapsData.at(laps).setLapStart(timeSinceRaceStart);}
-    time_t getCurrentLastSeen() {return lapsData.at(laps).getLastSeen();}
-    time_t getCurrentLastSeenSinceRaceStart() {return lapsData.at(laps).getLapStart() + lapsData.at(laps).getLastSeen();}
+    int64_t getCurrentLapStart() {return lapsData.at(laps).getLapStart();}
+    void setCurrentLapStart(int64_t timeSinceRaceStart) {lapsData.at(laps).setLapStart(timeSinceRaceStart);}
+    int64_t getCurrentLastSeen() {return lapsData.at(laps).getLastSeen();}
+    int64_t getCurrentLastSeenSinceRaceStart() {return lapsData.at(laps).getLapStart() + lapsData.at(laps).getLastSeen();}
 
-    void setCurrentLastSeen(time_t timeSinceLapStart) {lapsData.at(laps).setLastSeen(timeSinceLapStart);}
-    void setCurrentLap(time_t timeSinceRaceStart,time_t timeSinceLapStart) {lapsData.at(laps).setLap(timeSinceRaceStart,timeSinceLapStart);}
+    void setCurrentLastSeen(int64_t timeSinceLapStart) {lapsData.at(laps).setLastSeen(timeSinceLapStart);}
+    void setCurrentLap(int64_t timeSinceRaceStart,int64_t timeSinceLapStart) {lapsData.at(laps).setLap(timeSinceRaceStart,timeSinceLapStart);}
 
     uint32_t getTimeSinceLastSeen() {return timeSinceLastSeen;}
     void setTimeSinceLastSeen(time_t inTime) {timeSinceLastSeen=inTime;}
@@ -292,10 +465,21 @@ class participantData {
     }
 
   private:
+    // Must be called when the current lap start changes
+    void updateBestLap()
+    {
+      if (laps == 0) {
+        lapsData.at(0).setBestLap(INT64_MAX);
+        return;
+      }
+      lapsData.at(laps).setBestLap(std::min(lapsData.at(laps-1).getBestLap(), getLastLapTime()));
+    }
+
     std::string name;     // Participant name
     uint32_t laps;
-    time_t timeCurrentLapFirstDetected; // First time in this lap the tag is ever detected, getCurrentLapStart() might get updated to a theRace.getUpdateCloserTime() seconds after detection if RSSI get "stronger".
-    int8_t bestRSSInearNewLap; // Updated theRace.getUpdateCloserTime() seconds after a new lap is detected and used to present a lap time closer to unit in case of early detection (with some smooting maybe?)
+    uint32_t goal;        // Distance in m at race maxTime, 0 if no goal, see GOAL_HALFTIME_SHARE
+    int64_t timeCurrentLapFirstDetected; // First time (ms) in this lap the tag is ever detected, getCurrentLapStart() might get updated to a theRace.getUpdateCloserTime() seconds after detection if RSSI get "stronger".
+    rssiPeakEstimator rssiPeak; // Samples theRace.getUpdateCloserTime() seconds after a new lap is detected and used to present a lap time closer to unit in case of early detection
     uint32_t timeSinceLastSeen; // in seconds, used to update UI Update when calculated
     std::vector<lapData> lapsData;
     uint32_t handleGFX;
@@ -305,6 +489,8 @@ class participantData {
 };
 
 
+#define ITAG_OWNER_SELF -1 // iTag::owner before validateTagOwners() if the tag is not shared
+
 class iTag {
   public:
     std::string address;  // BT UUID
@@ -312,20 +498,42 @@ class iTag {
     uint32_t color1;      // Color of iTag holder
     int32_t battery;      // 0-100 and -1 when unknown
     bool active;          // As in part of race, has been configured (or on it's way to be)
-    bool connected;       // As near enough right now, e.g. spoted recently
+    bool connected;       // As near enough right now, e.g. spoted recently by any of the participants tags
+    int owner;            // Index in iTags of the participant carrying this tag, itself if not shared
+
+    // Last accepted detection, used to deduplicate when more then one receiver sees the tag
+    int64_t lastDetectionTimeMs;
+    uint8_t lastDetectionReceiver;
+    int8_t lastDetectionRSSI;
+
+    // Background battery polling
+    time_t batteryTime;           // Epoch of last successful battery reading
+    time_t batteryPollTime;       // Epoch of last battery read attempt
+    bool batteryReadPending;      // MSG_ITAG_READ_BATTERY sent, waiting for MSG_ITAG_BATTERY
+    int32_t batteryTrendStart;    // Battery level at start of drain trend, -1 when no reading yet
+    time_t batteryTrendStartTime; // Epoch of batteryTrendStart reading
   
     participantData participant;
-    iTag(std::string inAddress,std::string inName, bool isInRace, uint32_t inColor0, uint32_t inColor1);
+    iTag(std::string inAddress,std::string inName, bool isInRace, uint32_t inColor0, uint32_t inColor1, int inOwner = ITAG_OWNER_SELF);
     bool UpdateParticipantInGFX();
     bool UpdateParticipantStatusInGUI();
     bool UpdateParticipantStatsInGUI();
+    bool UpdateParticipantLapStatsInGUI();
+    void invalidateLapStats() {lapStatsSentLaps = UINT32_MAX;} // Resend lap statistics on next update, e.g. goal or race changed
     void reset();
+    void updateBattery(int8_t newBattery, time_t now);
+    int16_t getBatteryHoursLeft();
+    bool isBatteryLow(time_t now);
+    bool isDuplicateDetection(msg_iTagDetected &detection);
 
     //void saveGUIObjects(lv_obj_t * ledColor0, lv_obj_t * ledColor1, lv_obj_t * labelName, lv_obj_t * labelDist, lv_obj_t * labelLaps, lv_obj_t * labelTime, lv_obj_t * labelConnStatus, /*lv_obj_t * labelBatterySym,*/ lv_obj_t * labelBat);
     int getRSSI() {return RSSI;}
     void setRSSI(int val) {RSSI=val;}
   private:
     int RSSI;
+    // Lap statistics are only sent to the GUI when these changed
+    uint32_t lapStatsSentLaps;
+    int64_t lapStatsSentLapStart;
 };
 
 #define ITAG_COLOR_PINK     0xfdb9c8 // Lemonade
@@ -336,11 +544,13 @@ class iTag {
 #define ITAG_COLOR_GREEN    0xAEF359 // Lime
 
 //TODO update BTUUIDs, names and color, also make name editable from GUI
+// Last argument is the participant (index) carrying the tag if it's an extra tag of someone else,
+// detections from all tags of a participant are fused into one lap decision.
 iTag iTags[ITAG_COUNT] = {
   iTag("ff:ff:10:7e:be:67", "OrangeBlue",   false,  ITAG_COLOR_ORANGE,  ITAG_COLOR_DARKBLUE), //00
-  iTag("ff:ff:10:7f:7c:b7", "Zingo0",  true,  ITAG_COLOR_BLACK,   ITAG_COLOR_PINK), //01
-  iTag("ff:ff:10:7d:53:fe", "Zingo1",  true, ITAG_COLOR_DARKBLUE,   ITAG_COLOR_PINK),//02
-  iTag("ff:ff:10:80:71:e7", "Zingo2",  true, ITAG_COLOR_ORANGE,   ITAG_COLOR_BLACK), //03
+  iTag("ff:ff:10:7f:7c:b7", "Zingo0",  false,  ITAG_COLOR_BLACK,   ITAG_COLOR_PINK, 4), //01 Extra tag for Zingo
+  iTag("ff:ff:10:7d:53:fe", "Zingo1",  false, ITAG_COLOR_DARKBLUE,   ITAG_COLOR_PINK, 4),//02 Extra tag for Zingo
+  iTag("ff:ff:10:80:71:e7", "Zingo2",  false, ITAG_COLOR_ORANGE,   ITAG_COLOR_BLACK, 4), //03 Extra tag for Zingo
   iTag("ff:ff:10:7e:82:46", "Zingo", true,  ITAG_COLOR_ORANGE,  ITAG_COLOR_ORANGE), //04
   iTag("ff:ff:10:7d:d2:08", "BlueOrange",  false,  ITAG_COLOR_DARKBLUE,ITAG_COLOR_ORANGE),  //05
   iTag("ff:ff:10:7e:52:e0", "BlueBlack",    false,  ITAG_COLOR_DARKBLUE,  ITAG_COLOR_BLACK), //06
@@ -357,29 +567,181 @@ iTag iTags[ITAG_COUNT] = {
   iTag("ff:ff:10:82:ef:1e", "Green",   false, ITAG_COLOR_GREEN,   ITAG_COLOR_GREEN)   //17 Light green BT4
 };
 
-static void AddParticipantToGFX(uint32_t handleDB, participantData &participant,uint32_t col0, uint32_t col1)
+// Standings of all participants in the race, most laps first and on equal laps the one that
+// reached it first. Kept in an order statistics tree so a lap event only costs O(log n) to
+// re-rank and the position is found in O(log n), only the participant that moved is sent to
+// the GUI (MSG_GFX_STANDINGS_MOVE) as the rest keep their relative order.
+struct standingsKey
 {
-  msg_GFX msg;
-  msg.AddUser.header.msgType = MSG_GFX_ADD_USER;
-  msg.AddUser.handleDB = handleDB;
-  msg.AddUser.color0 = col0;
-  msg.AddUser.color1 = col1;
-  std::string name = participant.getName();
-  size_t len = name.copy(msg.AddUser.name, PARTICIPANT_NAME_LENGTH);
-  msg.AddUser.name[len] = '\0';
-  msg.AddUser.inRace = participant.getInRace();  
+  uint32_t laps;
+  int64_t lapStart; // ms since race start when laps was reached
+  uint32_t handleDB;
 
-  //ESP_LOGI(TAG,"Send: MSG_GFX_ADD_USER MSG:0x%" PRIx32 " handleDB:0x%08" PRIx32 " color:(0x%06" PRIx32 ",0x%06" PRIx32 ") Name:%s inRace:%" PRId32 "",
-  //             msg.AddUser.header.msgType, msg.AddUser.handleDB, msg.AddUser.color0, msg.AddUser.color1, msg.AddUser.name, msg.AddUser.inRace);
+  bool operator<(const standingsKey &other) const
+  {
+    if (laps != other.laps) {
+      return laps > other.laps;
+    }
+    if (lapStart != other.lapStart) {
+      return lapStart < other.lapStart;
+    }
+    return handleDB < other.handleDB;
+  }
+  bool operator==(const standingsKey &other) const
+  {
+    return laps == other.laps && lapStart == other.lapStart && handleDB == other.handleDB;
+  }
+};
 
-  BaseType_t xReturned = xQueueSend(queueGFX, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 2000 )); // TODO add resend ? if not participant.isHandleGFXValid() sometimes later
+class raceStandings {
+  public:
+    raceStandings()
+    {
+      for(int j=0; j<ITAG_COUNT; j++)
+      {
+        inStandings[j] = false;
+      }
+    }
+
+    // Call when laps, lap start or in race status of a participant might have changed
+    void update(uint32_t handleDB)
+    {
+      participantData &participant = iTags[handleDB].participant;
+      if (!participant.getInRace()) {
+        remove(handleDB);
+        return;
+      }
+      standingsKey key = {participant.getLapCount(), participant.getCurrentLapStart(), handleDB};
+      uint32_t oldPosition = UINT32_MAX;
+      if (inStandings[handleDB]) {
+        if (keys[handleDB] == key) {
+          return; // Nothing changed
+        }
+        oldPosition = order.order_of_key(keys[handleDB]);
+        order.erase(keys[handleDB]);
+      }
+      keys[handleDB] = key;
+      inStandings[handleDB] = true;
+      order.insert(key);
+      uint32_t position = order.order_of_key(key);
+      if (position != oldPosition) {
+        sendMove(handleDB, position);
+      }
+    }
+
+    void remove(uint32_t handleDB)
+    {
+      if (inStandings[handleDB]) {
+        order.erase(keys[handleDB]);
+        inStandings[handleDB] = false;
+      }
+    }
+
+    // Rebuild from scratch and send all positions, used when all laps are changed e.g. race start and load
+    void rebuild()
+    {
+      order.clear();
+      for(int j=0; j<ITAG_COUNT; j++)
+      {
+        inStandings[j] = false;
+      }
+      for(int j=0; j<ITAG_COUNT; j++)
+      {
+        participantData &participant = iTags[j].participant;
+        if (participant.getInRace()) {
+          keys[j] = {participant.getLapCount(), participant.getCurrentLapStart(), static_cast<uint32_t>(j)};
+          inStandings[j] = true;
+          order.insert(keys[j]);
+        }
+      }
+      // Send in position order so each row only moves to its final place
+      uint32_t position = 0;
+      for (const standingsKey &key : order) {
+        sendMove(key.handleDB, position++);
+      }
+    }
+
+    uint32_t getPosition(uint32_t handleDB)
+    {
+      if (!inStandings[handleDB]) {
+        return UINT32_MAX;
+      }
+      return order.order_of_key(keys[handleDB]);
+    }
+
+  private:
+    void sendMove(uint32_t handleDB, uint32_t position)
+    {
+      participantData &participant = iTags[handleDB].participant;
+      if (!participant.isHandleGFXValid()) {
+        return;
+      }
+      msg_GFX msg;
+      msg.StandingsMove.header.msgType = MSG_GFX_STANDINGS_MOVE;
+      msg.StandingsMove.handleGFX = participant.getHandleGFX();
+      msg.StandingsMove.position = position;
+      TRACE_BEGIN(TRACE_SEND_GFX, msg.header.msgType);
+      BaseType_t xReturned = xQueueSend(queueGFX, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 200 ));
+      TRACE_END(TRACE_SEND_GFX);
+      if (!xReturned) {
+        ESP_LOGW(TAG,"WARNING: Send: MSG_GFX_STANDINGS_MOVE %s to %" PRIu32 " could not be sent in 200ms", participant.getName().c_str(), position);
+      }
+    }
+
+    __gnu_pbds::tree<standingsKey, __gnu_pbds::null_type, std::less<standingsKey>,
+                     __gnu_pbds::rb_tree_tag, __gnu_pbds::tree_order_statistics_node_update> order;
+    standingsKey keys[ITAG_COUNT];
+    bool inStandings[ITAG_COUNT];
+};
+
+static raceStandings standings;
+
+// Register all participants in the GUI in one go and wait until all handleGFX are known,
+// this is done before the race is loaded so no updates are sent with an invalid handleGFX
+#define GFX_REGISTER_TIMEOUT 5000 // ms
+static participantRegistration registrations[ITAG_COUNT];
+
+static void RegisterParticipantsInGFX()
+{
+  for(uint32_t handleDB=0; handleDB<ITAG_COUNT; handleDB++)
+  {
+    // Use index into iTags as the "secret" handleDB
+    participantRegistration &reg = registrations[handleDB];
+    reg.handleDB = handleDB;
+    reg.color0 = iTags[handleDB].color0;
+    reg.color1 = iTags[handleDB].color1;
+    std::string name = iTags[handleDB].participant.getName();
+    size_t len = name.copy(reg.name, PARTICIPANT_NAME_LENGTH);
+    reg.name[len] = '\0';
+    reg.inRace = iTags[handleDB].participant.getInRace();
+    reg.handleGFX = UINT32_MAX;
+    reg.wasOK = false;
+  }
+
+  msg_GFX msg;
+  msg.AddUsers.header.msgType = MSG_GFX_ADD_USERS;
+  msg.AddUsers.participants = registrations;
+  msg.AddUsers.count = ITAG_COUNT;
+  msg.AddUsers.replyTask = xTaskGetCurrentTaskHandle();
+
+  BaseType_t xReturned = xQueueSend(queueGFX, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 2000 ));
   if (!xReturned) {
     // it it fails er are probably smoked
-    ESP_LOGE(TAG,"FATAL ERROR: Send: MSG_GFX_ADD_USER MSG:0x%" PRIx32 " handleDB:0x%08" PRIx32 " color:(0x%06" PRIx32 ",0x%06" PRIx32 ") Name:%s inRace:%d could not be sent in 2000ms. INITIAL SETUP ERROR",
-                 msg.AddUser.header.msgType, msg.AddUser.handleDB, msg.AddUser.color0, msg.AddUser.color1, msg.AddUser.name, msg.AddUser.inRace);
+    ESP_LOGE(TAG,"FATAL ERROR: Send: MSG_GFX_ADD_USERS count:%" PRIu32 " could not be sent in 2000ms. INITIAL SETUP ERROR", msg.AddUsers.count);
     ESP_LOGE(TAG,"----- esp_restart() -----");
     esp_restart();
   }
+
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GFX_REGISTER_TIMEOUT)) == 0) {
+    ESP_LOGE(TAG,"FATAL ERROR: MSG_GFX_ADD_USERS not handled by GUI in %dms. INITIAL SETUP ERROR", GFX_REGISTER_TIMEOUT);
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
+  }
+
+  for(uint32_t handleDB=0; handleDB<ITAG_COUNT; handleDB++)
+  {
+    iTags[handleDB].participant.setHandleGFX(registrations[handleDB].handleGFX, registrations[handleDB].wasOK);
+  }
 }
 
 bool iTag::UpdateParticipantInGFX()
@@ -414,35 +776,34 @@ bool iTag::UpdateParticipantStatusInGUI()
     msg.UpdateStatus.header.msgType = MSG_GFX_UPDATE_USER_STATUS;
     msg.UpdateStatus.handleGFX = participant.getHandleGFX();
 
-    if (active)
-    {
-      if (connected) {
-        if (participant.getTimeSinceLastSeen() < 20) {
-          msg.UpdateStatus.connectionStatus = getRSSI();
-        }
-        else {
-          msg.UpdateStatus.connectionStatus = 1;
-        }
+    // connected is set on the owner when any of the participants tags is seen
+    if (connected) {
+      if (participant.getTimeSinceLastSeen() < 20) {
+        msg.UpdateStatus.connectionStatus = getRSSI();
       }
       else {
-          msg.UpdateStatus.connectionStatus = 0;
+        msg.UpdateStatus.connectionStatus = 1;
       }
     }
     else {
-          msg.UpdateStatus.connectionStatus = 0;
+        msg.UpdateStatus.connectionStatus = 0;
     }
 
     msg.UpdateStatus.battery = battery;
+    msg.UpdateStatus.batteryHoursLeft = getBatteryHoursLeft();
+    msg.UpdateStatus.batteryLow = isBatteryLow(theRace.getNow());
     msg.UpdateStatus.inRace = participant.getInRace();
 
     //ESP_LOGI(TAG,"Send MSG_GFX_UPDATE_USER_STATUS: MSG:0x%" PRIx32 " handleGFX:0x%08" PRIx32 " connectionStatus:%" PRId32 " battery:%" PRId32 " inRace:%d",
     //            msg.UpdateStatus.header.msgType, msg.UpdateStatus.handleGFX, msg.UpdateStatus.connectionStatus, msg.UpdateStatus.battery, msg.UpdateStatus.inRace);
 
+    TRACE_BEGIN(TRACE_SEND_GFX, msg.header.msgType);
     BaseType_t xReturned = xQueueSend(queueGFX, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 200 )); // TODO add resend ?
+    TRACE_END(TRACE_SEND_GFX);
     return xReturned;
   }
   else {
-  // TODO ERROR maybe redo AddParticipantToGFX()
+  // TODO ERROR maybe redo RegisterParticipantsInGFX()
     return false;
   }
   return true;
@@ -460,49 +821,163 @@ bool iTag::UpdateParticipantStatsInGUI()
 
     msg.UpdateUserData.distance = participant.getLapCount() * theRace.getLapDistance();
     msg.UpdateUserData.laps = participant.getLapCount();
-    msg.UpdateUserData.lastLapTime = participant.getCurrentLapStart();
-    msg.UpdateUserData.lastSeenTime = participant.getCurrentLastSeenSinceRaceStart();
-    if (active)
-    {
-      if (connected) {
-        if (participant.getTimeSinceLastSeen() < 20) {
-          msg.UpdateUserData.connectionStatus = getRSSI();
-        }
-        else {
-          msg.UpdateUserData.connectionStatus = 1;
-        }
+    msg.UpdateUserData.lastLapTimeMs = participant.getCurrentLapStart();
+    msg.UpdateUserData.lastSeenTimeMs = participant.getCurrentLastSeenSinceRaceStart();
+    if (connected) {
+      if (participant.getTimeSinceLastSeen() < 20) {
+        msg.UpdateUserData.connectionStatus = getRSSI();
       }
       else {
-          msg.UpdateUserData.connectionStatus = 0;
+        msg.UpdateUserData.connectionStatus = 1;
       }
     }
     else {
-          msg.UpdateUserData.connectionStatus = 0;
+        msg.UpdateUserData.connectionStatus = 0;
     }
     msg.UpdateUserData.inRace = participant.getInRace();
     //ESP_LOGI(TAG,"Send MSG_GFX_UPDATE_USER_DATA: MSG:0x%" PRIx32 " handleGFX:0x%08" PRIx32 " distance:%" PRId32 " laps:%" PRId32 " lastlaptime:%" PRId32 " connectionStatus:%" PRId32 "",
     //            msg.UpdateUserData.header.msgType, msg.UpdateUserData.handleGFX, msg.UpdateUserData.distance, msg.UpdateUserData.laps,
     //            msg.UpdateUserData.lastLapTime, msg.UpdateUserData.connectionStatus);
 
+    TRACE_BEGIN(TRACE_SEND_GFX, msg.header.msgType);
     BaseType_t xReturned = xQueueSend(queueGFX, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 200 )); // TODO add resend ?
+    TRACE_END(TRACE_SEND_GFX);
+    UpdateParticipantLapStatsInGUI();
     return xReturned;
   }
   else {
-  // TODO ERROR maybe redo AddParticipantToGFX()
+  // TODO ERROR maybe redo RegisterParticipantsInGFX()
     return false;
   }
   return true;
 }
 
-iTag::iTag(std::string inAddress, std::string inName, bool isInRace, uint32_t inColor0, uint32_t inColor1)
+// Goal when nothing is saved, only the participant shown in the graph gets one
+static uint32_t defaultGoal(uint32_t handleDB)
+{
+  return (handleDB == DEFAULT_PARTICIPANT) ? DEFAULT_PARTICIPANT_GOAL : 0;
+}
+
+// Goal plan distance (m) at timeMs since race start, linear up to GOAL_HALFTIME_SHARE of
+// the goal at half time and then linear up to the goal at maxTimeMs
+static double goalPlanDistance(uint32_t goal, int64_t timeMs, int64_t maxTimeMs)
+{
+  int64_t halfTimeMs = maxTimeMs / 2;
+  double halfGoal = GOAL_HALFTIME_SHARE * goal;
+  if (halfTimeMs <= 0 || timeMs >= maxTimeMs) {
+    return goal;
+  }
+  if (timeMs < halfTimeMs) {
+    return halfGoal * timeMs / halfTimeMs;
+  }
+  return halfGoal + (goal - halfGoal) * (timeMs - halfTimeMs) / (maxTimeMs - halfTimeMs);
+}
+
+// Pace (s/km) needed from timeMs/dist to reach the next goal checkpoint, the half time one
+// if we are before half time and not already past it, otherwise the goal at maxTimeMs
+static uint32_t goalPlanPace(uint32_t goal, double dist, int64_t timeMs, int64_t maxTimeMs)
+{
+  int64_t halfTimeMs = maxTimeMs / 2;
+  double halfGoal = GOAL_HALFTIME_SHARE * goal;
+  int64_t timeLeftMs;
+  double distLeft;
+  if (timeMs < halfTimeMs && dist < halfGoal) {
+    timeLeftMs = halfTimeMs - timeMs;
+    distLeft = halfGoal - dist;
+  }
+  else {
+    timeLeftMs = maxTimeMs - timeMs;
+    distLeft = goal - dist;
+  }
+  if (timeLeftMs <= 0) {
+    return 0;
+  }
+  if (distLeft < 1.0) distLeft = 1.0; //division protection
+  return timeLeftMs / distLeft; // ms/m is s/km
+}
+
+bool iTag::UpdateParticipantLapStatsInGUI()
+{
+  if(!participant.isHandleGFXValid()) {
+    return false;
+  }
+  uint32_t laps = participant.getLapCount();
+  int64_t lapStart = participant.getCurrentLapStart();
+  if (laps == lapStatsSentLaps && lapStart == lapStatsSentLapStart) {
+    return true; // Nothing new
+  }
+
+  msg_GFX msg;
+  msg.UpdateLapStats.header.msgType = MSG_GFX_UPDATE_USER_STATS;
+  msg.UpdateLapStats.handleGFX = participant.getHandleGFX();
+  msg.UpdateLapStats.laps = laps;
+  msg.UpdateLapStats.lastLapTime = participant.getLastLapTime();
+  msg.UpdateLapStats.bestLapTime = participant.getBestLapTime();
+  msg.UpdateLapStats.averageLapTime = participant.getAverageLapTime();
+  msg.UpdateLapStats.lastNLapTime = participant.getLastNAverageLapTime();
+
+  double lapDistance = theRace.getLapDistance();
+  int64_t lastNLapTime = msg.UpdateLapStats.lastNLapTime;
+  msg.UpdateLapStats.averagePace = 0;
+  msg.UpdateLapStats.currentPace = 0;
+  msg.UpdateLapStats.projectedDistance = laps * lapDistance;
+  msg.UpdateLapStats.projectedFinishTime = 0;
+  if (lapDistance > 0.0 && lastNLapTime > 0) {
+    // ms per lap / lapDistance in m is s/km
+    msg.UpdateLapStats.averagePace = msg.UpdateLapStats.averageLapTime / lapDistance;
+    msg.UpdateLapStats.currentPace = lastNLapTime / lapDistance;
+
+    int64_t maxTimeMs = static_cast<int64_t>(theRace.getMaxTime()) * 60 * 60 * 1000;
+    if (maxTimeMs > lapStart) {
+      msg.UpdateLapStats.projectedDistance += (maxTimeMs - lapStart) * lapDistance / lastNLapTime;
+    }
+    uint32_t raceLaps = theRace.getLaps();
+    if (!theRace.isTimeBasedRace() && raceLaps > laps) {
+      msg.UpdateLapStats.projectedFinishTime = lapStart + (raceLaps - laps) * lastNLapTime;
+    }
+  }
+
+  uint32_t goal = participant.getGoal();
+  msg.UpdateLapStats.goal = goal;
+  msg.UpdateLapStats.goalAhead = 0;
+  msg.UpdateLapStats.goalPace = 0;
+  if (goal > 0) {
+    int64_t maxTimeMs = static_cast<int64_t>(theRace.getMaxTime()) * 60 * 60 * 1000;
+    double dist = laps * lapDistance;
+    msg.UpdateLapStats.goalAhead = dist - goalPlanDistance(goal, lapStart, maxTimeMs);
+    msg.UpdateLapStats.goalPace = goalPlanPace(goal, dist, lapStart, maxTimeMs);
+  }
+
+  TRACE_BEGIN(TRACE_SEND_GFX, msg.header.msgType);
+  BaseType_t xReturned = xQueueSend(queueGFX, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 200 )); // TODO add resend ?
+  TRACE_END(TRACE_SEND_GFX);
+  if (xReturned) {
+    lapStatsSentLaps = laps;
+    lapStatsSentLapStart = lapStart;
+  }
+  return xReturned;
+}
+
+iTag::iTag(std::string inAddress, std::string inName, bool isInRace, uint32_t inColor0, uint32_t inColor1, int inOwner)
 {
   address = inAddress;
   color0 = inColor0;
   color1 = inColor1;
   battery = -1; //Unknown or Not read yet
+  batteryTime = 0;
+  batteryPollTime = 0;
+  batteryReadPending = false;
+  batteryTrendStart = -1;
+  batteryTrendStartTime = 0;
   RSSI = -9999;
   active = false;
   connected = false;
+  owner = inOwner;
+  lastDetectionTimeMs = 0;
+  lastDetectionReceiver = RECEIVER_ID_LOCAL;
+  lastDetectionRSSI = INT8_MIN;
+  lapStatsSentLaps = UINT32_MAX;
+  lapStatsSentLapStart = 0;
 
   // TODO make sure string is shorter then PARTICIPANT_NAME_LENGTH
   participant.setName(inName);
@@ -522,6 +997,153 @@ void iTag::reset()
   }
 }
 
+// Make sure all owners are valid, a tag without owner is its own and owners must be their own owner (no chains)
+static void validateTagOwners()
+{
+  for(int j=0; j<ITAG_COUNT; j++)
+  {
+    if (iTags[j].owner < 0 || iTags[j].owner >= ITAG_COUNT) {
+      iTags[j].owner = j;
+    }
+  }
+  for(int j=0; j<ITAG_COUNT; j++)
+  {
+    int owner = iTags[j].owner;
+    if (iTags[owner].owner != owner) {
+      ESP_LOGW(TAG,"Tag %d owner %d is carried by %d, only one level is supported. Tag %d is now its own", j, owner, iTags[owner].owner, j);
+      iTags[j].owner = j;
+    }
+    else if (owner != j) {
+      ESP_LOGI(TAG,"Tag %d %s is carried by %d %s", j, iTags[j].participant.getName().c_str(), owner, iTags[owner].participant.getName().c_str());
+    }
+  }
+}
+
+// When more then one receiver (see scannerLink.h) hears the same advertisement only the strongest is used,
+// a weaker detection from another receiver close in time is dropped.
+bool iTag::isDuplicateDetection(msg_iTagDetected &detection)
+{
+  int64_t diff = detection.timeMs - lastDetectionTimeMs;
+  if (detection.receiverId != lastDetectionReceiver &&
+      diff >= -RECEIVER_DEDUP_TIME && diff <= RECEIVER_DEDUP_TIME &&
+      detection.RSSI <= lastDetectionRSSI) {
+    return true;
+  }
+  lastDetectionTimeMs = detection.timeMs;
+  lastDetectionReceiver = detection.receiverId;
+  lastDetectionRSSI = detection.RSSI;
+  return false;
+}
+
+void iTag::updateBattery(int8_t newBattery, time_t now)
+{
+  if (newBattery < 0 || newBattery > 100) {
+    return; // INT8_MIN when not read
+  }
+  battery = newBattery;
+  batteryTime = now;
+  if (batteryTrendStart < 0 || battery > batteryTrendStart) {
+    // First reading or battery was replaced/recovered, restart the trend from here
+    batteryTrendStart = battery;
+    batteryTrendStartTime = now;
+  }
+}
+
+// Linear estimate from the drain since batteryTrendStart, -1 if unknown
+int16_t iTag::getBatteryHoursLeft()
+{
+  if (battery < 0 || batteryTrendStart < 0) {
+    return -1;
+  }
+  int64_t trendTime = batteryTime - batteryTrendStartTime;
+  int32_t drained = batteryTrendStart - battery;
+  if (trendTime < BATTERY_TREND_MIN_TIME || drained <= 0) {
+    return -1;
+  }
+  int64_t hoursLeft = (static_cast<int64_t>(battery) * trendTime) / (static_cast<int64_t>(drained) * 60 * 60);
+  return static_cast<int16_t>(std::min(hoursLeft, static_cast<int64_t>(999)));
+}
+
+bool iTag::isBatteryLow(time_t now)
+{
+  if (battery < 0) {
+    return false; // Unknown
+  }
+  if (battery <= BATTERY_LOW_LEVEL) {
+    return true;
+  }
+  int16_t hoursLeft = getBatteryHoursLeft();
+  if (hoursLeft >= 0 && theRace.isRaceOngoing()) {
+    time_t raceEnd = theRace.getRaceStart() + theRace.getMaxTime()*60*60;
+    time_t hoursLeftInRace = (raceEnd - now + 60*60 - 1)/(60*60);
+    return hoursLeft < hoursLeftInRace;
+  }
+  return false;
+}
+
+// Called when tagIndex is detected e.g. it is in range, if it is time to refresh it's battery level
+// and no one is expected near the unit ask the BT task to read it.
+static void pollBatteryWhenIdle(int tagIndex, uint64_t address, time_t now)
+{
+  static time_t lastBatteryPoll = 0;
+  iTag &tag = iTags[tagIndex];
+
+  if (!tag.active) {
+    return;
+  }
+  if (tag.batteryReadPending && (now - tag.batteryPollTime) < BATTERY_POLL_RETRY) {
+    return; // Wait for answer (if it got lost we retry)
+  }
+  if ((now - tag.batteryPollTime) < BATTERY_POLL_INTERVAL) {
+    return; // Still fresh
+  }
+  if ((now - lastBatteryPoll) < BATTERY_POLL_RATE_LIMIT) {
+    return;
+  }
+  if (uxQueueMessagesWaiting(queueBTConnect) > 0) {
+    return; // BT task is busy configuring tags
+  }
+
+  if (theRace.isRaceOngoing()) {
+    int64_t timeFromRaceStartMs = static_cast<int64_t>(now - theRace.getRaceStart()) * 1000;
+    for(int j=0; j<ITAG_COUNT; j++)
+    {
+      if (!iTags[j].participant.getInRace()) {
+        continue;
+      }
+      participantData &participant = iTags[j].participant;
+      if ((timeFromRaceStartMs - participant.getCurrentLapFirstDetected()) <= theRace.getUpdateCloserTime()*1000) {
+        return; // Someone is passing right now and lap time is still being decided
+      }
+      uint32_t laps = participant.getLapCount();
+      if (laps >= 1) {
+        // Assume this lap takes as long as the last one
+        int64_t lastLapTimeMs = participant.getLap(laps).getLapStart() - participant.getLap(laps-1).getLapStart();
+        int64_t expectedArrivalMs = participant.getCurrentLapStart() + lastLapTimeMs;
+        int64_t diffMs = timeFromRaceStartMs - expectedArrivalMs;
+        if (diffMs > -BATTERY_POLL_GUARD*1000 && diffMs < BATTERY_POLL_GUARD*1000) {
+          return;
+        }
+      }
+    }
+  }
+
+  msg_iTagDetected msg;
+  msg.header.msgType = MSG_ITAG_READ_BATTERY;
+  msg.timeMs = static_cast<int64_t>(now) * 1000;
+  msg.address = address;
+  msg.RSSI = tag.getRSSI();
+  msg.battery = INT8_MIN;
+  msg.receiverId = RECEIVER_ID_LOCAL;
+  BaseType_t xReturned = xQueueSend(queueBTConnect, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 0 )); //Don't wait, just retry next time we see the tag
+  if (xReturned) {
+    ESP_LOGI(TAG,"%s Read battery", tag.participant.getName().c_str());
+    lastBatteryPoll = now;
+    tag.batteryPollTime = now;
+    tag.batteryReadPending = true;
+  }
+}
+
 static void raceCleariTags()
 {
   theRace.setRaceStart(0);
@@ -533,6 +1155,7 @@ static void raceCleariTags()
     iTags[j].participant.setUpdated();
   }
   refreshTagGUI();
+  standings.rebuild();
 }
 
 
@@ -548,6 +1171,7 @@ static void raceStartiTags(time_t raceStartTime)
     iTags[j].participant.setUpdated();
   }
   refreshTagGUI();
+  standings.rebuild();
   saveRace(); // Queue up a MSG_ITAG_SAVE_RACE
 }
 
@@ -565,20 +1189,19 @@ static void raceContinueiTags()
 
 void refreshTagGUI()
 {
+  TRACE_SCOPE(TRACE_REFRESH_TAG_GUI, 0);
 //  ESP_LOGI(TAG,"----- Active tags: -----");
+  int64_t timeFromRaceStartMs = theRace.getTimeSinceStartMs();
   for(int j=0; j<ITAG_COUNT; j++)
   {
-    if (iTags[j].active && iTags[j].connected) {
+    if (iTags[j].connected) {
       // Check if "long time no see" and "disconnect"
-      tm timeNow = rtc.getTimeStruct();
-      time_t timeNowfromEpoc = mktime(&timeNow);
-      time_t timeFromRaceStart = difftime(timeNowfromEpoc, theRace.getRaceStart());      
-      time_t lastSeenSinceStart = iTags[j].participant.getCurrentLapStart() + iTags[j].participant.getCurrentLastSeen();
-      uint32_t timeSinceLastSeen = difftime( timeFromRaceStart, lastSeenSinceStart);
+      int64_t lastSeenSinceStartMs = iTags[j].participant.getCurrentLastSeenSinceRaceStart();
+      uint32_t timeSinceLastSeen = std::max(timeFromRaceStartMs - lastSeenSinceStartMs, static_cast<int64_t>(0)) / 1000;
       iTags[j].participant.setTimeSinceLastSeen(timeSinceLastSeen);
 
       if (timeSinceLastSeen > theRace.getBlockNewLapTime()) {
-        ESP_LOGI(TAG,"%s Disconnected Time: %s delta %d timeSinceLastSeen: %d", iTags[j].address.c_str(),rtc.getTime("%Y-%m-%d %H:%M:%S").c_str(),iTags[j].participant.getTimeSinceLastSeen(),timeSinceLastSeen);
+        DLOGI(TAG,"%s Disconnected Time: %s delta %d timeSinceLastSeen: %d", iTags[j].address.c_str(),deferredLogTime{timebaseNowMs()},iTags[j].participant.getTimeSinceLastSeen(),timeSinceLastSeen);
         iTags[j].connected = false;
       }
       iTags[j].participant.setUpdated();
@@ -637,6 +1260,38 @@ static void checkDisk()
   ESP_LOGI(TAG,"-----------------------------");
 }
 
+// All JSON documents of the race/config files allocate with this so the memory is
+// charged to HEAP_PERSISTENCE, see heapStats.h
+class persistenceAllocator : public ArduinoJson::Allocator {
+  public:
+    void* allocate(size_t size) override
+    {
+      void *ptr = malloc(size);
+      if (ptr) {
+        heapTrackAlloc(HEAP_PERSISTENCE, heap_caps_get_allocated_size(ptr));
+      }
+      return ptr;
+    }
+    void deallocate(void* ptr) override
+    {
+      if (ptr) {
+        heapTrackFree(HEAP_PERSISTENCE, heap_caps_get_allocated_size(ptr));
+      }
+      free(ptr);
+    }
+    void* reallocate(void* ptr, size_t newSize) override
+    {
+      size_t oldSize = ptr ? heap_caps_get_allocated_size(ptr) : 0;
+      void *newPtr = realloc(ptr, newSize);
+      if (newPtr) {
+        heapTrackFree(HEAP_PERSISTENCE, oldSize);
+        heapTrackAlloc(HEAP_PERSISTENCE, heap_caps_get_allocated_size(newPtr));
+      }
+      return newPtr;
+    }
+};
+static persistenceAllocator jsonAllocator;
+
 static void DBloadGlobalConfig()
 {
   std::string fileName = std::string("/CrazyCapyTime.json");
@@ -649,7 +1304,7 @@ static void DBloadGlobalConfig()
     return;
   }
 
-  DynamicJsonDocument raceJson(50000);
+  JsonDocument raceJson(&jsonAllocator);
   DeserializationError err = deserializeJson(raceJson, raceFile);
   raceFile.close();
   if (err) {
@@ -677,7 +1332,7 @@ static void DBloadGlobalConfig()
 
 static void DBsaveGlobalConfig()
 {
-  DynamicJsonDocument raceJson(50000);
+  JsonDocument raceJson(&jsonAllocator);
   raceJson["Appname"] = "CrazyCapyTime";
   raceJson["filetype"] = "globalconfig";
   raceJson["fileformatversion"] = "0.1";
@@ -696,7 +1351,19 @@ static void DBsaveGlobalConfig()
 }
 
 
-static void DBloadRace()
+// Lap times are saved in ms since fileformatversion 0.4, older files have seconds
+static int64_t DBloadLapTimeMs(JsonObject lapJson, const char *keyMs, const char *keySeconds)
+{
+  if (lapJson[keyMs].is<int64_t>()) {
+    return lapJson[keyMs].as<int64_t>();
+  }
+  int64_t seconds = lapJson[keySeconds] | static_cast<int64_t>(0);
+  return seconds * 1000;
+}
+
+// Read and parse the race file, nothing is changed or sent to the GUI so this can be done
+// at boot while the GUI is created
+static bool DBreadRaceFile(JsonDocument &raceJson)
 {
   uint64_t start_time = micros();
 
@@ -706,25 +1373,34 @@ static void DBloadRace()
   if (!raceFile) {
     ESP_LOGE(TAG,"ERROR: LittleFS open(%s) for read failed",fileName.c_str());
     checkDisk(); // just for debug
-    return;
+    return false;
   }
 
-  DynamicJsonDocument raceJson(50000);  // TODO verify with a maximum Tags/Laps file
   DeserializationError err = deserializeJson(raceJson, raceFile);
   raceFile.close();
   if (err) {
     ESP_LOGE(TAG,"ERROR: deserializeJson() failed with code %s",err.c_str());
     checkDisk(); // just for debug
-    return;
+    return false;
   }
-  
+  uint64_t stop_time = micros();
+  uint32_t tot_time = stop_time - start_time;
+  ESP_LOGI(TAG,"Read race %s time %d us", fileName.c_str(),tot_time );
+  return true;
+}
+
+// Setup race and all participants from a parsed race file and send it all to the GUI
+static void DBapplyRace(JsonDocument &raceJson)
+{
+  uint64_t start_time = micros();
+
   //String output = "";
   //serializeJsonPretty(raceJson, output);
   //ESP_LOGI(TAG,"Loaded json:\n%s", output.c_str());
   std::string version = raceJson["fileformatversion"].as<std::string>();
 
-  if ( ! (version == "0.3")) {
-    ESP_LOGE(TAG,"LoadRace ERROR fileformatversion=%s != 0.3 (NOK) Try anyway JSON is kind of build for this.",version.c_str());
+  if ( ! (version == "0.4" || version == "0.3")) {
+    ESP_LOGE(TAG,"LoadRace ERROR fileformatversion=%s != 0.4 (NOK) Try anyway JSON is kind of build for this.",version.c_str());
   }
   //ESP_LOGI(TAG,"fileformatversion=%s (OK)",version.c_str());
 
@@ -756,10 +1432,9 @@ static void DBloadRace()
 
   theRace.setRaceStart(raceStart);
   theRace.setRaceOngoing(raceOngoing);
-  if (raceStart > rtc.getEpoch()) {
-    // If our clock is older the race jump to that time
-    ESP_LOGW(TAG,"LoadRace WARNING race time is after NOW faking a timejump to race time by force");
-    rtc.setTime(raceStart,0);
+  if (raceStart > theRace.getNow()) {
+    // Our clock is older then the race, e.g. saved while running on a test clock, race time is negative until we get there
+    ESP_LOGW(TAG,"LoadRace WARNING race start is %" PRId64 " s after NOW, check the clock",static_cast<int64_t>(raceStart - theRace.getNow()));
   }
 
 
@@ -800,22 +1475,27 @@ static void DBloadRace()
     uint32_t tagColor0 = tagJson["color0"] | 0;
     uint32_t tagColor1 = tagJson["color1"] | 0;
     //bool tagActive = tagJson["active"] | false;
+    int tagOwner = tagJson["owner"] | iTags[i].owner; // Older files keep the default mapping
 
     JsonObject participantJson = tagJson["participant"];
     std::string participantName = participantJson["name"].as<std::string>();
     //uint32_t participantLaps = participantJson["laps"] | 0;
     uint32_t participantTimeSinceLastSeen = participantJson["timeSinceLastSeen"] | 0;
     bool participantInRace = participantJson["inRace"] | false;
+    uint32_t participantGoal = participantJson["goal"] | defaultGoal(i);
 
     // ...existing code...
     iTags[i].address = tagAddress;
     iTags[i].color0 = tagColor0;
     iTags[i].color1 = tagColor1;
+    iTags[i].owner = tagOwner;
     //iTags[i].active = tagActive;
     iTags[i].participant.setName(participantName);
     //iTags[i].participant.set (participantLaps); //will be handled by the lap loop
     iTags[i].participant.setTimeSinceLastSeen(participantTimeSinceLastSeen);
     iTags[i].participant.setInRace(participantInRace); //TOD do not update correctly
+    iTags[i].participant.setGoal(participantGoal);
+    iTags[i].invalidateLapStats();
     iTags[i].participant.clearLaps();
     iTags[i].participant.setUpdated(); // TODO triger resend of name and tag color also
 
@@ -831,8 +1511,8 @@ static void DBloadRace()
           // No more laps saved
           break;
         }
-        time_t lapStart = lapJson["StartTime"] | 0;
-        time_t lapLastSeen = lapJson["LastSeen"] | 0;
+        int64_t lapStart = DBloadLapTimeMs(lapJson, "StartTimeMs", "StartTime");
+        int64_t lapLastSeen = DBloadLapTimeMs(lapJson, "LastSeenMs", "LastSeen");
         if (lap==0) {
           iTags[i].participant.setCurrentLap(lapStart,lapLastSeen);
         }
@@ -851,14 +1531,13 @@ static void DBloadRace()
           // No more laps saved
           break;
         }
-        time_t lapStart = lapJson["StartTime"] | 0;  // -> iTags[i].participant.getLap(lap).getLapStart();
-        time_t lapLastSeen = lapJson["LastSeen"] | 0;// -> iTags[i].participant.getLap(lap).getLastSeen();
-        unsigned long now = rtc.getEpoch();
-
-        if ((raceStart+lapStart+lapLastSeen) > now) {
-          // If our clock is older the lapLastSeen jump to that time
-          ESP_LOGW(TAG,"LoadRace WARNING race lapLastSeen is after NOW by %" PRId64 " s faking a timejump to race time by force",(raceStart+lapStart+lapLastSeen) - now);
-          rtc.setTime((raceStart+lapStart+lapLastSeen),0);
+        int64_t lapStart = DBloadLapTimeMs(lapJson, "StartTimeMs", "StartTime");  // -> iTags[i].participant.getLap(lap).getLapStart();
+        int64_t lapLastSeen = DBloadLapTimeMs(lapJson, "LastSeenMs", "LastSeen");// -> iTags[i].participant.getLap(lap).getLastSeen();
+        time_t now = theRace.getNow();
+        time_t lastSeenEpoch = raceStart + (lapStart + lapLastSeen + 999) / 1000;
+
+        if (lastSeenEpoch > now) {
+          ESP_LOGW(TAG,"LoadRace WARNING race lapLastSeen is after NOW by %" PRId64 " s, check the clock",static_cast<int64_t>(lastSeenEpoch - now));
         }
 
         //ESP_LOGI(TAG,"         lap[%4d] StartTime:%8d, lastSeen:%8d",lap,lapStart,lapLastSeen);
@@ -872,10 +1551,11 @@ static void DBloadRace()
       }
     }
   }
+  validateTagOwners();
+  standings.rebuild();
   uint64_t stop_time = micros();
   uint32_t tot_time = stop_time - start_time;
-  ESP_LOGI(TAG,"Loaded race as %s time %d us", fileName.c_str(),tot_time );
-  delay(20);
+  ESP_LOGI(TAG,"Loaded race %s time %d us", name.c_str(),tot_time );
   if (theRace.isRaceOngoing()) {
     // Load race was in started state
     ESP_LOGI(TAG,"Loaded race was started when saved");
@@ -884,15 +1564,24 @@ static void DBloadRace()
   }
 }
 
+static void DBloadRace()
+{
+  JsonDocument raceJson(&jsonAllocator);
+  if (DBreadRaceFile(raceJson)) {
+    DBapplyRace(raceJson);
+  }
+}
+
 static void DBsaveRace()
 {
+  TRACE_SCOPE(TRACE_DB_SAVE_RACE, 0);
   delay(20);
   uint64_t start_time = micros();
-  DynamicJsonDocument raceJson(50000); // TODO verify with a maximum Tags/Laps file
+  JsonDocument raceJson(&jsonAllocator);
 
   raceJson["Appname"] = "CrazyCapyTime";
   raceJson["filetype"] = "racedata";
-  raceJson["fileformatversion"] = "0.3";
+  raceJson["fileformatversion"] = "0.4";
   raceJson["racename"] = theRace.getName();
   raceJson["raceTimeBased"] = theRace.isTimeBasedRace();
   raceJson["raceMaxTime"] = theRace.getMaxTime();
@@ -914,18 +1603,20 @@ static void DBsaveRace()
     tagJson["color0"] = iTags[i].color0;
     tagJson["color1"] = iTags[i].color1;
     tagJson["active"] = iTags[i].active;
+    tagJson["owner"] = iTags[i].owner;
     JsonObject participantJson = tagJson.createNestedObject("participant");
     participantJson["name"] = iTags[i].participant.getName();
     participantJson["laps"] = iTags[i].participant.getLapCount();
     participantJson["timeSinceLastSeen"] = iTags[i].participant.getTimeSinceLastSeen();
     participantJson["inRace"] = iTags[i].participant.getInRace();
+    participantJson["goal"] = iTags[i].participant.getGoal();
 
     JsonArray lapArrayJson = participantJson.createNestedArray("laps");
     for(int lap=0; lap<=iTags[i].participant.getLapCount(); lap++)
     {
       JsonObject lapJson = lapArrayJson.createNestedObject();
-      lapJson["StartTime"] = iTags[i].participant.getLap(lap).getLapStart();
-      lapJson["LastSeen"] = iTags[i].participant.getLap(lap).getLastSeen();
+      lapJson["StartTimeMs"] = iTags[i].participant.getLap(lap).getLapStart();
+      lapJson["LastSeenMs"] = iTags[i].participant.getLap(lap).getLastSeen();
     }
   }
 
@@ -958,31 +1649,59 @@ void vTaskRaceDB( void *pvParameters )
   */
   //configASSERT( ( ( uint32_t ) pvParameters ) == 2 );
 
-  // Add all Participants in race to race page
-  for(int handleDB=0; handleDB<ITAG_COUNT; handleDB++)
-  {
-    // Add Participand to GUI tabs
-    // Use index into iTags as the "secret" handleDB
-    AddParticipantToGFX(handleDB, iTags[handleDB].participant,iTags[handleDB].color0,iTags[handleDB].color1); 
-  }
+  // This runs in parallel with the GUI creation and the BT init, see boot.h
+  uint32_t stage = bootStageStart("LittleFS");
+  initLittleFS();
+  bootStageDone(stage);
 
   ESP_LOGI(TAG,"Setup Race");
-  DBloadGlobalConfig();
-  DBloadRace();
+  {
+    // Parsed race file is kept until the GUI and clock are ready, then freed
+    stage = bootStageStart("Read race");
+    validateTagOwners();
+    for(uint32_t handleDB=0; handleDB<ITAG_COUNT; handleDB++) {
+      iTags[handleDB].participant.setGoal(defaultGoal(handleDB)); // Kept if there is no race file
+    }
+    DBloadGlobalConfig();
+    JsonDocument raceJson(&jsonAllocator);
+    bool raceRead = DBreadRaceFile(raceJson);
+    bootStageDone(stage);
+
+    // Add all Participants to the GUI tabs
+    bootWaitFor(BOOT_GUI_READY, "RaceDB");
+    stage = bootStageStart("Register GUI");
+    RegisterParticipantsInGFX();
+    bootStageDone(stage);
+
+    bootWaitFor(BOOT_RTC_READY, "RaceDB");
+    stage = bootStageStart("Apply race");
+    theRace.tick();
+    if (raceRead) {
+      DBapplyRace(raceJson);
+    }
+    bootStageDone(stage);
+  }
 
   // Send Race setup to GUI
   ESP_LOGI(TAG,"Send Race to GUI");
   theRace.send_ConfigMsg(queueGFX);
 
-  int lastAutoSaveMinute = rtc.getMinute();
+  int lastAutoSaveMinute = theRace.getNowMinute();
   bool autoSaveTainted = false;
 
+  ESP_LOGI(TAG,"RaceDB ready, counting laps");
+  bootReport();
+
 
   for( ;; )
   {
     msg_RaceDB msg;
     if( xQueueReceive(queueRaceDB, &(msg), (TickType_t)portMAX_DELAY) == pdPASS)
     {
+      HEAP_TRACK_SCOPE(HEAP_RACEDB);
+      TRACE_SCOPE(TRACE_RACEDB_MSG, msg.header.msgType);
+      TRACE_COUNTER(TRACE_RACEDB_QUEUED, uxQueueMessagesWaiting(queueRaceDB));
+      theRace.tick();
       switch(msg.header.msgType) {
         case MSG_ITAG_DETECTED:
         {
@@ -996,10 +1715,16 @@ void vTaskRaceDB( void *pvParameters )
             if (strcasecmp(bleAddress.c_str(), iTags[j].address.c_str()) == 0) {
               //ESP_LOGI(TAG,"Scaning iTAGs MATCH: %s",bleAddress.c_str());
               found = true;
+              int tagIndex = j; // The physical tag, j is the owner below
+
+              if (iTags[tagIndex].isDuplicateDetection(msg.iTag)) {
+                //ESP_LOGI(TAG,"%s Duplicate from receiver %d dropped", iTags[tagIndex].participant.getName().c_str(), msg.iTag.receiverId);
+                break;
+              }
 
               // First check if TAG needs to be configurated (to not beep when out of range)
               if (!iTags[j].active) {
-                ESP_LOGI(TAG,"%s Activate Time: %s", iTags[j].participant.getName().c_str(),rtc.getTime("%Y-%m-%d %H:%M:%S").c_str());                
+                DLOGI(TAG,"%s Activate Time: %s", iTags[j].participant.getName().c_str(),deferredLogTime{msg.iTag.timeMs});
                 // TODO we should not rely on this struct being the same as MSG_ITAG_DETECTED and it should probably be a new struct
                 msg.iTag.header.msgType = MSG_ITAG_CONFIG;
                 BaseType_t xReturned = xQueueSend(queueBTConnect, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 0 )); //Don't wait if queue is full, just retry next time we scan the tag
@@ -1010,38 +1735,32 @@ void vTaskRaceDB( void *pvParameters )
                 }
               }
 
-#ifdef ALL_TAGS_TRIGGER_DEFAULT_PARTICIPANT
-              // Override and always trigger this participant -> one man race mode use all TAGs
+              // Feed the detection to the participant carrying the tag, all tags of a participant
+              // share the same lap decision and RSSI peak estimation.
               // This is done AFTER check for MSG_ITAG_CONFIG is sent to ensure every tag is configurated
-              //ESP_LOGI(TAG,"####### Spotted TAG:%" PRId32 " but fake it as TAG:%" PRId32 " %s Time: %s", j, DEFAULT_PARTICIPANT, iTags[DEFAULT_PARTICIPANT].participant.getName().c_str(),strftime_buf);
-              j = DEFAULT_PARTICIPANT;
-#else
-              //ESP_LOGI(TAG,"####### Spotted %s Time: %s", iTags[j].participant.getName().c_str(),strftime_buf);
-#endif
-              time_t iTagLapTime = msg.iTag.time;
-              // Format iTagLapTime for logging (ensure buffer is in scope for all uses)
-              struct tm timeinfo;
-              localtime_r(&iTagLapTime, &timeinfo);
-              char strftime_buf[64];
-              strftime(strftime_buf, sizeof(strftime_buf), "%Y-%m-%d %H:%M:%S", &timeinfo);
-              time_t newLapTime = difftime(iTagLapTime, theRace.getRaceStart());
+              j = iTags[tagIndex].owner;
+              time_t iTagLapTime = static_cast<time_t>(msg.iTag.timeMs / 1000);
+              deferredLogTime lapTime = {msg.iTag.timeMs}; // Formatted by the log task, see deferredLog.h
+              int64_t newLapTime = msg.iTag.timeMs - static_cast<int64_t>(theRace.getRaceStart()) * 1000; // ms since race start
+              iTags[tagIndex].setRSSI(msg.iTag.RSSI);
               iTags[j].setRSSI(msg.iTag.RSSI);
-              if (msg.iTag.battery != INT8_MIN) {
-                iTags[j].battery = msg.iTag.battery;
-              }
+              iTags[tagIndex].updateBattery(msg.iTag.battery, iTagLapTime);
 
               iTags[j].connected = true;
               iTags[j].participant.setTimeSinceLastSeen(0);
-              //tm timeNow = rtc.getTimeStruct();
-              time_t lastSeenSinceStart = iTags[j].participant.getCurrentLapStart() + iTags[j].participant.getCurrentLastSeen();
-              uint32_t timeSinceLastSeen = difftime(newLapTime, lastSeenSinceStart);
-              ESP_LOGI(TAG,"%s Connected Time: %s               timeSinceLastSeen: %" PRId32 " = difftime(newLapTime:%" PRId64 ", lastSeenSinceStart:%" PRId64 ") ", iTags[j].participant.getName().c_str(),strftime_buf,timeSinceLastSeen,newLapTime,lastSeenSinceStart);
+              int64_t lastSeenSinceStart = iTags[j].participant.getCurrentLastSeenSinceRaceStart();
+              int64_t timeSinceLastSeen = 0; // ms
+              if (newLapTime > lastSeenSinceStart) {
+                // Detections from other receivers can arrive a bit after our own
+                timeSinceLastSeen = newLapTime - lastSeenSinceStart;
+              }
+              DLOGI(TAG,"%s Connected Time: %s               timeSinceLastSeen: %" PRId64 " ms = newLapTime:%" PRId64 " - lastSeenSinceStart:%" PRId64 " ", iTags[j].participant.getName().c_str(),lapTime,timeSinceLastSeen,newLapTime,lastSeenSinceStart);
 
-              ESP_LOGI(TAG,"%s Connected Time: %s Check new lap timeSinceLastSeen: %" PRId32 " > theRace.getBlockNewLapTime():%" PRId64 " ?", iTags[j].participant.getName().c_str(),strftime_buf,timeSinceLastSeen,theRace.getBlockNewLapTime());
-              if (timeSinceLastSeen > theRace.getBlockNewLapTime()) {                
+              DLOGI(TAG,"%s Connected Time: %s Check new lap timeSinceLastSeen: %" PRId64 " ms > theRace.getBlockNewLapTime():%" PRId64 " s ?", iTags[j].participant.getName().c_str(),lapTime,timeSinceLastSeen,theRace.getBlockNewLapTime());
+              if (timeSinceLastSeen > theRace.getBlockNewLapTime()*1000) {
                 // New Lap!
-                ESP_LOGI(TAG,"%s Connected Time: %s delta %" PRId64 "->%" PRId32 " (%" PRId64 ",%" PRId64 ") NEW LAP", iTags[j].participant.getName().c_str(),strftime_buf,newLapTime,timeSinceLastSeen, iTags[j].participant.getCurrentLapStart(), iTags[j].participant.getCurrentLastSeen());
-                iTags[j].participant.setBestRSSInearNewLap(msg.iTag.RSSI); // Save RSSI
+                DLOGI(TAG,"%s Connected Time: %s delta %" PRId64 "->%" PRId64 " (%" PRId64 ",%" PRId64 ") NEW LAP", iTags[j].participant.getName().c_str(),lapTime,newLapTime,timeSinceLastSeen, iTags[j].participant.getCurrentLapStart(), iTags[j].participant.getCurrentLastSeen());
+                iTags[j].participant.getRSSIPeak().start(newLapTime, msg.iTag.RSSI);
                 if(!iTags[j].participant.nextLap(newLapTime)) {
                   //TODO GUI popup ??
                   ESP_LOGE(TAG,"%s NEW LAP ERROR can't handle more then %" PRId32 " Laps during race", iTags[j].participant.getName().c_str(),iTags[j].participant.getLapCount());
@@ -1052,28 +1771,43 @@ void vTaskRaceDB( void *pvParameters )
                 }
               }
               else {
-                uint32_t timeSinceThisLap = difftime(newLapTime, iTags[j].participant.getCurrentLapFirstDetected());
-                
+                int64_t timeSinceThisLap = newLapTime - iTags[j].participant.getCurrentLapFirstDetected();
+
                 // theRace.getUpdateCloserTime() seconds after first BT detection, we update the Lap time if we get stringer signal (typical 30s)
-                if (timeSinceThisLap <= theRace.getUpdateCloserTime())
+                if (timeSinceThisLap <= theRace.getUpdateCloserTime()*1000)
                 {
                   // We are within the grace period from BT first detected
-                  // If saved RSSI is better then iTags[j].participant.getBestRSSInearNewLap() then update lap
-                  if (msg.iTag.RSSI > iTags[j].participant.getBestRSSInearNewLap() ) //TODO Maybe add some margin of better like 5%
+                  // Add sample and move lap time to the estimated closest pass
+                  rssiPeakEstimator &rssiPeak = iTags[j].participant.getRSSIPeak();
+                  rssiPeak.addSample(newLapTime, msg.iTag.RSSI);
+                  int64_t peakTimeMs;
+                  if (rssiPeak.estimatePeak(peakTimeMs))
                   {
-                    // We are withing grace period and RSS was better -> update lap!
-                    iTags[j].participant.setBestRSSInearNewLap(msg.iTag.RSSI);
-                    iTags[j].participant.updateLapTagIsCloser(newLapTime);
+                    if (peakTimeMs != iTags[j].participant.getCurrentLapStart()) {
+                      DLOGI(TAG,"%s Closest pass estimated at %" PRId64 " ms from %" PRId32 " samples", iTags[j].participant.getName().c_str(), peakTimeMs, rssiPeak.getSampleCount());
+                      iTags[j].participant.updateLapTagIsCloser(peakTimeMs);
+                    }
                   }
                 }
-                time_t newLastSeenSinceLapStart = difftime(newLapTime, iTags[j].participant.getCurrentLapStart());
-                ESP_LOGI(TAG,"%s Connected Time: %s delta %" PRId64 "->%" PRId32 " (%" PRId64 ",%" PRId64 ") %" PRId64 " To early", iTags[j].participant.getName().c_str(),strftime_buf,newLapTime,timeSinceLastSeen,iTags[j].participant.getCurrentLapStart(), iTags[j].participant.getCurrentLastSeen(),newLastSeenSinceLapStart);
-                iTags[j].participant.setCurrentLastSeen(newLastSeenSinceLapStart);
+                int64_t newLastSeenSinceLapStart = newLapTime - iTags[j].participant.getCurrentLapStart();
+                DLOGI(TAG,"%s Connected Time: %s delta %" PRId64 "->%" PRId64 " (%" PRId64 ",%" PRId64 ") %" PRId64 " To early", iTags[j].participant.getName().c_str(),lapTime,newLapTime,timeSinceLastSeen,iTags[j].participant.getCurrentLapStart(), iTags[j].participant.getCurrentLastSeen(),newLastSeenSinceLapStart);
+                if (newLastSeenSinceLapStart > iTags[j].participant.getCurrentLastSeen()) {
+                  iTags[j].participant.setCurrentLastSeen(newLastSeenSinceLapStart);
+                }
               }
+              standings.update(j);
               autoSaveTainted = true;
               iTags[j].participant.setUpdated(); // Make it redraw when GUI loop looks at it
               iTags[j].UpdateParticipantStatusInGUI();
-              
+              if (tagIndex != j) {
+                iTags[tagIndex].UpdateParticipantStatusInGUI(); // Battery of the extra tag
+              }
+
+              if (msg.iTag.receiverId == RECEIVER_ID_LOCAL) {
+                // Only connect to tags our own BT can hear, a tag seen by a helper may be out of our range
+                pollBatteryWhenIdle(tagIndex, msg.iTag.address, iTagLapTime);
+              }
+
               break; // No need to check more TAGs if we got a match
             }
             //else {
@@ -1082,7 +1816,7 @@ void vTaskRaceDB( void *pvParameters )
             //}
           }
           if (found == false) {
-            ESP_LOGW(TAG,"Scaning iTAGs NO MATCH: %s",bleAddress.c_str());
+            DLOGW(TAG,"Scaning iTAGs NO MATCH: %s",bleAddress.c_str());
           }
           break;
         }
@@ -1095,12 +1829,11 @@ void vTaskRaceDB( void *pvParameters )
           for(int j=0; j<ITAG_COUNT; j++)
           {
             // TODO send index? so we don't need the string compare here???
-            if(bleAddress == iTags[j].address) {
+            if (strcasecmp(bleAddress.c_str(), iTags[j].address.c_str()) == 0) {
               //time_t newLapTime = msg.iTag.time;
               iTags[j].setRSSI(msg.iTag.RSSI);
-              if (msg.iTag.battery != INT8_MIN) {
-                iTags[j].battery = msg.iTag.battery;
-              }
+              iTags[j].updateBattery(msg.iTag.battery, theRace.getNow());
+              iTags[j].batteryPollTime = theRace.getNow();
               iTags[j].participant.setTimeSinceLastSeen(0);
               iTags[j].active = true;
               iTags[j].UpdateParticipantStatusInGUI();
@@ -1108,11 +1841,27 @@ void vTaskRaceDB( void *pvParameters )
           }          
           break;
         }
-        case MSG_ITAG_GFX_ADD_USER_RESPONSE:
+        case MSG_ITAG_BATTERY:
         {
-          //ESP_LOGI(TAG,"Received: MSG_ITAG_GFX_ADD_USER_RESPONSE MSG:0x%" PRIx32 " handleDB:0x%08" PRIx32 " handleGFX:0x%08" PRIx32 " wasOK:%" PRId32 "", 
-          //     msg.AddedToGFX.header.msgType, msg.AddedToGFX.handleDB, msg.AddedToGFX.handleGFX, msg.AddedToGFX.wasOK);
-          iTags[msg.AddedToGFX.handleDB].participant.setHandleGFX(msg.AddedToGFX.handleGFX, msg.AddedToGFX.wasOK);
+          std::string bleAddress = convertBLEAddressToString(msg.iTag.address);
+          for(int j=0; j<ITAG_COUNT; j++)
+          {
+            if (strcasecmp(bleAddress.c_str(), iTags[j].address.c_str()) == 0) {
+              time_t now = theRace.getNow();
+              iTags[j].batteryReadPending = false;
+              if (msg.iTag.battery != INT8_MIN) {
+                iTags[j].updateBattery(msg.iTag.battery, now);
+                ESP_LOGI(TAG,"Received: MSG_ITAG_BATTERY %s %" PRId32 "%% ~%dh", iTags[j].participant.getName().c_str(), iTags[j].battery, iTags[j].getBatteryHoursLeft());
+              }
+              else {
+                // Failed, probably out of range, retry sooner then normal
+                ESP_LOGW(TAG,"Received: MSG_ITAG_BATTERY %s read failed, retry in %ds", iTags[j].participant.getName().c_str(), BATTERY_POLL_RETRY);
+                iTags[j].batteryPollTime = now - BATTERY_POLL_INTERVAL + BATTERY_POLL_RETRY;
+              }
+              iTags[j].UpdateParticipantStatusInGUI();
+              break;
+            }
+          }
           break;
         }
         case MSG_ITAG_UPDATE_USER:
@@ -1128,6 +1877,7 @@ void vTaskRaceDB( void *pvParameters )
           iTags[handleDB].participant.setInRace(msg.UpdateParticipant.inRace);
           // Send update to GUI
           iTags[handleDB].UpdateParticipantInGFX();
+          standings.update(handleDB);
 
           break;
         }
@@ -1142,6 +1892,7 @@ void vTaskRaceDB( void *pvParameters )
             iTags[handleDB].participant.setInRace(msg.UpdateParticipantRaceStatus.inRace);
             // Send update to GUI
             iTags[handleDB].UpdateParticipantStatusInGUI();
+            standings.update(handleDB);
           }
           break;
         }
@@ -1163,6 +1914,7 @@ void vTaskRaceDB( void *pvParameters )
               ESP_LOGI(TAG," Removing %d/%" PRId32 " laps",i, lapDiff);
               iTags[handleDB].participant.prevLap();
             }
+            standings.update(handleDB);
             if (theRace.isRaceOngoing()) {
               saveRace(); // Queue up a MSG_ITAG_SAVE_RACE
             }
@@ -1173,12 +1925,12 @@ void vTaskRaceDB( void *pvParameters )
             for(int i = 0; i < lapDiff; i++)
             {
               ESP_LOGI(TAG," Adding %d/%" PRId32 " laps",i, lapDiff);
-              tm timeNow = rtc.getTimeStruct();
-              time_t lapStart = difftime(mktime(&timeNow), theRace.getRaceStart());
+              int64_t lapStart = theRace.getTimeSinceStartMs();
               // TODO Now this will add a "lap block" so this ONLY works when participant is in "LAP AREA"
-              // TODO maybe something like      time_t newLapTime = mktime(&timeNow) - theRace.getBlockNewLapTime(); // remove theRace.getBlockNewLapTime() to make it possible to detect next lap directly
+              // TODO maybe something like      int64_t newLapTime = lapStart - theRace.getBlockNewLapTime()*1000; // remove theRace.getBlockNewLapTime() to make it possible to detect next lap directly
               iTags[handleDB].participant.nextLap(lapStart,0);
             }
+            standings.update(handleDB);
             if (theRace.isRaceOngoing()) {
               saveRace(); // Queue up a MSG_ITAG_SAVE_RACE
             }
@@ -1189,10 +1941,25 @@ void vTaskRaceDB( void *pvParameters )
           }
           break;
         }
+        case MSG_ITAG_UPDATE_USER_GOAL:
+        {
+          uint32_t handleDB = msg.UpdateParticipantGoal.handleDB;
+          ESP_LOGI(TAG,"Received: MSG_ITAG_UPDATE_USER_GOAL MSG:0x%" PRIx32 " handleDB:0x%08" PRIx32 " handleGFX:0x%08" PRIx32 " goal:%" PRIu32 "",
+               msg.UpdateParticipantGoal.header.msgType, handleDB, msg.UpdateParticipantGoal.handleGFX, msg.UpdateParticipantGoal.goal);
+          if (handleDB >= ITAG_COUNT) {
+            ESP_LOGE(TAG,"ERROR: MSG_ITAG_UPDATE_USER_GOAL bad handleDB:0x%08" PRIx32 " do nothing", handleDB);
+            break;
+          }
+          iTags[handleDB].participant.setGoal(msg.UpdateParticipantGoal.goal);
+          iTags[handleDB].invalidateLapStats();
+          iTags[handleDB].UpdateParticipantLapStatsInGUI();
+          autoSaveTainted = true;
+          break;
+        }
         case MSG_ITAG_LOAD_RACE:
         {
           ESP_LOGI(TAG,"Received: MSG_ITAG_LOAD_RACE MSG:0x%" PRIx32 "", msg.LoadRace.header.msgType);
-          lastAutoSaveMinute = rtc.getMinute(); // Reset autosave timer
+          lastAutoSaveMinute = theRace.getNowMinute(); // Reset autosave timer
           autoSaveTainted = false;
           DBloadRace();
           break;
@@ -1200,7 +1967,7 @@ void vTaskRaceDB( void *pvParameters )
         case MSG_ITAG_SAVE_RACE:
         {
           ESP_LOGI(TAG,"Received: MSG_ITAG_SAVE_RACE MSG:0x%" PRIx32 "", msg.SaveRace.header.msgType);
-          lastAutoSaveMinute = rtc.getMinute(); // Reset autosave timer
+          lastAutoSaveMinute = theRace.getNowMinute(); // Reset autosave timer
           autoSaveTainted = false;
           DBsaveRace();
           break;
@@ -1212,15 +1979,14 @@ void vTaskRaceDB( void *pvParameters )
           refreshTagGUI();
 
           if (theRace.isRaceOngoing()) {
-            time_t now = rtc.getEpoch();
-            if ( (theRace.getRaceStart() + theRace.getMaxTime()*60*60 ) < now ) {
+            if ( theRace.getTimeSinceStartMs() > static_cast<int64_t>(theRace.getMaxTime())*60*60*1000 ) {
               // Race is done
               theRace.setRaceOngoing(false);
               stopRace(); //TODO signal/message
             }
           }
 
-          int nowMinute = rtc.getMinute();
+          int nowMinute = theRace.getNowMinute();
           if (lastAutoSaveMinute != nowMinute) {
             // Autosave each 5min if tainted (e.g. something changed)
             if (autoSaveTainted && nowMinute % 5 == 0) {
@@ -1235,7 +2001,7 @@ void vTaskRaceDB( void *pvParameters )
         case MSG_RACE_START:
         {
           ESP_LOGI(TAG,"Received: MSG_RACE_START MSG:0x%" PRIx32 " startTime:%" PRId64 "", msg.Broadcast.RaceStart.header.msgType,msg.Broadcast.RaceStart.startTime);
-          lastAutoSaveMinute = rtc.getMinute(); // Reset autosave timer
+          lastAutoSaveMinute = theRace.getNowMinute(); // Reset autosave timer
           autoSaveTainted = true;
           raceStartiTags(msg.Broadcast.RaceStart.startTime);
           break;
@@ -1243,7 +2009,7 @@ void vTaskRaceDB( void *pvParameters )
         case MSG_RACE_STOP:
         {
           ESP_LOGI(TAG,"Received: MSG_RACE_STOP MSG:0x%" PRIx32 "", msg.Broadcast.RaceStop.header.msgType);
-          lastAutoSaveMinute = rtc.getMinute(); // Reset autosave timer
+          lastAutoSaveMinute = theRace.getNowMinute(); // Reset autosave timer
           autoSaveTainted = true;
           raceStopiTags();
           break;
@@ -1251,7 +2017,7 @@ void vTaskRaceDB( void *pvParameters )
         case MSG_RACE_CLEAR:
         {
           ESP_LOGI(TAG,"Received: MSG_RACE_CLEAR MSG:0x%" PRIx32 "", msg.Broadcast.RaceStart.header.msgType);
-          lastAutoSaveMinute = rtc.getMinute(); // Reset autosave timer
+          lastAutoSaveMinute = theRace.getNowMinute(); // Reset autosave timer
           autoSaveTainted = true;
           raceCleariTags();
           break;
@@ -1261,6 +2027,11 @@ void vTaskRaceDB( void *pvParameters )
           ESP_LOGI(TAG,"Received: MSG_RACE_CONFIG MSG:0x%" PRIx32 "", msg.Broadcast.RaceConfig.header.msgType);
           theRace.receive_ConfigMsg(&msg.Broadcast.RaceConfig);
           theRace.send_ConfigMsg(queueGFX); //Make sure GUI is in sync
+          // Projections and goal plans depends on maxTime and distance
+          for(int j=0; j<ITAG_COUNT; j++) {
+            iTags[j].invalidateLapStats();
+            iTags[j].UpdateParticipantLapStatsInGUI();
+          }
           break;
         }
         default:
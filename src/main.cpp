@@ -29,6 +29,13 @@
 #include "gui.h"
 #include "iTag.h"
 #include "bluetooth.h"
+#include "scannerLink.h"
+#include "timebase.h"
+#include "boot.h"
+#include "sysStats.h"
+#include "heapStats.h"
+#include "trace.h"
+#include "deferredLog.h"
 #define TAG "Main"
 #include "RTClib.h"
 
@@ -36,7 +43,15 @@
 ESP32Time rtc(0);  // use epoc as race start TODO use real RCT time from HW or NTP
 RTC_PCF8563 rtcHW;
 
-static unsigned long raceStartInEpoch = 0;
+// Race start is scheduled with a esp_timer on a whole second so the broadcasted start time
+// (s since epoch) is the exact instant and lap times are anchored to it.
+#define RACE_START_MAX_WAIT_US (100*1000) // Re-check at least this often, e.g. if not on real clock
+// Set by startRaceCountdown() in the GUI task and read by loop() and armRaceStartTimer(), 64 bit
+// is not read/written atomically so only use it under raceStartMux, see getRaceStartAtMs()
+static portMUX_TYPE raceStartMux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t raceStartAtMs = 0; // Scheduled race start, ms since epoch
+static esp_timer_handle_t raceStartTimer = nullptr;
+static TaskHandle_t xHandleLoop = nullptr;
 uint32_t raceStartIn = 0;
 bool raceOngoing = false;
 
@@ -46,6 +61,7 @@ QueueHandle_t queueRaceDB = NULL;
 QueueHandle_t queueGFX = NULL; 
 
 TaskHandle_t xHandleBT = NULL;
+TaskHandle_t xHandleScannerLink = NULL;
 TaskHandle_t xHandleRaceDB = NULL;
 TaskHandle_t xHandleGUI = NULL;
 
@@ -173,24 +189,62 @@ static void BroadcastRaceStop()
   xQueueSend(queueGFX, (void*)&msgGFX, (TickType_t)pdMS_TO_TICKS( 2000 ));  //No check for error, user will see problem in UI and repress
 }
 
+static int64_t getRaceStartAtMs()
+{
+  portENTER_CRITICAL(&raceStartMux);
+  int64_t atMs = raceStartAtMs;
+  portEXIT_CRITICAL(&raceStartMux);
+  return atMs;
+}
+
+// Runs in the esp_timer task, wake up loop() that will start the race
+static void raceStartTimer_cb(void *arg)
+{
+  if (xHandleLoop) {
+    xTaskNotifyGive(xHandleLoop);
+  }
+}
+
+static void armRaceStartTimer()
+{
+  if (raceStartTimer == nullptr) {
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = raceStartTimer_cb;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "RaceStart";
+    if (esp_timer_create(&timerArgs, &raceStartTimer) != ESP_OK) {
+      ESP_LOGE(TAG,"ERROR: esp_timer_create(RaceStart) failed, race will start from loop() poll");
+      raceStartTimer = nullptr;
+      return;
+    }
+  }
+  esp_timer_stop(raceStartTimer); // In case it is running, error if not is OK
+  esp_timer_start_once(raceStartTimer, timebaseRealUsUntil(getRaceStartAtMs(), RACE_START_MAX_WAIT_US));
+}
+
 void startRaceCountdown(time_t countdownTime)
 {
   ESP_LOGI(TAG,"================== startRaceCountdown(%d) ================== ",countdownTime);
-  unsigned long now = rtc.getEpoch();
-  ESP_LOGI(TAG,"startRaceCountdown()");
-  raceStartIn = countdownTime; //seconds
-  raceStartInEpoch = now + raceStartIn;
+  timebaseAnchor(); // Countdown and race is timed from a fresh anchor so it runs without steps
+  int64_t nowMs = timebaseNowMs();
+  int64_t startAtMs = ((nowMs + static_cast<int64_t>(countdownTime) * 1000 + 999) / 1000) * 1000; // Round up to whole second
+  portENTER_CRITICAL(&raceStartMux);
+  raceStartAtMs = startAtMs;
+  portEXIT_CRITICAL(&raceStartMux);
+  raceStartIn = (startAtMs - nowMs + 999) / 1000; //seconds
   raceOngoing = false;
+  ESP_LOGI(TAG,"startRaceCountdown() start at %" PRId64 " ms", startAtMs);
 
   BroadcastRaceClear();
+  armRaceStartTimer();
 }
 
 static void startRace()
 {
   ESP_LOGI(TAG,"================== startRace() ================== ");
-  raceStartInEpoch = rtc.getEpoch();
-  tm timeNow = rtc.getTimeStruct();
-  time_t raceStartTime = mktime(&timeNow);
+  int64_t startAtMs = getRaceStartAtMs();
+  time_t raceStartTime = startAtMs / 1000; // Exact as it was scheduled on a whole second
+  ESP_LOGI(TAG,"startRace() scheduled:%" PRId64 " ms now:%" PRId64 " ms", startAtMs, timebaseNowMs());
   raceStartIn = 0;
   raceOngoing = true;
 
@@ -202,6 +256,9 @@ void stopRace()
 {
   ESP_LOGI(TAG,"================== stopRace() ================== ");
   raceStartIn = 0;
+  if (raceStartTimer) {
+    esp_timer_stop(raceStartTimer);
+  }
   raceOngoing = false;
   BroadcastRaceStop();
 }
@@ -329,41 +386,57 @@ HWPlatform autoDetectHW()
 
 void setup()
 {
+  uint32_t setupStage = bootStageStart("setup");
+  xHandleLoop = xTaskGetCurrentTaskHandle();
   raceStartIn = 0;
   raceOngoing = false;
-  delay(1000);
   Serial.begin(115200);
   ESP_LOGI(TAG, "Crazy Capy Time setup");
+  deferredLogInit();
 
+  bootInit(); // Must be called before starting all tasks as they wait for each other
+  traceInit();
+
+  uint32_t stage = bootStageStart("autoDetectHW");
   HW_Platform = autoDetectHW();
+  bootStageDone(stage);
 
   initMessageQueues(); // Must be called before starting all tasks as they might use the messages queues
 
+  // All tasks init in parallel and wait for what they need from each other, see boot.h
   initLVGL();
   initBluetooth();
-  initLittleFS();
+  initScannerLink();
+  initRaceDB(); // Mounts LittleFS and reads the race while the GUI is created
 
-  initRTC(); // After initLVGL as it setups wire-I2C
-  delay(100); //TODO do we need this? Ideas is to see if autoloaded race is correct in graph
-  initRaceDB();
-  ESP_LOGI(TAG, "Setup done switching to running loop");
+  bootWaitFor(BOOT_I2C_READY, "initRTC"); // The GUI task setups wire-I2C
+  stage = bootStageStart("initRTC");
+  initRTC();
+  timebaseAnchor();
+  bootStageDone(stage);
+  bootSignal(BOOT_RTC_READY);
 
+  bootStageDone(setupStage);
+  ESP_LOGI(TAG, "Setup done switching to running loop");
 }
 
 void loop()
 {
-  unsigned long now = rtc.getEpoch();
+  unsigned long now = timebaseNow();
 
   if(raceStartIn > 0) {
-    if(now>=raceStartInEpoch) {
+    int64_t nowMs = timebaseNowMs();
+    int64_t startAtMs = getRaceStartAtMs();
+    if(nowMs >= startAtMs) {
       //Countdown 0 -> Start Race!!!!
-      raceStartInEpoch = now;
-      raceStartIn = 0;
       startRace();
     }
-     else {
-      // Update countdown
-      raceStartIn = raceStartInEpoch - now;
+    else {
+      // Update countdown, and re-arm if the timer woke us up to early (e.g. not on real clock)
+      raceStartIn = (startAtMs - nowMs + 999) / 1000;
+      if (raceStartTimer && !esp_timer_is_active(raceStartTimer)) {
+        armRaceStartTimer();
+      }
     }
   }
 
@@ -372,16 +445,36 @@ void loop()
     lastTimeUpdate = now;
     ESP_LOGI(TAG,"------------------------ Time: %s\n",rtc.getTime("%Y-%m-%d %H:%M:%S").c_str()); // format options see https://cplusplus.com/reference/ctime/strftime/
     showHeapInfo(); //Monitor heap to see if memory leaks
-    ESP_LOGI(TAG,"Main   used stack: %d",uxTaskGetStackHighWaterMark(nullptr));
-    ESP_LOGI(TAG,"BT     used stack: %d / %d",uxTaskGetStackHighWaterMark(xHandleBT),TASK_BT_STACK);
-//#if NIMBLE_CFG_CONTROLLER
-//    ESP_LOGI(TAG,"BT ll  used stack: %d",nimble_port_freertos_get_ll_hwm());
-//#endif
-//    ESP_LOGI(TAG,"BT hs  used stack: %d",nimble_port_freertos_get_hs_hwm());
-    ESP_LOGI(TAG,"RaceDB used stack: %d / %d",uxTaskGetStackHighWaterMark(xHandleRaceDB),TASK_RACEDB_STACK);
-    ESP_LOGI(TAG,"GUI    used stack: %d / %d",uxTaskGetStackHighWaterMark(xHandleGUI),TASK_GUI_STACK);
+  }
+
+  // Diagnostics are scheduled on uptime, not on timebaseNow() that may be a scaled test clock
+  unsigned long uptime = millis() / 1000;
+
+  // CPU load and stack of all tasks, logged as a STATS line and shown in the GUI
+  static unsigned long lastStatsSample = 0;
+  if ((lastStatsSample+SYS_STATS_PERIOD) <= uptime) {
+    lastStatsSample = uptime;
+    sysStatsSample();
+  }
+
+  // Heap per subsystem, fragmentation and leak trend, logged as a HEAP line
+  static unsigned long lastHeapSample = 0;
+  if ((lastHeapSample+HEAP_STATS_PERIOD) <= uptime) {
+    lastHeapSample = uptime;
+    heapStatsSample();
+  }
+
+  // Commands from the serial monitor, see trace.h
+  while (Serial.available() > 0) {
+    int command = Serial.read();
+    if (command == 't') {
+      traceDump(Serial);
+    }
+    else if (command == 'T') {
+      traceSave();
+    }
   }
 
   //ESP_LOGI(TAG,"Time: %s\n",rtc.getTime("%Y-%m-%d %H:%M:%S").c_str()); // format options see https://cplusplus.com/reference/ctime/strftime/
-  delay(100);
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)); // Sleep, race start timer wakes us up directly
 }
\ No newline at end of file
@@ -0,0 +1,416 @@
+/*
+  Link to extra scanner nodes (helpers), see scannerLink.h for the line format.
+*/
+#include "driver/uart.h"
+#include "common.h"
+#include "messages.h"
+#include "bluetooth.h"
+#include "scannerLink.h"
+#include "timebase.h"
+#include "boot.h"
+#include "trace.h"
+#include "deferredLog.h"
+
+#define TAG "LINK"
+
+#define SCANNER_LINK_UART        UART_NUM_1
+#define SCANNER_LINK_BAUD        115200
+#define SCANNER_LINK_LINE_LENGTH 96
+#define SCANNER_LINK_RX_BUFFER   1024
+#define SCANNER_LINK_READ_CHUNK  64
+#define SCANNER_LINK_RX_TIMEOUT  1   // Symbols of idle RX before the driver hands over what it got
+#define SCANNER_LINK_IDLE_WAIT   100 // ms, longest block on RX so the sync pings are sent in time
+
+// Pins for the link UART, free on the Sunton board extension connector. On the MakerFab
+// board 17,18 is used by I2C (touch and RTC) so the link is disabled there unless other
+// pins are set with -DSCANNER_LINK_RX_PIN=x -DSCANNER_LINK_TX_PIN=y
+#ifndef SCANNER_LINK_RX_PIN
+#define SCANNER_LINK_RX_PIN 18
+#define SCANNER_LINK_TX_PIN 17
+#define SCANNER_LINK_DEFAULT_PINS
+#endif
+
+// Until a receiver has answered a time sync the offset is the smallest (local - remote) time
+// seen in detections, e.g. the sample with least transport delay, restarted this often so it
+// follows if the clocks drift apart
+#define SCANNER_LINK_OFFSET_WINDOW (60*1000) // ms
+
+// Time sync, NTP style. Main send "$S,<receiverId>,<seq>,<t1>" and the helper answer with
+// "$R,<receiverId>,<seq>,<t1>,<t2>,<t3>" where t2 is when the helper received the ping and t3
+// when it sent the answer, main note t4 when the answer arrives.
+//   offset (local - remote) = ((t1 - t2) + (t4 - t3)) / 2
+//   round trip delay        = (t4 - t1) - (t3 - t2)
+#define SCANNER_LINK_SYNC_INTERVAL  (5*1000)  // ms between pings to each receiver
+#define SCANNER_LINK_DRIFT_BASELINE (60*1000) // ms between the samples used to estimate drift
+#define SCANNER_LINK_DELAY_MARGIN   5         // ms, answers slower then best delay + this are ignored
+#define SCANNER_LINK_SYNC_TIMEOUT   (60*1000) // ms without answer before we fall back to detection offset
+
+// Our clock in ms since epoch, same timebase as our own detections
+static int64_t linkNowMs()
+{
+  return timebaseNowMs();
+}
+
+static uint8_t linkChecksum(const char *payload, size_t len)
+{
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < len; i++) {
+    checksum ^= static_cast<uint8_t>(payload[i]);
+  }
+  return checksum;
+}
+
+// Write "$<payload>*<checksum>\n"
+static void linkSendLine(const char *payload)
+{
+  char line[SCANNER_LINK_LINE_LENGTH];
+  int len = snprintf(line, sizeof(line), "$%s*%02X\n", payload, linkChecksum(payload, strlen(payload)));
+  if (len > 0 && len < static_cast<int>(sizeof(line))) {
+    uart_write_bytes(SCANNER_LINK_UART, line, len);
+  }
+}
+
+#ifdef SCANNER_HELPER
+
+void scannerLinkSendDetection(const msg_iTagDetected &msg_iTag)
+{
+  char payload[SCANNER_LINK_LINE_LENGTH];
+  snprintf(payload, sizeof(payload), "D,%u,%" PRId64 ",%s,%d,%d", SCANNER_HELPER_ID, msg_iTag.timeMs,
+           convertBLEAddressToString(msg_iTag.address).c_str(), msg_iTag.RSSI, msg_iTag.battery);
+  linkSendLine(payload);
+}
+
+// Answer a time sync ping from the main unit, receivedMs is when the ping arrived (t2)
+static void linkHandleSyncPing(const char *payload, int64_t receivedMs)
+{
+  int receiverId;
+  unsigned int seq;
+  long long t1;
+  if (sscanf(payload, "S,%d,%u,%lld", &receiverId, &seq, &t1) != 3) {
+    ESP_LOGW(TAG,"Bad sync line: %s", payload);
+    return;
+  }
+  if (receiverId != SCANNER_HELPER_ID) {
+    return; // To another helper
+  }
+  char reply[SCANNER_LINK_LINE_LENGTH];
+  snprintf(reply, sizeof(reply), "R,%d,%u,%lld,%" PRId64 ",%" PRId64, receiverId, seq, t1, receivedMs, linkNowMs());
+  linkSendLine(reply);
+}
+
+#else
+
+struct receiverClock
+{
+  bool valid;            // offset is usable
+  bool synced;           // offset is from time sync, not from detections
+  int64_t offsetMs;      // local = remote + offsetMs (at offsetTimeMs)
+  int64_t offsetTimeMs;  // Local time of the offset
+  float driftPpm;        // How much faster (+) our clock runs compared to the receivers
+  int64_t driftRefOffsetMs; // Older sample used to estimate drift
+  int64_t driftRefTimeMs;
+  int64_t bestDelayMs;   // Shortest round trip seen
+  int64_t lastSyncMs;    // Local time of last accepted sync answer
+  uint32_t pingSeq;
+  int64_t lastPingMs;
+  int64_t windowMinMs;   // Smallest local - remote in current window (used until synced)
+  int64_t windowStartMs;
+};
+
+static receiverClock receiverClocks[SCANNER_LINK_MAX_RECEIVERS];
+
+// Offset at a given local time, adjusted with the drift
+static int64_t receiverOffsetAt(receiverClock &clock, int64_t localMs)
+{
+  return clock.offsetMs + static_cast<int64_t>(clock.driftPpm * static_cast<float>(localMs - clock.offsetTimeMs) / 1000000.0f);
+}
+
+// Convert a remote time to our clock
+static int64_t receiverToLocalTime(uint8_t receiverId, int64_t remoteMs, int64_t localMs)
+{
+  receiverClock &clock = receiverClocks[receiverId];
+  if (clock.synced && (localMs - clock.lastSyncMs) > SCANNER_LINK_SYNC_TIMEOUT) {
+    ESP_LOGW(TAG,"Receiver %d no time sync answer in %d ms, using detection offset", receiverId, SCANNER_LINK_SYNC_TIMEOUT);
+    clock.synced = false;
+    clock.valid = false;
+  }
+  if (clock.synced) {
+    return remoteMs + receiverOffsetAt(clock, localMs);
+  }
+
+  int64_t diff = localMs - remoteMs;
+  if (!clock.valid) {
+    clock.valid = true;
+    clock.offsetMs = diff;
+    clock.offsetTimeMs = localMs;
+    clock.driftPpm = 0.0f;
+    clock.windowMinMs = diff;
+    clock.windowStartMs = localMs;
+    ESP_LOGI(TAG,"Receiver %d first seen, clock offset %" PRId64 " ms", receiverId, diff);
+  }
+  if ((localMs - clock.windowStartMs) > SCANNER_LINK_OFFSET_WINDOW) {
+    clock.offsetMs = clock.windowMinMs;
+    clock.windowMinMs = diff;
+    clock.windowStartMs = localMs;
+  }
+  clock.windowMinMs = std::min(clock.windowMinMs, diff);
+  clock.offsetMs = std::min(clock.offsetMs, diff);
+  return remoteMs + clock.offsetMs;
+}
+
+static void linkSendSyncPings(int64_t localMs)
+{
+  for (int receiverId = RECEIVER_ID_LOCAL+1; receiverId < SCANNER_LINK_MAX_RECEIVERS; receiverId++) {
+    receiverClock &clock = receiverClocks[receiverId];
+    if (!clock.valid && !clock.synced) {
+      continue; // Never heard from, wait for a detection before we start syncing
+    }
+    if ((localMs - clock.lastPingMs) < SCANNER_LINK_SYNC_INTERVAL) {
+      continue;
+    }
+    clock.lastPingMs = localMs;
+    clock.pingSeq++;
+    char payload[SCANNER_LINK_LINE_LENGTH];
+    snprintf(payload, sizeof(payload), "S,%d,%" PRIu32 ",%" PRId64, receiverId, clock.pingSeq, linkNowMs());
+    linkSendLine(payload);
+  }
+}
+
+// Answer from a helper, receivedMs is when it arrived (t4)
+static void linkHandleSyncReply(const char *payload, int64_t receivedMs)
+{
+  int receiverId;
+  unsigned int seq;
+  long long t1, t2, t3;
+  if (sscanf(payload, "R,%d,%u,%lld,%lld,%lld", &receiverId, &seq, &t1, &t2, &t3) != 6 ||
+      receiverId <= RECEIVER_ID_LOCAL || receiverId >= SCANNER_LINK_MAX_RECEIVERS) {
+    ESP_LOGW(TAG,"Bad sync reply: %s", payload);
+    return;
+  }
+  receiverClock &clock = receiverClocks[receiverId];
+  if (seq != clock.pingSeq) {
+    return; // Old answer, the delay is unknown
+  }
+
+  int64_t t4 = receivedMs;
+  int64_t delayMs = (t4 - t1) - (t3 - t2);
+  int64_t offsetMs = ((t1 - t2) + (t4 - t3)) / 2;
+  if (delayMs < 0) {
+    return;
+  }
+
+  if (!clock.synced || delayMs < clock.bestDelayMs) {
+    clock.bestDelayMs = delayMs;
+  }
+  else {
+    // Let the best delay slowly grow so a temporary very fast answer don't block all later
+    clock.bestDelayMs++;
+  }
+  if (clock.synced && delayMs > (clock.bestDelayMs + SCANNER_LINK_DELAY_MARGIN)) {
+    return; // Slow answer, probably waited in some buffer, don't trust it
+  }
+
+  if (!clock.synced) {
+    ESP_LOGI(TAG,"Receiver %d time synced, offset %" PRId64 " ms delay %" PRId64 " ms", receiverId, offsetMs, delayMs);
+    clock.synced = true;
+    clock.valid = true;
+    clock.driftPpm = 0.0f;
+    clock.driftRefOffsetMs = offsetMs;
+    clock.driftRefTimeMs = t4;
+  }
+  else if ((t4 - clock.driftRefTimeMs) >= SCANNER_LINK_DRIFT_BASELINE) {
+    float drift = static_cast<float>(offsetMs - clock.driftRefOffsetMs) * 1000000.0f / static_cast<float>(t4 - clock.driftRefTimeMs);
+    clock.driftPpm = (clock.driftPpm == 0.0f) ? drift : (clock.driftPpm * 0.75f + drift * 0.25f);
+    clock.driftRefOffsetMs = offsetMs;
+    clock.driftRefTimeMs = t4;
+    ESP_LOGI(TAG,"Receiver %d offset %" PRId64 " ms delay %" PRId64 " ms drift %.1f ppm", receiverId, offsetMs, delayMs, clock.driftPpm);
+  }
+  clock.offsetMs = offsetMs;
+  clock.offsetTimeMs = t4;
+  clock.lastSyncMs = t4;
+}
+
+// "ff:ff:10:7e:82:46" -> same value as static_cast<uint64_t>(NimBLEAddress)
+static bool parseBLEAddress(const char *str, uint64_t &address)
+{
+  unsigned int b[6];
+  if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+    return false;
+  }
+  address = 0;
+  for (int i = 0; i < 6; i++) {
+    address = (address << 8) | b[i];
+  }
+  return true;
+}
+
+static void linkHandleDetection(const char *payload, int64_t localMs)
+{
+  int receiverId;
+  long long remoteMs;
+  char addressStr[18];
+  int rssi;
+  int battery;
+  if (sscanf(payload, "D,%d,%lld,%17[^,],%d,%d", &receiverId, &remoteMs, addressStr, &rssi, &battery) != 5) {
+    ESP_LOGW(TAG,"Bad detection line: %s", payload);
+    return;
+  }
+  uint64_t address;
+  if (receiverId <= RECEIVER_ID_LOCAL || receiverId >= SCANNER_LINK_MAX_RECEIVERS || !parseBLEAddress(addressStr, address)) {
+    ESP_LOGW(TAG,"Bad detection values: %s", payload);
+    return;
+  }
+
+  int64_t timeMs = receiverToLocalTime(receiverId, remoteMs, localMs);
+
+  msg_RaceDB msg;
+  msg.iTag.header.msgType = MSG_ITAG_DETECTED;
+  msg.iTag.timeMs = timeMs;
+  msg.iTag.address = address;
+  msg.iTag.RSSI = static_cast<int8_t>(std::max(rssi, static_cast<int>(INT8_MIN)));
+  msg.iTag.battery = static_cast<int8_t>(std::max(battery, static_cast<int>(INT8_MIN)));
+  msg.iTag.receiverId = static_cast<uint8_t>(receiverId);
+  TRACE_INSTANT(TRACE_BT_ITAG_SEEN, static_cast<uint32_t>(address));
+  TRACE_SCOPE(TRACE_SEND_RACEDB, msg.iTag.header.msgType);
+  BaseType_t xReturned = xQueueSend(queueRaceDB, (void*)&msg, (TickType_t)pdMS_TO_TICKS( 100 ));
+  if (!xReturned)
+  {
+    DLOGE(TAG,"ERROR iTAG detected queue is full: %s from receiver %d trow a way detected", addressStr, receiverId);
+  }
+}
+
+#endif // SCANNER_HELPER
+
+static void linkHandleLine(char *line, size_t len, int64_t localMs)
+{
+  // line is "$<payload>*<checksum>"
+  char *star = strrchr(line, '*');
+  if (line[0] != '$' || star == nullptr || (star + 3) != (line + len)) {
+    ESP_LOGW(TAG,"Bad line: %s", line);
+    return;
+  }
+  *star = '\0';
+  const char *payload = line + 1;
+  unsigned int checksum;
+  if (sscanf(star + 1, "%2x", &checksum) != 1 || checksum != linkChecksum(payload, strlen(payload))) {
+    ESP_LOGW(TAG,"Bad checksum: %s", payload);
+    return;
+  }
+
+  switch (payload[0]) {
+#ifdef SCANNER_HELPER
+    case 'S':
+      linkHandleSyncPing(payload, localMs);
+      break;
+#else
+    case 'D':
+      linkHandleDetection(payload, localMs);
+      break;
+    case 'R':
+      linkHandleSyncReply(payload, localMs);
+      break;
+#endif
+    default:
+      ESP_LOGW(TAG,"Unknown line: %s", payload);
+      break;
+  }
+}
+
+static void vTaskScannerLink( void *pvParameters )
+{
+  char line[SCANNER_LINK_LINE_LENGTH];
+  size_t len = 0;
+  int64_t lineStartMs = 0; // Time when $ was received, closer to the send time then end of line
+  uint8_t chunk[SCANNER_LINK_READ_CHUNK];
+
+  // Detections and sync pings are timestamped, wait until the timebase is anchored to the RTC
+  bootWaitFor(BOOT_RTC_READY, "ScannerLink");
+
+  for( ;; )
+  {
+#ifndef SCANNER_HELPER
+    linkSendSyncPings(linkNowMs());
+#endif
+    // Block in the UART driver until the first byte arrives, then take what is buffered
+    int got = uart_read_bytes(SCANNER_LINK_UART, chunk, 1, pdMS_TO_TICKS(SCANNER_LINK_IDLE_WAIT));
+    if (got <= 0) {
+      continue;
+    }
+    int64_t chunkMs = linkNowMs();
+    size_t buffered = 0;
+    if (uart_get_buffered_data_len(SCANNER_LINK_UART, &buffered) == ESP_OK && buffered > 0) {
+      got += std::max(uart_read_bytes(SCANNER_LINK_UART, chunk + 1, std::min(buffered, sizeof(chunk) - 1), 0), 0);
+    }
+
+    for (int i = 0; i < got; i++) {
+      char c = static_cast<char>(chunk[i]);
+      if (c == '$') {
+        len = 0;
+        lineStartMs = chunkMs;
+      }
+      if (c == '\r') {
+        continue;
+      }
+      if (c == '\n') {
+        if (len > 0) {
+          line[len] = '\0';
+          linkHandleLine(line, len, lineStartMs);
+        }
+        len = 0;
+        continue;
+      }
+      if (len < (sizeof(line) - 1)) {
+        line[len++] = c;
+      }
+      else {
+        len = 0; // Too long, drop it and wait for next $
+      }
+    }
+  }
+  vTaskDelete( NULL ); // Should never be reached
+}
+
+void initScannerLink()
+{
+#ifdef SCANNER_LINK_DEFAULT_PINS
+  if (HW_Platform == HWPlatform::MakerFab_800x480) {
+    ESP_LOGW(TAG,"Scanner link disabled, pins %d,%d are used by I2C on MakerFab, set SCANNER_LINK_RX_PIN and SCANNER_LINK_TX_PIN", SCANNER_LINK_RX_PIN, SCANNER_LINK_TX_PIN);
+    return;
+  }
+#endif
+  ESP_LOGI(TAG,"Scanner link on RX:%d TX:%d", SCANNER_LINK_RX_PIN, SCANNER_LINK_TX_PIN);
+  uart_config_t uartConfig = {};
+  uartConfig.baud_rate = SCANNER_LINK_BAUD;
+  uartConfig.data_bits = UART_DATA_8_BITS;
+  uartConfig.parity = UART_PARITY_DISABLE;
+  uartConfig.stop_bits = UART_STOP_BITS_1;
+  uartConfig.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  uartConfig.source_clk = UART_SCLK_APB;
+  // The task blocks in uart_read_bytes(), a short RX timeout wakes it right after a line
+  if (uart_driver_install(SCANNER_LINK_UART, SCANNER_LINK_RX_BUFFER, 0, 0, nullptr, 0) != ESP_OK ||
+      uart_param_config(SCANNER_LINK_UART, &uartConfig) != ESP_OK ||
+      uart_set_pin(SCANNER_LINK_UART, SCANNER_LINK_TX_PIN, SCANNER_LINK_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK ||
+      uart_set_rx_timeout(SCANNER_LINK_UART, SCANNER_LINK_RX_TIMEOUT) != ESP_OK)
+  {
+    ESP_LOGE(TAG,"ERROR: Could not setup UART %d for the scanner link, link disabled", SCANNER_LINK_UART);
+    return;
+  }
+
+  // Main receive detections and time sync answers, helper receive time sync pings
+  BaseType_t xReturned;
+  /* Create the task, storing the handle. */
+  xReturned = xTaskCreate(
+                  vTaskScannerLink,        /* Function that implements the task. */
+                  "ScannerLink",           /* Text name for the task. */
+                  TASK_SCANNERLINK_STACK,  /* Stack size in words, not bytes. */
+                  NULL,                    /* Parameter passed into the task. */
+                  TASK_SCANNERLINK_PRIO,   /* Priority  0-(configMAX_PRIORITIES-1)   idle = 0 = tskIDLE_PRIORITY*/
+                  &xHandleScannerLink );   /* Used to pass out the created task's handle. */
+
+  if( xReturned != pdPASS )
+  {
+    ESP_LOGE(TAG,"FATAL ERROR: xTaskCreate(vTaskScannerLink, ScannerLink,..) Failed");
+    ESP_LOGE(TAG,"----- esp_restart() -----");
+    esp_restart();
+  }
+}
@@ -0,0 +1,178 @@
+/*
+  Task runtime statistics, see sysStats.h
+*/
+#include <algorithm>
+#include <cstring>
+#include "esp_timer.h"
+#include "esp_freertos_hooks.h"
+#include "common.h"
+#include "sysStats.h"
+
+#define TAG "Stats"
+
+#define SYS_STATS_LINE_LENGTH 1024
+
+static portMUX_TYPE sysStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static sysStatsSnapshot lastSnapshot = {};
+static sysStatsSnapshot newSnapshot = {};   // Static, to big for the loop() stack
+static TaskStatus_t taskStatus[SYS_STATS_MAX_TASKS];
+
+static void sysStatsLog(const sysStatsSnapshot &snapshot)
+{
+  static char line[SYS_STATS_LINE_LENGTH];
+  int len = snprintf(line, sizeof(line), "STATS,%" PRId64, snapshot.uptimeMs);
+  for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (snapshot.coreLoad[core] == SYS_STATS_LOAD_UNKNOWN) {
+      len += snprintf(line + len, sizeof(line) - len, ",-");
+    }
+    else {
+      len += snprintf(line + len, sizeof(line) - len, ",%u", snapshot.coreLoad[core]);
+    }
+  }
+  len += snprintf(line + len, sizeof(line) - len, ",%" PRIu32, snapshot.taskCount);
+  for (uint32_t i = 0; i < snapshot.taskCount && len < static_cast<int>(sizeof(line)); i++) {
+    const sysTaskStats &task = snapshot.tasks[i];
+    char core[4] = "-";
+    char load[4] = "-";
+    if (task.core != tskNO_AFFINITY) {
+      snprintf(core, sizeof(core), "%d", static_cast<int>(task.core));
+    }
+    if (task.load != SYS_STATS_LOAD_UNKNOWN) {
+      snprintf(load, sizeof(load), "%u", task.load);
+    }
+    len += snprintf(line + len, sizeof(line) - len, ",%s:%s:%u:%s:%" PRIu32 ":n/a",
+                    task.name, core, static_cast<unsigned>(task.priority), load, task.stackFree);
+  }
+  ESP_LOGI(TAG,"%s", line);
+}
+
+// Tick sampling, one table per core only written by that cores tick hook
+struct sysTickSlot {
+  TaskHandle_t handle;
+  uint32_t ticks;
+};
+static portMUX_TYPE sysTickMux = portMUX_INITIALIZER_UNLOCKED;
+static sysTickSlot tickSlots[portNUM_PROCESSORS][SYS_STATS_MAX_TASKS];
+static uint32_t tickCount[portNUM_PROCESSORS];
+static sysTickSlot sampledSlots[portNUM_PROCESSORS][SYS_STATS_MAX_TASKS]; // Static, to big for the loop() stack
+static bool tickHooksRegistered = false;
+
+static void IRAM_ATTR sysStatsTickHook()
+{
+  BaseType_t core = xPortGetCoreID();
+  TaskHandle_t running = xTaskGetCurrentTaskHandleForCPU(core);
+  portENTER_CRITICAL_ISR(&sysTickMux);
+  tickCount[core]++;
+  for (uint32_t i = 0; i < SYS_STATS_MAX_TASKS; i++) {
+    sysTickSlot &slot = tickSlots[core][i];
+    if (slot.handle == running || slot.handle == nullptr) {
+      slot.handle = running;
+      slot.ticks++;
+      break;
+    }
+  }
+  portEXIT_CRITICAL_ISR(&sysTickMux);
+}
+
+static void sysStatsRegisterTickHooks()
+{
+  for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (esp_register_freertos_tick_hook_for_cpu(sysStatsTickHook, core) != ESP_OK) {
+      ESP_LOGW(TAG,"WARNING: Could not register tick hook on core %" PRIu32 ", no load stats", core);
+    }
+  }
+  tickHooksRegistered = true;
+}
+
+static uint32_t sysStatsTicksOf(TaskHandle_t handle, uint32_t core)
+{
+  for (uint32_t i = 0; i < SYS_STATS_MAX_TASKS && sampledSlots[core][i].handle != nullptr; i++) {
+    if (sampledSlots[core][i].handle == handle) {
+      return sampledSlots[core][i].ticks;
+    }
+  }
+  return 0;
+}
+
+static uint8_t sysStatsPercent(uint32_t part, uint32_t total)
+{
+  return std::min(static_cast<uint32_t>(100), static_cast<uint32_t>((static_cast<uint64_t>(part) * 100 + total / 2) / total));
+}
+
+void sysStatsSample()
+{
+  if (!tickHooksRegistered) {
+    sysStatsRegisterTickHooks(); // Loads are known from the next sample
+  }
+
+  // Take the ticks since the previous sample and start over
+  uint32_t sampledTicks[portNUM_PROCESSORS];
+  portENTER_CRITICAL(&sysTickMux);
+  for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+    sampledTicks[core] = tickCount[core];
+    tickCount[core] = 0;
+    std::copy(tickSlots[core], tickSlots[core] + SYS_STATS_MAX_TASKS, sampledSlots[core]);
+    std::fill(tickSlots[core], tickSlots[core] + SYS_STATS_MAX_TASKS, sysTickSlot{nullptr, 0});
+  }
+  portEXIT_CRITICAL(&sysTickMux);
+  uint32_t elapsedTicks = *std::max_element(sampledTicks, sampledTicks + portNUM_PROCESSORS);
+
+  newSnapshot.uptimeMs = esp_timer_get_time() / 1000;
+  for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+    newSnapshot.coreLoad[core] = SYS_STATS_LOAD_UNKNOWN;
+    if (sampledTicks[core] > 0) {
+      uint32_t idleTicks = sysStatsTicksOf(xTaskGetIdleTaskHandleForCPU(core), core);
+      newSnapshot.coreLoad[core] = 100 - sysStatsPercent(idleTicks, sampledTicks[core]);
+    }
+  }
+
+#if configUSE_TRACE_FACILITY
+  UBaseType_t count = uxTaskGetSystemState(taskStatus, SYS_STATS_MAX_TASKS, nullptr);
+  if (count == 0) {
+    ESP_LOGW(TAG,"WARNING: More then %d tasks, increase SYS_STATS_MAX_TASKS", SYS_STATS_MAX_TASKS);
+    return;
+  }
+
+  newSnapshot.taskCount = count;
+  for (uint32_t i = 0; i < count; i++) {
+    const TaskStatus_t &status = taskStatus[i];
+    sysTaskStats &task = newSnapshot.tasks[i];
+    strncpy(task.name, status.pcTaskName, configMAX_TASK_NAME_LEN - 1);
+    task.name[configMAX_TASK_NAME_LEN - 1] = '\0';
+    task.handle = status.xHandle;
+#if configTASKLIST_INCLUDE_COREID
+    task.core = status.xCoreID;
+#else
+    task.core = tskNO_AFFINITY;
+#endif
+    task.priority = status.uxCurrentPriority;
+    task.stackFree = status.usStackHighWaterMark;
+    task.ticks = 0;
+    for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+      task.ticks += sysStatsTicksOf(task.handle, core); // Unpinned tasks may run on both
+    }
+    task.load = (elapsedTicks > 0) ? sysStatsPercent(task.ticks, elapsedTicks) : SYS_STATS_LOAD_UNKNOWN;
+  }
+  std::sort(newSnapshot.tasks, newSnapshot.tasks + count, [](const sysTaskStats &a, const sysTaskStats &b) {
+    // Unknown load (0xFF) last
+    uint32_t loadA = (a.load == SYS_STATS_LOAD_UNKNOWN) ? 0 : a.load + 1;
+    uint32_t loadB = (b.load == SYS_STATS_LOAD_UNKNOWN) ? 0 : b.load + 1;
+    return loadA > loadB;
+  });
+#else
+  newSnapshot.taskCount = 0; // No task list without configUSE_TRACE_FACILITY, only core load
+#endif
+
+  portENTER_CRITICAL(&sysStatsMux);
+  lastSnapshot = newSnapshot;
+  portEXIT_CRITICAL(&sysStatsMux);
+
+  sysStatsLog(newSnapshot);
+}
+
+void sysStatsGet(sysStatsSnapshot &snapshot)
+{
+  portENTER_CRITICAL(&sysStatsMux);
+  snapshot = lastSnapshot;
+  portEXIT_CRITICAL(&sysStatsMux);
+}
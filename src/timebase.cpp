@@ -0,0 +1,134 @@
+/*
+  Millisecond timebase, see timebase.h
+*/
+#include <sys/time.h>
+#include <algorithm>
+#include "esp_timer.h"
+#include "common.h"
+#include "timebase.h"
+
+#define TAG "TIME"
+
+// If the RTC and our time differs more then this the clock was set, re-anchor
+#define TIMEBASE_RESYNC_LIMIT 1000 // ms
+
+static portMUX_TYPE timebaseMux = portMUX_INITIALIZER_UNLOCKED;
+static timebaseRealClock realClock;
+static timebaseClock *currentClock = &realClock;
+
+static int64_t systemEpochMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<int64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+void timebaseRealClock::anchor()
+{
+  int64_t epochMs = systemEpochMs();
+  int64_t timerUs = esp_timer_get_time();
+  portENTER_CRITICAL(&timebaseMux);
+  anchorEpochMs = epochMs;
+  anchorTimerUs = timerUs;
+  anchored = true;
+  portEXIT_CRITICAL(&timebaseMux);
+  ESP_LOGI(TAG,"Timebase anchored at %" PRId64 " ms", epochMs);
+}
+
+int64_t timebaseRealClock::nowMs()
+{
+  int64_t epochMs = systemEpochMs();
+  int64_t timerUs = esp_timer_get_time();
+  portENTER_CRITICAL(&timebaseMux);
+  bool isAnchored = anchored;
+  int64_t nowMs = anchorEpochMs + (timerUs - anchorTimerUs) / 1000;
+  portEXIT_CRITICAL(&timebaseMux);
+
+  int64_t diff = epochMs - nowMs;
+  if (!isAnchored || diff > TIMEBASE_RESYNC_LIMIT || diff < -TIMEBASE_RESYNC_LIMIT) {
+    if (isAnchored) {
+      ESP_LOGW(TAG,"Clock was set, moved %" PRId64 " ms", diff);
+    }
+    anchor();
+    return epochMs;
+  }
+  return nowMs;
+}
+
+void timebaseScaledClock::start()
+{
+  int64_t epochMs = realClock.nowMs();
+  int64_t timerUs = esp_timer_get_time();
+  portENTER_CRITICAL(&timebaseMux);
+  startEpochMs = epochMs;
+  startTimerUs = timerUs;
+  portEXIT_CRITICAL(&timebaseMux);
+  ESP_LOGI(TAG,"Scaled clock x%" PRIu32 " started at %" PRId64 " ms", scale, epochMs);
+}
+
+int64_t timebaseScaledClock::nowMs()
+{
+  int64_t timerUs = esp_timer_get_time();
+  portENTER_CRITICAL(&timebaseMux);
+  int64_t nowMs = startEpochMs + ((timerUs - startTimerUs) * scale) / 1000;
+  portEXIT_CRITICAL(&timebaseMux);
+  return nowMs;
+}
+
+void timebaseSetClock(timebaseClock *clock)
+{
+  if (clock == nullptr) {
+    clock = &realClock;
+  }
+  portENTER_CRITICAL(&timebaseMux);
+  currentClock = clock;
+  portEXIT_CRITICAL(&timebaseMux);
+  ESP_LOGW(TAG,"Clock changed to %s clock", clock == &realClock ? "real" : "test");
+}
+
+bool timebaseIsRealClock()
+{
+  portENTER_CRITICAL(&timebaseMux);
+  bool isReal = currentClock == &realClock;
+  portEXIT_CRITICAL(&timebaseMux);
+  return isReal;
+}
+
+uint32_t timebaseClockSpeed()
+{
+  portENTER_CRITICAL(&timebaseMux);
+  timebaseClock *clock = currentClock;
+  portEXIT_CRITICAL(&timebaseMux);
+  return clock->speed();
+}
+
+uint64_t timebaseRealUsUntil(int64_t atMs, uint64_t maxUs)
+{
+  int64_t leftMs = atMs - timebaseNowMs();
+  if (leftMs <= 0) {
+    return 0;
+  }
+  uint32_t speed = timebaseClockSpeed();
+  if (speed == 0) {
+    return maxUs;
+  }
+  return std::min(static_cast<uint64_t>(leftMs) * 1000 / speed, maxUs);
+}
+
+void timebaseAnchor()
+{
+  realClock.anchor();
+}
+
+int64_t timebaseNowMs()
+{
+  portENTER_CRITICAL(&timebaseMux);
+  timebaseClock *clock = currentClock;
+  portEXIT_CRITICAL(&timebaseMux);
+  return clock->nowMs();
+}
+
+time_t timebaseNow()
+{
+  return static_cast<time_t>(timebaseNowMs() / 1000);
+}
@@ -0,0 +1,155 @@
+/*
+  Event tracer, see trace.h
+*/
+#include <atomic>
+#include <algorithm>
+#include <cstdarg>
+#include <LittleFS.h>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "common.h"
+#include "trace.h"
+
+#define TAG "Trace"
+
+#define TRACE_MAX_TASKS   32
+#define TRACE_LINE_LENGTH 96
+
+static_assert((TRACE_EVENTS_PER_CORE & (TRACE_EVENTS_PER_CORE - 1)) == 0, "TRACE_EVENTS_PER_CORE must be a power of 2");
+
+static const char *traceNames[TRACE_ID_COUNT] = {
+  "BT iTAG seen",
+  "BT connect",
+  "Send queueRaceDB",
+  "Send queueGFX",
+  "RaceDB msg",
+  "queueRaceDB waiting",
+  "GFX msg",
+  "queueGFX waiting",
+  "BTConnect msg",
+  "DBsaveRace",
+  "refreshTagGUI",
+  "lv_timer_handler",
+  "Display flush"
+};
+
+struct traceRecord {
+  uint32_t timeUs;   // Lower 32 bits of esp_timer, the dump restores the full time
+  TaskHandle_t task;
+  traceId id;
+  traceType type;    // 0 = never written
+  uint32_t arg;
+};
+
+struct traceRing {
+  std::atomic<uint32_t> head; // Total events written, slot is head % TRACE_EVENTS_PER_CORE
+  traceRecord *events;
+};
+
+static traceRing traceRings[portNUM_PROCESSORS];
+static std::atomic<bool> traceRunning(false);
+
+void traceInit()
+{
+#if TRACE_ENABLED
+  for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+    size_t size = TRACE_EVENTS_PER_CORE * sizeof(traceRecord);
+    traceRecord *events = static_cast<traceRecord *>(heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM));
+    if (events == nullptr) {
+      ESP_LOGE(TAG,"ERROR: Could not allocate %u bytes for the trace buffer, tracing is off", size);
+      return;
+    }
+    traceRings[core].events = events;
+    traceRings[core].head = 0;
+  }
+  traceRunning = true;
+  ESP_LOGI(TAG,"Tracing %d events per core, send t on serial to dump, T to save to %s", TRACE_EVENTS_PER_CORE, TRACE_FILE);
+#endif
+}
+
+void traceEvent(traceId id, traceType type, uint32_t arg)
+{
+  if (!traceRunning.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // If the task moves to the other core after this it just ends up in the wrong ring, the
+  // dump sorts on time anyway.
+  traceRing &ring = traceRings[xPortGetCoreID()];
+  uint32_t index = ring.head.fetch_add(1, std::memory_order_relaxed);
+  traceRecord &record = ring.events[index & (TRACE_EVENTS_PER_CORE - 1)];
+  record.timeUs = static_cast<uint32_t>(esp_timer_get_time());
+  record.task = xTaskGetCurrentTaskHandle();
+  record.id = id;
+  record.arg = arg;
+  record.type = type;
+}
+
+static void traceWrite(Stream &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void traceWrite(Stream &out, const char *fmt, ...)
+{
+  char line[TRACE_LINE_LENGTH];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  out.write(reinterpret_cast<const uint8_t*>(line), std::min(len, static_cast<int>(sizeof(line)) - 1));
+}
+
+void traceDump(Stream &out)
+{
+  if (!traceRunning) {
+    ESP_LOGW(TAG,"WARNING: Tracing is off, nothing to dump");
+    return;
+  }
+  traceRunning = false;
+  vTaskDelay(pdMS_TO_TICKS(2)); // Let trace points that already passed the check finish
+
+  int64_t nowUs = esp_timer_get_time();
+  uint32_t nowUs32 = static_cast<uint32_t>(nowUs);
+  traceWrite(out, "TRACE,START,%" PRId64 ",%d\n", nowUs, TRACE_EVENTS_PER_CORE);
+  for (uint32_t id = 0; id < TRACE_ID_COUNT; id++) {
+    traceWrite(out, "TRACE,ID,%" PRIu32 ",%s\n", id, traceNames[id]);
+  }
+
+#if configUSE_TRACE_FACILITY
+  static TaskStatus_t tasks[TRACE_MAX_TASKS];
+  UBaseType_t taskCount = uxTaskGetSystemState(tasks, TRACE_MAX_TASKS, nullptr);
+  for (UBaseType_t i = 0; i < taskCount; i++) {
+    traceWrite(out, "TRACE,TASK,%08" PRIxPTR ",%s\n", reinterpret_cast<uintptr_t>(tasks[i].xHandle), tasks[i].pcTaskName);
+  }
+#endif
+
+  uint32_t dumped = 0;
+  for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+    traceRing &ring = traceRings[core];
+    uint32_t head = ring.head;
+    uint32_t count = std::min(head, static_cast<uint32_t>(TRACE_EVENTS_PER_CORE));
+    for (uint32_t index = head - count; index != head; index++) {
+      const traceRecord &record = ring.events[index & (TRACE_EVENTS_PER_CORE - 1)];
+      if (record.type == 0) {
+        continue;
+      }
+      int64_t timeUs = nowUs - static_cast<uint32_t>(nowUs32 - record.timeUs);
+      traceWrite(out, "TRACE,EV,%" PRIu32 ",%" PRId64 ",%08" PRIxPTR ",%u,%c,%" PRIu32 "\n",
+                 core, timeUs, reinterpret_cast<uintptr_t>(record.task), static_cast<unsigned>(record.id),
+                 static_cast<char>(record.type), record.arg);
+      dumped++;
+    }
+  }
+  traceWrite(out, "TRACE,END\n");
+  ESP_LOGI(TAG,"Dumped %" PRIu32 " trace events", dumped);
+
+  traceRunning = true;
+}
+
+void traceSave()
+{
+  File traceFile = LittleFS.open(TRACE_FILE, "w");
+  if (!traceFile) {
+    ESP_LOGE(TAG,"ERROR: LittleFS open(%s) for write failed", TRACE_FILE);
+    return;
+  }
+  traceDump(traceFile);
+  traceFile.close();
+  ESP_LOGI(TAG,"Trace saved to %s", TRACE_FILE);
+}
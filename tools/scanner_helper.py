@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Stand in for a CrazyCapyTime scanner helper during testing, see include/scannerLink.h.
+
+Connect a USB serial adapter crossed to the main units scanner link pins (default RX 18,
+TX 17) and let the script send detections and answer the time sync pings like a helper:
+
+  python tools/scanner_helper.py /dev/ttyUSB0 --tag ff:ff:10:7e:82:46 --tag ff:ff:10:7e:82:47:-70
+
+Each --tag is seen every --interval seconds, with -60 dBm if no rssi is given. --offset
+moves the helper clock to test the clock sync, --id sets the receiverId (1-7). With
+--print no port is opened, the lines are only printed, e.g.:
+
+  $D,1,1700000000000,ff:ff:10:7e:82:46,-60,-128*33
+
+Needs pyserial (pip install pyserial) unless --print is used.
+"""
+import argparse
+import sys
+import time
+
+BAUD = 115200
+BATTERY_UNKNOWN = -128
+
+
+def checksum(payload):
+    value = 0
+    for c in payload.encode("ascii"):
+        value ^= c
+    return value
+
+
+def frame(payload):
+    return "$%s*%02X\n" % (payload, checksum(payload))
+
+
+def parse_frame(line):
+    """Returns the payload of a "$<payload>*<checksum>" line or None if it's bad."""
+    line = line.strip()
+    star = line.rfind("*")
+    if not line.startswith("$") or star < 0 or len(line) != star + 3:
+        return None
+    payload = line[1:star]
+    try:
+        if int(line[star + 1:], 16) != checksum(payload):
+            return None
+    except ValueError:
+        return None
+    return payload
+
+
+def parse_tag(text):
+    parts = text.split(":")
+    if len(parts) not in (6, 7):
+        raise argparse.ArgumentTypeError("tag must be ff:ff:10:7e:82:46 or ff:ff:10:7e:82:46:<rssi>")
+    rssi = int(parts[6]) if len(parts) == 7 else -60
+    return ":".join(parts[:6]).lower(), rssi
+
+
+class Helper:
+    def __init__(self, receiver_id, offset_ms, write):
+        self.receiver_id = receiver_id
+        self.offset_ms = offset_ms
+        self.write = write
+
+    def now_ms(self):
+        return int(time.time() * 1000) + self.offset_ms
+
+    def send_detection(self, address, rssi):
+        self.write(frame("D,%d,%d,%s,%d,%d" % (self.receiver_id, self.now_ms(), address, rssi, BATTERY_UNKNOWN)))
+
+    def handle_line(self, line, received_ms):
+        payload = parse_frame(line)
+        if payload is None:
+            print("Bad line: %r" % line, file=sys.stderr)
+            return
+        fields = payload.split(",")
+        if fields[0] != "S" or len(fields) != 4:
+            return
+        receiver_id, seq, t1 = fields[1:]
+        if int(receiver_id) != self.receiver_id:
+            return  # To another helper
+        self.write(frame("R,%s,%s,%s,%d,%d" % (receiver_id, seq, t1, received_ms, self.now_ms())))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Stand in for a scanner helper on the scanner link")
+    parser.add_argument("port", nargs="?", help="Serial port, e.g. /dev/ttyUSB0 or COM3")
+    parser.add_argument("--tag", action="append", type=parse_tag, default=[], help="Tag address[:rssi] to report")
+    parser.add_argument("--id", type=int, default=1, help="receiverId of this helper (1-7)")
+    parser.add_argument("--interval", type=float, default=1.0, help="Seconds between detections of each tag")
+    parser.add_argument("--offset", type=int, default=0, help="ms added to the helper clock")
+    parser.add_argument("--print", action="store_true", help="Only print the lines, no serial port")
+    args = parser.parse_args()
+    if not args.tag:
+        parser.error("at least one --tag is needed")
+    if not 1 <= args.id <= 7:
+        parser.error("--id must be 1-7")
+
+    if args.print:
+        helper = Helper(args.id, args.offset, sys.stdout.write)
+        for address, rssi in args.tag:
+            helper.send_detection(address, rssi)
+        return
+
+    if args.port is None:
+        parser.error("port is needed unless --print is used")
+    import serial  # pyserial
+
+    link = serial.Serial(args.port, BAUD, timeout=0.01)
+    helper = Helper(args.id, args.offset, lambda line: link.write(line.encode("ascii")))
+    next_detection = time.monotonic()
+    received = b""
+    received_ms = 0
+    while True:
+        if time.monotonic() >= next_detection:
+            for address, rssi in args.tag:
+                helper.send_detection(address, rssi)
+            next_detection += args.interval
+        data = link.read(64)
+        for byte in data:
+            if byte == ord("$"):
+                received = b""
+                received_ms = helper.now_ms()  # t2, when the ping started to arrive
+            received += bytes([byte])
+            if byte == ord("\n"):
+                helper.handle_line(received.decode("ascii", errors="replace"), received_ms)
+                received = b""
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""
+Convert a CrazyCapyTime trace dump into a Chrome trace JSON timeline.
+
+The dump is made on the unit by sending "t" on the serial monitor (the TRACE lines end up in
+the serial log) or "T" to save it to /trace.txt on LittleFS, see include/trace.h.
+
+  python tools/trace2chrome.py monitor.log > trace.json
+
+Open trace.json in chrome://tracing or https://ui.perfetto.dev. Each task is a thread, the
+last dump in the file is used and other log lines are ignored.
+"""
+import json
+import sys
+
+MSG_TYPE_IDS = ("Send queueRaceDB", "Send queueGFX", "RaceDB msg", "GFX msg", "BTConnect msg")
+
+
+def read_dump(lines):
+    dump = None
+    for line in lines:
+        pos = line.find("TRACE,")
+        if pos < 0:
+            continue
+        fields = line[pos:].rstrip("\r\n").split(",")
+        kind = fields[1] if len(fields) > 1 else ""
+        if kind == "START":
+            dump = {"ids": {}, "tasks": {}, "events": [], "complete": False}
+        elif dump is None:
+            continue
+        elif kind == "ID":
+            dump["ids"][int(fields[2])] = ",".join(fields[3:])
+        elif kind == "TASK":
+            dump["tasks"][int(fields[2], 16)] = ",".join(fields[3:])
+        elif kind == "EV" and len(fields) == 8:
+            core, time_us, task, trace_id, ev_type, arg = fields[2:]
+            dump["events"].append((int(time_us), int(core), int(task, 16), int(trace_id), ev_type, int(arg)))
+        elif kind == "END":
+            dump["complete"] = True
+    return dump
+
+
+def to_chrome(dump):
+    events = sorted(dump["events"])
+    tids = {}
+    chrome = [{"name": "process_name", "ph": "M", "pid": 0, "args": {"name": "CrazyCapyTime"}}]
+
+    def tid_of(task):
+        if task not in tids:
+            tids[task] = len(tids) + 1
+            name = dump["tasks"].get(task, "task %08x" % task)
+            chrome.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": tids[task], "args": {"name": name}})
+        return tids[task]
+
+    depth = {}
+    for time_us, core, task, trace_id, ev_type, arg in events:
+        name = dump["ids"].get(trace_id, "id %d" % trace_id)
+        tid = tid_of(task)
+        if ev_type == "C":
+            chrome.append({"name": name, "ph": "C", "ts": time_us, "pid": 0, "args": {"value": arg}})
+            continue
+        if ev_type == "E":
+            # The begin may have been overwritten in the ring buffer
+            if depth.get(tid, 0) == 0:
+                continue
+            depth[tid] -= 1
+        elif ev_type == "B":
+            depth[tid] = depth.get(tid, 0) + 1
+        event = {"name": name, "ph": ev_type, "ts": time_us, "pid": 0, "tid": tid, "args": {"core": core}}
+        if ev_type != "E":
+            event["args"]["arg"] = ("0x%x" % arg) if name in MSG_TYPE_IDS else arg
+        if ev_type == "i":
+            event["s"] = "t"
+        chrome.append(event)
+    return {"traceEvents": chrome, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) > 2:
+        sys.exit("Usage: %s [log or trace file] > trace.json" % sys.argv[0])
+    if len(sys.argv) == 2:
+        with open(sys.argv[1], errors="replace") as f:
+            dump = read_dump(f)
+    else:
+        dump = read_dump(sys.stdin)
+    if dump is None:
+        sys.exit("No TRACE,START found")
+    if not dump["complete"]:
+        print("WARNING: Dump has no TRACE,END, it is cut short", file=sys.stderr)
+    json.dump(to_chrome(dump), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()